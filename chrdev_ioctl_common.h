@@ -22,4 +22,196 @@ struct chrdev_ioctl_out_args {
     int64_t val2;  // 第二个传出int64_t参数
 };
 
+// 4. 共享内存采样环（mmap）
+// 内核线程按固定周期查询计数器，把(tsc, tx, rx)写入环中，用户态通过mmap无syscall读取。
+// 布局：偏移0为chrdev_ring_header（占CHRDEV_RING_HDR_SIZE字节），其后为nr_slots个chrdev_ring_sample。
+// 生产者（内核）只写head/overrun，消费者（用户态）只写tail；head - tail == nr_slots 时环满，
+// 新采样被丢弃并累加overrun，保证丢失的采样能被上报而不是被静默覆盖。
+// depth > 1 时为异步流水线：内核线程每个周期为每个目标提交一个异步固件命令（mlx5_cmd_exec_cb），
+// 不等待完成，最多depth个命令同时在途；命令完成回调中记录完成时刻并写入环，
+// 因此采样间隔可以小于一个固件命令的往返延迟。在途命令已满时提交等待空闲槽位（实际速率受限于固件吞吐）。
+// 两种模式都在环头中累计每个固件命令的延迟统计，可用于观察固件命令的争用。
+#define CHRDEV_IOCTL_RING_CONFIG _IOW(CHRDEV_MAGIC, 0x02, struct chrdev_ring_config)
+#define CHRDEV_IOCTL_RING_START  _IO(CHRDEV_MAGIC, 0x03)
+#define CHRDEV_IOCTL_RING_STOP   _IO(CHRDEV_MAGIC, 0x04)
+
+#define CHRDEV_RING_MAGIC        0x52425752u  // "RWBR"
+#define CHRDEV_RING_VERSION      3
+#define CHRDEV_RING_HDR_SIZE     4096
+#define CHRDEV_RING_MAX_SLOTS    (1u << 22)
+#define CHRDEV_RING_MIN_PERIOD   1000         // 最小采样周期（纳秒）
+#define CHRDEV_RING_MAX_DEPTH    32           // 异步流水线最多同时在途的命令数
+#define CHRDEV_RING_LAT_BUCKETS  16           // 命令延迟直方图：桶k为[2^(k-1), 2^k)微秒，桶0为<1微秒
+
+struct chrdev_ring_config {  // 已BIND_TARGET时忽略bus/slot/func
+    int bus;
+    int slot;
+    int func;
+    __u32 period_ns;   // 采样周期（纳秒），可在停止状态下重新配置
+    __u32 nr_slots;    // 槽位数（2的幂），首次配置后不可修改
+    __u32 depth;       // 同时在途的固件命令数：0或1为同步查询，>1为异步流水线（不超过CHRDEV_RING_MAX_DEPTH）
+};
+
+// 每个周期对每个绑定的目标各写一条记录，target为其在绑定数组中的下标
+// 异步流水线中记录按完成顺序写入，同一目标的tsc仍然递增
+struct chrdev_ring_sample {
+    __u64 tsc;          // 采样时刻：同步为固件查询前后rdtsc的中点；异步为提交到完成回调的中点
+    __u64 tx;           // 发送计数（单位同val1：4字节）
+    __u64 rx;           // 接收计数（单位同val2：4字节）
+    __u32 read_cycles;  // 本次固件查询耗时（TSC周期）：同步为命令耗时，异步为提交到完成（含排队）
+    __u32 target;
+};
+
+struct chrdev_ring_header {
+    __u32 magic;
+    __u32 version;
+    __u32 nr_slots;
+    __u32 period_ns;
+    __u32 running;
+    __u32 nr_targets;   // 每个周期写入的记录数（绑定的目标数）
+    __u32 pad0[10];
+    // 生产者写（独占一个cache line）
+    __u64 head;         // 已写入的采样总数
+    __u64 overrun;      // 因环满（或异步流水线中同一目标乱序完成）被丢弃的采样数
+    __u64 pad1[6];
+    // 消费者写（独占一个cache line）
+    __u64 tail;         // 已读取的采样总数
+    __u64 pad2[7];
+    // 固件命令统计（生产者写，累计值）
+    __u32 depth;        // 生效的在途命令数上限
+    __u32 inflight_max; // 观察到的最大在途命令数
+    __u64 cmds;         // 已完成的命令数（含失败）
+    __u64 cmd_errors;   // 失败的命令数（对应的采样不写入环）
+    __u64 lat_sum;      // 提交到完成的耗时之和（TSC周期）
+    __u64 lat_max;      // 最大耗时（TSC周期）
+    __u64 lat_hist[CHRDEV_RING_LAT_BUCKETS];
+};
+
+// 5. 绑定采样目标（每个打开的文件一组）
+// 绑定时解析domain:bus:slot.func并持有设备引用，之后GET_TWO_INT64不再做PCI查找，
+// 忽略传入的bus/slot/func，直接查询第一个绑定的目标；文件关闭时释放引用。
+// BIND_TARGET等价于只含一个目标的BIND_TARGETS。
+// SR-IOV：vport选择查询的vport，0为PF自身，n为第n-1个VF（需要PF是vport group manager）；
+// 一个PF的多个VF各占一个目标，GET_BATCH在内核中依次查询，不需要每个VF一次系统调用。
+#define CHRDEV_IOCTL_BIND_TARGET   _IOW(CHRDEV_MAGIC, 0x05, struct chrdev_target)
+#define CHRDEV_IOCTL_UNBIND_TARGET _IO(CHRDEV_MAGIC, 0x06)
+#define CHRDEV_IOCTL_BIND_TARGETS  _IOW(CHRDEV_MAGIC, 0x07, struct chrdev_target_set)
+
+// 每个文件最多绑定的(NIC, 端口, vport)数；chrdev_batch须小于ioctl编码的16KB上限
+#define CHRDEV_MAX_TARGETS 256
+
+struct chrdev_target {
+    int domain;
+    int bus;
+    int slot;
+    int func;
+    int port;      // 物理端口号（从1开始），0视为1
+    int vport;     // 0：PF自身；n：VF n-1
+};
+
+struct chrdev_target_set {
+    __u32 nr;
+    __u32 reserved;
+    struct chrdev_target targets[CHRDEV_MAX_TARGETS];
+};
+
+// 6. 批量查询：一次内核调用依次查询所有绑定目标的计数器，counters[i]对应第i个目标
+// 内核只回写nr以及前nr个元素；单个目标查询失败时填写err，不影响其他目标。
+#define CHRDEV_IOCTL_GET_BATCH _IOR(CHRDEV_MAGIC, 0x08, struct chrdev_batch)
+
+#define CHRDEV_COUNTER_CACHED 0x1   // 计数器来自其他请求的查询结果（见SET_MAX_AGE）
+
+// tsc/bracket_cycles在内核中紧贴固件命令读取，不包含系统调用进出、copy_from_user等开销，
+// 用户态可以据此剔除时间不确定度过大的采样
+struct chrdev_counter {
+    __u64 tx;      // 发送计数（单位：4字节）
+    __u64 rx;      // 接收计数（单位：4字节）
+    __u64 tsc;     // 产生该计数器的固件查询前后rdtsc的中点
+    __s32 err;     // 0或负的errno
+    __u32 flags;   // CHRDEV_COUNTER_*
+    __u32 bracket_cycles;  // 固件查询前后rdtsc之差（采样时刻的不确定区间），缓存结果为0
+    __u32 hw_khz;          // 设备时钟频率（kHz），没有hw_clock时为0
+    __u64 hw_clock;        // 固件查询前后设备内部时钟的中点（CHRDEV_OPT_HW_CLOCK），否则为0
+};
+
+struct chrdev_batch {
+    __u32 nr;
+    __u32 reserved;
+    struct chrdev_counter counters[CHRDEV_MAX_TARGETS];
+};
+
+// 7. 内核窗口统计：内核线程按周期采样所有绑定目标，每个窗口结束时生成一条汇总记录，
+// 用户态通过read()/poll()读取（每个窗口唤醒一次），不需要独占一个自旋的CPU核心。
+// 记录 = chrdev_summary + nr_targets个chrdev_summary_target（每个目标的RX/TX峰值、TOP-K、直方图）。
+// read()返回尽可能多的完整记录（缓冲区小于一条记录时返回-EINVAL），没有记录时阻塞（O_NONBLOCK返回-EAGAIN），
+// 停止后读完剩余记录返回0。内核最多缓存CHRDEV_SUMMARY_SLOTS条，读取落后时丢弃最旧的并累加lost。
+#define CHRDEV_IOCTL_SUMMARY_START _IOW(CHRDEV_MAGIC, 0x09, struct chrdev_summary_config)
+#define CHRDEV_IOCTL_SUMMARY_STOP  _IO(CHRDEV_MAGIC, 0x0a)
+
+#define CHRDEV_SUMMARY_MAGIC      0x4d555342u  // "BSUM"
+#define CHRDEV_SUMMARY_VERSION    1
+#define CHRDEV_SUMMARY_SLOTS      8
+#define CHRDEV_SUMMARY_TOPK       8
+#define CHRDEV_SUMMARY_MIN_WINDOW 1           // 最小窗口（毫秒）
+// 直方图：单位Mbps，每个2的幂区间等分4个子桶（相对误差约25%），最大可区分2^21 Mbps
+#define CHRDEV_SUMMARY_SUB_BITS   2
+#define CHRDEV_SUMMARY_SUB        (1 << CHRDEV_SUMMARY_SUB_BITS)
+#define CHRDEV_SUMMARY_MAX_EXP    20
+#define CHRDEV_SUMMARY_BUCKETS    (CHRDEV_SUMMARY_SUB + \
+                                   (CHRDEV_SUMMARY_MAX_EXP - CHRDEV_SUMMARY_SUB_BITS + 1) * CHRDEV_SUMMARY_SUB)
+
+struct chrdev_summary_config {  // 采样所有已绑定的目标（必须先BIND_TARGET(S)）
+    __u32 period_ns;   // 采样周期（纳秒），不小于CHRDEV_RING_MIN_PERIOD
+    __u32 window_ms;   // 窗口长度（毫秒）
+    __u32 reserved[2];
+};
+
+struct chrdev_summary_top {
+    __u32 mbps;        // 相邻两次采样之间的平均速率
+    __u32 offset_us;   // 该采样距窗口开始的时间
+};
+
+struct chrdev_summary_dir {
+    __u64 bytes;                                        // 窗口内的总字节数
+    __u32 peak_mbps;
+    __u32 mean_mbps;                                    // bytes / 窗口长度
+    struct chrdev_summary_top top[CHRDEV_SUMMARY_TOPK]; // 降序，不足时mbps为0
+    __u32 hist[CHRDEV_SUMMARY_BUCKETS];
+};
+
+struct chrdev_summary_target {
+    struct chrdev_summary_dir rx;
+    struct chrdev_summary_dir tx;
+    __u32 samples;     // 窗口内有效的速率采样数
+    __u32 errors;      // 查询失败次数
+};
+
+struct chrdev_summary {
+    __u32 magic;
+    __u32 version;
+    __u32 size;        // 本条记录的总字节数
+    __u32 nr_targets;
+    __u64 seq;         // 窗口序号（从0开始，有间隔说明被丢弃）
+    __u64 start_ns;    // 窗口起止（CLOCK_MONOTONIC）
+    __u64 end_ns;
+    __u64 lost;        // 累计因读取落后被丢弃的窗口数
+    __u32 period_ns;
+    __u32 missed;      // 本窗口内错过的采样周期数
+    __u32 max_read_ns; // 本窗口内最慢的一轮查询
+    __u32 reserved;
+    struct chrdev_summary_target targets[];
+};
+
+// 8. 请求合并：同一(NIC, 端口)的所有使用者（其他打开的文件、采样环、窗口统计）共享最近一次查询结果。
+// 设置后本文件的GET_TWO_INT64/GET_BATCH在缓存不超过max_age_ns时直接返回缓存（tsc为缓存的采样时刻），
+// 否则发起查询；同一NIC同时只有一个合并的查询在进行，等待的请求使用它的结果。
+// 0（默认，模块参数coalesce_ns可修改）表示每次都查询固件。
+#define CHRDEV_IOCTL_SET_MAX_AGE _IOW(CHRDEV_MAGIC, 0x0b, __u32)
+
+// 9. 本文件GET_BATCH的可选项（CHRDEV_OPT_*按位或，默认0）
+// HW_CLOCK：每次固件查询前后各读一次网卡内部时钟（两次PCIe读），填写chrdev_counter.hw_clock/hw_khz
+#define CHRDEV_IOCTL_SET_OPTIONS _IOW(CHRDEV_MAGIC, 0x0c, __u32)
+
+#define CHRDEV_OPT_HW_CLOCK 0x1
+
 #endif // CHRDEV_IOCTL_COMMON_H
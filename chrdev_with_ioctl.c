@@ -3,6 +3,23 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/uaccess.h>  // 用于copy_to_user
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/math64.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/moduleparam.h>
+#include <linux/atomic.h>
+#include <linux/rwsem.h>
+#include <linux/pci.h>
+#include <linux/notifier.h>
+#include <asm/tsc.h>        // 用于rdtsc_ordered、tsc_khz
 #include "chrdev_ioctl_common.h"  // 包含共用头文件
 #include <linux/mlx5/vport.h>
 
@@ -16,20 +33,1181 @@ static dev_t dev_num;                      // 设备号（主+次）
 static struct cdev chr_dev;                // 字符设备对象
 static struct class *dev_class;            // 设备类
 static struct device *dev_device;
-struct mlx5_ifc_query_vport_counter_out_bits out;
 
-// 核心：ioctl实现（无传入参数，两个int64_t传出参数）
-static long chr_dev_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+// 新打开的文件默认的合并窗口（纳秒），0表示不合并
+static unsigned int coalesce_ns;
+module_param(coalesce_ns, uint, 0644);
+MODULE_PARM_DESC(coalesce_ns, "default max age (ns) of a shared counter query reused by other requests, 0 = off");
+
+#define MLX5_SUM_CNT(p, cntr1, cntr2)   \
+        (MLX5_GET64(query_vport_counter_out, p, cntr1) + \
+        MLX5_GET64(query_vport_counter_out, p, cntr2))
+
+// 一个(NIC, 端口, vport)：所有打开的文件、采样环和窗口统计共享同一个实例，按引用计数释放
+// 同时缓存最近一次固件查询的结果，供允许一定陈旧度的请求直接使用（合并固件命令）
+// mdev只在mlx5_core绑定期间有效：解绑时（BUS_NOTIFY_UNBIND_DRIVER）置gone并等待正在使用mdev的
+// 查询和在途的异步命令结束，之后该实例上的查询都返回-ENODEV，重新绑定后需要重新绑定目标
+struct chrdev_nic {
+    struct list_head node;               // 解绑后移出nic_list，不再被新的绑定找到
+    int refs;                            // nic_lock保护
+    struct pci_dev *pdev;                // 持有引用，最后一个使用者释放时put
+    struct mlx5_core_dev *mdev;
+    u32 hw_khz;                          // 设备时钟频率（绑定时读取）
+    struct rw_semaphore unbind_sem;      // 使用mdev的同步查询持有读锁，解绑时持有写锁
+    bool gone;                           // 驱动已解绑，unbind_sem保护
+    atomic_t async_inflight;             // 在途的异步命令数，解绑时等待归零
+    wait_queue_head_t async_wq;
+    u8 port;
+    u16 vport;                           // 0为PF自身，n为VF n-1
+    struct mutex query_lock;             // 合并的请求同一时刻只发一个固件命令
+    spinlock_t cache_lock;               // 保护下面的缓存（异步命令的完成回调也会更新，需关中断）
+    u64 cache_tx;
+    u64 cache_rx;
+    u64 cache_tsc;                       // 缓存结果的采样时刻（查询前后rdtsc的中点）
+    u64 cache_hw;                        // 缓存结果的设备时钟（未读取为0）
+    u64 cache_ns;                        // 缓存结果的完成时刻（ktime），0表示没有缓存
+};
+
+static LIST_HEAD(nic_list);
+static DEFINE_MUTEX(nic_lock);
+
+// 一个已解析的采样目标（NIC + 端口）
+struct chrdev_bound {
+    struct chrdev_nic *nic;              // 持有引用，解绑或释放时put
+};
+
+// 一次查询的结果
+struct chrdev_reading {
+    u64 tx;
+    u64 rx;
+    u64 tsc;                             // 固件查询前后rdtsc的中点
+    u32 cycles;                          // 固件查询耗时（TSC周期），0表示来自缓存
+    u64 hw;                              // 固件查询前后设备内部时钟的中点（CHRDEV_OPT_HW_CLOCK），否则为0
+};
+
+struct chrdev_ring;
+
+// 异步流水线中的一个在途命令槽位
+struct chrdev_async_cmd {
+    struct mlx5_async_work work;         // 提交后到完成回调返回之前必须保持有效
+    struct chrdev_ring *ring;
+    u32 target;
+    bool busy;                           // 提交线程置位，完成回调清除
+    u64 t_submit;                        // 提交时刻（TSC）
+    u32 in[MLX5_ST_SZ_DW(query_vport_counter_in)];
+    u32 out[MLX5_ST_SZ_DW(query_vport_counter_out)];
+};
+
+// 采样环（每个打开的文件一个，由内核线程按周期填充）
+struct chrdev_ring {
+    struct chrdev_ring_header *hdr;      // vmalloc_user分配，mmap给用户态
+    struct chrdev_ring_sample *samples;
+    size_t size;                         // 映射总大小（页对齐）
+    u32 mask;
+    u32 period_ns;
+    struct chrdev_bound targets[CHRDEV_MAX_TARGETS];  // 配置时从文件复制（各自持有引用）
+    u32 nr_targets;
+    void *out;                           // 采样线程专用的固件输出缓冲区
+    struct task_struct *thread;
+
+    // 异步流水线（depth > 1，启动时分配，停止时等待所有在途命令完成后释放）
+    u32 depth;
+    struct mlx5_async_ctx *actx;         // 每个目标一个（异步上下文绑定到目标所在的设备）
+    struct chrdev_async_cmd *cmds;       // depth个槽位
+    atomic_t inflight;
+    wait_queue_head_t async_wq;          // 完成回调释放槽位时唤醒提交线程
+    spinlock_t push_lock;                // 完成回调可能在多个CPU上并发，写环和统计时串行化
+    u64 last_tsc[CHRDEV_MAX_TARGETS];    // 每个目标已写入环的最新采样时刻，push_lock保护
+};
+
+#define SUMMARY_REC_MAX (sizeof(struct chrdev_summary) + \
+                         CHRDEV_MAX_TARGETS * sizeof(struct chrdev_summary_target))
+
+// 窗口统计（每个打开的文件一个，首次启动时分配，文件释放时才销毁，read/poll可以直接持有指针）
+struct chrdev_summary_state {
+    struct chrdev_bound targets[CHRDEV_MAX_TARGETS];  // 启动时从文件复制（各自持有引用）
+    u32 nr_targets;
+    u32 period_ns;
+    u64 window_ns;
+    size_t rec_size;                     // 当前目标数下一条记录的字节数
+    void *out;                           // 采样线程专用的固件输出缓冲区
+    struct task_struct *thread;
+    bool running;
+
+    // 采样线程私有：正在累计的窗口和每个目标的上一次采样
+    struct chrdev_summary *cur;
+    u64 seq;
+    u64 prev_ns[CHRDEV_MAX_TARGETS];
+    u64 prev_tx[CHRDEV_MAX_TARGETS];
+    u64 prev_rx[CHRDEV_MAX_TARGETS];
+    bool have_prev[CHRDEV_MAX_TARGETS];
+
+    // 已完成的窗口（q_lock保护，read时在锁内copy_to_user，因此用mutex）
+    struct mutex q_lock;
+    void *slots;                         // CHRDEV_SUMMARY_SLOTS条最大长度的记录
+    u64 head;
+    u64 tail;
+    u64 lost;
+    wait_queue_head_t wq;
+};
+
+// 每个打开的文件的私有状态
+struct chrdev_file {
+    struct mutex lock;                   // 保护ring/summary的配置/启停、目标的绑定/解绑以及out
+    struct chrdev_ring *ring;
+    struct chrdev_summary_state *summary;
+    struct chrdev_bound targets[CHRDEV_MAX_TARGETS];
+    u32 nr_targets;
+    u64 max_age_ns;                      // 允许使用的缓存的最大陈旧度，0表示总是查询固件
+    u32 options;                         // CHRDEV_OPT_*（SET_OPTIONS）
+    void *out;                           // 本文件ioctl专用的固件输出缓冲区（不同文件可以并发查询）
+};
+
+// 设备当前是否绑定在mlx5_core上（调用者持有device_lock，与解绑互斥）
+static bool chrdev_is_mlx5(struct pci_dev *pdev)
 {
-    // 1. 校验命令码的魔数和命令号合法性
-    if (_IOC_TYPE(cmd) != CHRDEV_MAGIC) {
-        printk(KERN_ERR "ioctl magic number error!\n");
-        return -EINVAL;  // 非法参数
+    struct pci_driver *drv = pci_dev_driver(pdev);
+
+    return drv && !strcmp(drv->name, "mlx5_core") && pci_get_drvdata(pdev);
+}
+
+// 查找或创建(NIC, 端口, vport)并增加引用
+// 锁顺序：device_lock → nic_lock（解绑通知在device_lock下调用，随后取nic_lock）
+static struct chrdev_nic *chrdev_nic_get(int domain, int bus, unsigned int devfn, u8 port, u16 vport)
+{
+    struct chrdev_nic *nic;
+    struct pci_dev *pdev = pci_get_domain_bus_and_slot(domain, bus, devfn);
+
+    if (!pdev)
+        return ERR_PTR(-ENODEV);
+    device_lock(&pdev->dev);
+    mutex_lock(&nic_lock);
+    list_for_each_entry(nic, &nic_list, node) {
+        if (nic->pdev == pdev && nic->port == port && nic->vport == vport) {
+            nic->refs++;
+            goto out;
+        }
+    }
+    // 只接受绑定在mlx5_core上的设备，其drvdata即mlx5_core_dev
+    if (!chrdev_is_mlx5(pdev)) {
+        nic = ERR_PTR(-ENODEV);
+        goto out;
     }
-    if (_IOC_NR(cmd) != 0x01) {
-        printk(KERN_ERR "ioctl command number error!\n");
+    // 只允许查询已启用的VF
+    if (vport > pci_num_vf(pdev)) {
+        nic = ERR_PTR(-ERANGE);
+        goto out;
+    }
+    nic = kzalloc(sizeof(*nic), GFP_KERNEL);
+    if (!nic) {
+        nic = ERR_PTR(-ENOMEM);
+        goto out;
+    }
+    nic->refs = 1;
+    nic->pdev = pci_dev_get(pdev);
+    nic->mdev = pci_get_drvdata(pdev);
+    nic->hw_khz = MLX5_CAP_GEN(nic->mdev, device_frequency_khz);
+    nic->port = port;
+    nic->vport = vport;
+    mutex_init(&nic->query_lock);
+    spin_lock_init(&nic->cache_lock);
+    init_rwsem(&nic->unbind_sem);
+    atomic_set(&nic->async_inflight, 0);
+    init_waitqueue_head(&nic->async_wq);
+    list_add(&nic->node, &nic_list);
+out:
+    mutex_unlock(&nic_lock);
+    device_unlock(&pdev->dev);
+    pci_dev_put(pdev);   // 实例持有自己的引用
+    return nic;
+}
+
+// 开始使用mdev（同步查询），驱动已解绑时返回false
+static bool chrdev_nic_enter(struct chrdev_nic *nic)
+{
+    down_read(&nic->unbind_sem);
+    if (nic->gone) {
+        up_read(&nic->unbind_sem);
+        return false;
+    }
+    return true;
+}
+
+static void chrdev_nic_exit(struct chrdev_nic *nic)
+{
+    up_read(&nic->unbind_sem);
+}
+
+// mlx5_core即将从设备解绑：使用该设备的实例都置为gone，等待正在进行的查询和在途的异步命令结束
+static int chrdev_pci_notify(struct notifier_block *nb, unsigned long action, void *data)
+{
+    struct pci_dev *pdev = to_pci_dev(data);
+    struct chrdev_nic *nic, *tmp;
+
+    if (action != BUS_NOTIFY_UNBIND_DRIVER)
+        return NOTIFY_DONE;
+    mutex_lock(&nic_lock);
+    list_for_each_entry_safe(nic, tmp, &nic_list, node) {
+        if (nic->pdev != pdev)
+            continue;
+        down_write(&nic->unbind_sem);
+        nic->gone = true;
+        up_write(&nic->unbind_sem);
+        wait_event(nic->async_wq, !atomic_read(&nic->async_inflight));
+        nic->mdev = NULL;
+        list_del_init(&nic->node);
+        printk(KERN_INFO "mlx5 device %s unbound, target port %u vport %u detached\n",
+               pci_name(pdev), nic->port, nic->vport);
+    }
+    mutex_unlock(&nic_lock);
+    return NOTIFY_OK;
+}
+
+static struct notifier_block chrdev_pci_nb = {
+    .notifier_call = chrdev_pci_notify,
+};
+
+static void chrdev_nic_hold(struct chrdev_nic *nic)
+{
+    mutex_lock(&nic_lock);
+    nic->refs++;
+    mutex_unlock(&nic_lock);
+}
+
+static void chrdev_nic_put(struct chrdev_nic *nic)
+{
+    mutex_lock(&nic_lock);
+    if (--nic->refs) {
+        mutex_unlock(&nic_lock);
+        return;
+    }
+    list_del_init(&nic->node);
+    mutex_unlock(&nic_lock);
+    pci_dev_put(nic->pdev);
+    kfree(nic);
+}
+
+// 按domain:bus:slot.func查找mlx5设备并持有引用
+static int chrdev_bind_one(struct chrdev_bound *b, const struct chrdev_target *t)
+{
+    int port = t->port ? t->port : 1;
+    struct chrdev_nic *nic;
+
+    if (t->domain < 0 || t->bus < 0 || t->bus > 0xff || t->slot < 0 || t->slot > 0x1f ||
+        t->func < 0 || t->func > 7 || port < 1 || port > 0xff || t->vport < 0 || t->vport > 0xffff)
         return -EINVAL;
+    nic = chrdev_nic_get(t->domain, t->bus, PCI_DEVFN(t->slot, t->func), port, t->vport);
+    if (IS_ERR(nic))
+        return PTR_ERR(nic);
+    b->nic = nic;
+    return 0;
+}
+
+static void chrdev_put_targets(struct chrdev_bound *targets, u32 *nr)
+{
+    u32 i;
+
+    for (i = 0; i < *nr; i++) {
+        chrdev_nic_put(targets[i].nic);
+        targets[i].nic = NULL;
+    }
+    *nr = 0;
+}
+
+static void chrdev_unbind_target(struct chrdev_file *cf)
+{
+    chrdev_put_targets(cf->targets, &cf->nr_targets);
+}
+
+// 绑定一组目标：全部解析成功才替换原有绑定
+static long chrdev_bind_targets(struct chrdev_file *cf, const struct chrdev_target *t, u32 nr)
+{
+    struct chrdev_bound *b;
+    u32 i, done = 0;
+    int err = 0;
+
+    if (!nr || nr > CHRDEV_MAX_TARGETS)
+        return -EINVAL;
+    b = kcalloc(nr, sizeof(*b), GFP_KERNEL);
+    if (!b)
+        return -ENOMEM;
+    for (i = 0; i < nr && !err; i++) {
+        err = chrdev_bind_one(&b[i], &t[i]);
+        if (!err)
+            done++;
+    }
+    if (err) {
+        chrdev_put_targets(b, &done);
+    } else {
+        chrdev_unbind_target(cf);
+        memcpy(cf->targets, b, nr * sizeof(*b));
+        cf->nr_targets = nr;
     }
+    kfree(b);
+    return err;
+}
+
+static long chrdev_ioctl_bind_target(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_target t;
+
+    if (copy_from_user(&t, (void __user *)arg, sizeof(t)))
+        return -EFAULT;
+    return chrdev_bind_targets(cf, &t, 1);
+}
+
+static long chrdev_ioctl_bind_targets(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_target_set *set;
+    long ret;
+
+    set = kmalloc(sizeof(*set), GFP_KERNEL);
+    if (!set)
+        return -ENOMEM;
+    if (copy_from_user(set, (void __user *)arg, sizeof(*set)))
+        ret = -EFAULT;
+    else
+        ret = chrdev_bind_targets(cf, set->targets, set->nr);
+    kfree(set);
+    return ret;
+}
+
+// 从query_vport_counter_out中取出收发字节数（单位：4字节）
+static void chrdev_read_octets(const void *outbuf, struct chrdev_reading *r)
+{
+    r->tx = MLX5_SUM_CNT(outbuf, transmitted_ib_unicast.octets,
+                         transmitted_ib_multicast.octets) >> 2;
+    r->rx = MLX5_SUM_CNT(outbuf, received_ib_unicast.octets,
+                         received_ib_multicast.octets) >> 2;
+}
+
+// 用一次固件查询的结果更新NIC的缓存（也在异步命令的完成回调中调用）
+static void chrdev_nic_update_cache(struct chrdev_nic *nic, const struct chrdev_reading *r)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&nic->cache_lock, flags);
+    // 并发的查询可能乱序完成，只保留较新的结果
+    if (r->tsc > nic->cache_tsc) {
+        nic->cache_tx = r->tx;
+        nic->cache_rx = r->rx;
+        nic->cache_tsc = r->tsc;
+        nic->cache_hw = r->hw;
+        nic->cache_ns = ktime_get_ns();
+    }
+    spin_unlock_irqrestore(&nic->cache_lock, flags);
+}
+
+// 读取设备内部时钟（初始化段中的64位自由运行计数器，频率为device_frequency_khz）
+// 高低两半分两次读取，高位在两次读之间变化时重读低位
+static u64 chrdev_read_hw_clock(struct mlx5_core_dev *mdev)
+{
+    u32 h1, l, h2;
+
+    h1 = ioread32be(&mdev->iseg->internal_timer_h);
+    l = ioread32be(&mdev->iseg->internal_timer_l);
+    h2 = ioread32be(&mdev->iseg->internal_timer_h);
+    if (h1 != h2)
+        l = ioread32be(&mdev->iseg->internal_timer_l);
+    return (u64)h2 << 32 | l;
+}
+
+// 查询一次vport计数器（单位：4字节），并更新NIC的缓存
+// outbuf由调用者提供：每个文件、采样环和窗口统计各有一个，互不共享，因此可以并发查询
+// rdtsc紧贴固件命令，区间只包含命令本身；设备时钟（每次读取是一次PCIe往返）读在TSC区间之外，不加宽它
+static int chrdev_nic_query_fw(struct chrdev_nic *nic, void *outbuf, u32 opts, struct chrdev_reading *r)
+{
+    u64 t1, t2, hw1 = 0, hw2 = 0;
+    int err;
+
+    if (!chrdev_nic_enter(nic))
+        return -ENODEV;
+    if (opts & CHRDEV_OPT_HW_CLOCK)
+        hw1 = chrdev_read_hw_clock(nic->mdev);
+    t1 = rdtsc_ordered();
+    // other_vport时vf参数为VF下标（固件vport号 = vf + 1）
+    err = mlx5_core_query_vport_counter(nic->mdev, nic->vport != 0, nic->vport - 1, nic->port, outbuf);
+    t2 = rdtsc_ordered();
+    if (opts & CHRDEV_OPT_HW_CLOCK)
+        hw2 = chrdev_read_hw_clock(nic->mdev);
+    chrdev_nic_exit(nic);
+    if (err)
+        return err;
+    chrdev_read_octets(outbuf, r);
+    r->tsc = t1 + ((t2 - t1) >> 1);
+    r->cycles = max_t(u64, min_t(u64, t2 - t1, U32_MAX), 1);
+    r->hw = hw1 ? hw1 + ((hw2 - hw1) >> 1) : 0;
+    chrdev_nic_update_cache(nic, r);
+    return 0;
+}
+
+static bool chrdev_nic_cached(struct chrdev_nic *nic, u64 max_age_ns, struct chrdev_reading *r)
+{
+    u64 now = ktime_get_ns();
+    unsigned long flags;
+    bool hit;
+
+    spin_lock_irqsave(&nic->cache_lock, flags);
+    hit = nic->cache_ns && now - nic->cache_ns <= max_age_ns;
+    if (hit) {
+        r->tx = nic->cache_tx;
+        r->rx = nic->cache_rx;
+        r->tsc = nic->cache_tsc;
+        r->hw = nic->cache_hw;
+        r->cycles = 0;
+    }
+    spin_unlock_irqrestore(&nic->cache_lock, flags);
+    return hit;
+}
+
+// 查询一个目标：max_age_ns为0时总是查询固件；
+// 否则缓存不超过max_age_ns时直接返回缓存，并且同一NIC同时只发一个合并的固件命令，
+// 在query_lock上等待的请求拿到锁后通常会命中刚刚更新的缓存
+static int chrdev_query_counters(const struct chrdev_bound *b, void *outbuf, u64 max_age_ns,
+                                 u32 opts, struct chrdev_reading *r)
+{
+    struct chrdev_nic *nic = b->nic;
+    int err = 0;
+
+    if (!max_age_ns)
+        return chrdev_nic_query_fw(nic, outbuf, opts, r);
+    if (chrdev_nic_cached(nic, max_age_ns, r))
+        return 0;
+    mutex_lock(&nic->query_lock);
+    if (!chrdev_nic_cached(nic, max_age_ns, r))
+        err = chrdev_nic_query_fw(nic, outbuf, opts, r);
+    mutex_unlock(&nic->query_lock);
+    return err;
+}
+
+// 写入一个采样：单生产者，环满则丢弃并累加overrun
+static void chrdev_ring_push(struct chrdev_ring *ring, u32 target, u64 tsc, u64 tx, u64 rx,
+                             u64 read_cycles)
+{
+    struct chrdev_ring_header *hdr = ring->hdr;
+    u64 head = hdr->head;
+    u64 tail = smp_load_acquire(&hdr->tail);
+    struct chrdev_ring_sample *s;
+
+    if (head - tail >= (u64)ring->mask + 1) {
+        WRITE_ONCE(hdr->overrun, hdr->overrun + 1);
+        return;
+    }
+    s = &ring->samples[head & ring->mask];
+    s->tsc = tsc;
+    s->tx = tx;
+    s->rx = rx;
+    s->read_cycles = min_t(u64, read_cycles, U32_MAX);
+    s->target = target;
+    // 先写数据再发布head，用户态acquire读取head后即可看到完整的采样
+    smp_store_release(&hdr->head, head + 1);
+}
+
+// 累计一个固件命令的延迟（TSC周期），err非0时计为失败
+static void chrdev_ring_cmd_stat(struct chrdev_ring *ring, u64 cycles, int err)
+{
+    struct chrdev_ring_header *hdr = ring->hdr;
+    u64 us = tsc_khz ? div_u64(cycles * 1000, tsc_khz) : 0;
+    int k = us ? min_t(int, fls64(us), CHRDEV_RING_LAT_BUCKETS - 1) : 0;
+
+    WRITE_ONCE(hdr->cmds, hdr->cmds + 1);
+    if (err)
+        WRITE_ONCE(hdr->cmd_errors, hdr->cmd_errors + 1);
+    WRITE_ONCE(hdr->lat_sum, hdr->lat_sum + cycles);
+    if (cycles > hdr->lat_max)
+        WRITE_ONCE(hdr->lat_max, cycles);
+    WRITE_ONCE(hdr->lat_hist[k], hdr->lat_hist[k] + 1);
+}
+
+// 落后超过一个周期时直接对齐到当前时间，不补采；返回false表示线程应退出
+static bool chrdev_ring_sleep(struct chrdev_ring *ring, ktime_t *next)
+{
+    ktime_t now;
+
+    *next = ktime_add_ns(*next, ring->period_ns);
+    now = ktime_get();
+    if (ktime_before(*next, now))
+        *next = now;
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (kthread_should_stop()) {
+        __set_current_state(TASK_RUNNING);
+        return false;
+    }
+    schedule_hrtimeout_range(next, 0, HRTIMER_MODE_ABS);
+    return true;
+}
+
+// 采样线程：按绝对截止时间周期查询（固件命令会睡眠，不能直接在hrtimer回调中执行）
+static int chrdev_ring_thread(void *data)
+{
+    struct chrdev_ring *ring = data;
+    ktime_t next = ktime_get();
+
+    while (!kthread_should_stop()) {
+        struct chrdev_reading r;
+        int err;
+        u32 i;
+
+        // 一个周期内依次查询所有目标，各自记录时间戳（总是查询固件，结果同时供其他请求合并）
+        for (i = 0; i < ring->nr_targets; i++) {
+            u64 t1 = rdtsc_ordered();
+
+            err = chrdev_query_counters(&ring->targets[i], ring->out, 0, 0, &r);
+            chrdev_ring_cmd_stat(ring, err ? rdtsc_ordered() - t1 : r.cycles, err);
+            if (!err)
+                chrdev_ring_push(ring, i, r.tsc, r.tx, r.rx, r.cycles);
+        }
+        if (!chrdev_ring_sleep(ring, &next))
+            break;
+    }
+    return 0;
+}
+
+// 异步命令完成（可能在中断上下文中）：不能睡眠，只解析结果、写环并释放槽位
+static void chrdev_async_done(int status, struct mlx5_async_work *work)
+{
+    struct chrdev_async_cmd *cmd = container_of(work, struct chrdev_async_cmd, work);
+    struct chrdev_ring *ring = cmd->ring;
+    struct chrdev_nic *nic = ring->targets[cmd->target].nic;
+    struct chrdev_reading r;
+    unsigned long flags;
+    u64 done = rdtsc_ordered();
+    bool fresh = false;
+
+    // 较早的内核在固件返回错误状态时仍以status=0回调
+    if (!status && MLX5_GET(mbox_out, cmd->out, status))
+        status = -EIO;
+    spin_lock_irqsave(&ring->push_lock, flags);
+    // 目标可能分布在多个设备上，同一设备的命令也可能占用不同的命令槽位并发执行，
+    // 无法推断命令何时真正开始执行：采样时刻取提交到完成的中点，
+    // 整个区间（含排队）作为不确定度记入cycles，由用户态按区间宽度剔除
+    chrdev_ring_cmd_stat(ring, done - cmd->t_submit, status);
+    if (!status) {
+        chrdev_read_octets(cmd->out, &r);
+        r.tsc = cmd->t_submit + ((done - cmd->t_submit) >> 1);
+        r.cycles = max_t(u64, min_t(u64, done - cmd->t_submit, U32_MAX), 1);
+        r.hw = 0;
+        // 同一目标的命令乱序完成时中点可能早于已写入的采样，丢弃（计入overrun）以保持tsc递增
+        fresh = r.tsc > ring->last_tsc[cmd->target];
+        if (fresh) {
+            ring->last_tsc[cmd->target] = r.tsc;
+            chrdev_ring_push(ring, cmd->target, r.tsc, r.tx, r.rx, r.cycles);
+        } else {
+            WRITE_ONCE(ring->hdr->overrun, ring->hdr->overrun + 1);
+        }
+    }
+    spin_unlock_irqrestore(&ring->push_lock, flags);
+    if (fresh)
+        chrdev_nic_update_cache(nic, &r);
+    if (atomic_dec_and_test(&nic->async_inflight))
+        wake_up(&nic->async_wq);
+
+    // 最后释放槽位：之后提交线程可能立即复用cmd
+    smp_store_release(&cmd->busy, false);
+    atomic_dec(&ring->inflight);
+    wake_up(&ring->async_wq);
+}
+
+// 找一个空闲槽位并占用，没有返回NULL（只有提交线程调用）
+static struct chrdev_async_cmd *chrdev_async_get(struct chrdev_ring *ring)
+{
+    u32 i;
+
+    for (i = 0; i < ring->depth; i++) {
+        struct chrdev_async_cmd *cmd = &ring->cmds[i];
+
+        if (!smp_load_acquire(&cmd->busy)) {
+            cmd->busy = true;
+            return cmd;
+        }
+    }
+    return NULL;
+}
+
+// 提交一个目标的异步查询，与mlx5_core_query_vport_counter构造相同的命令
+static int chrdev_async_submit(struct chrdev_ring *ring, struct chrdev_async_cmd *cmd, u32 target)
+{
+    struct chrdev_nic *nic = ring->targets[target].nic;
+    struct mlx5_core_dev *mdev;
+    u32 inflight;
+    int err;
+
+    // 驱动已解绑时不再提交（计为失败的命令）；提交期间持有读锁，解绑等待在途命令时计数已包含本命令
+    if (!chrdev_nic_enter(nic)) {
+        unsigned long flags;
+
+        spin_lock_irqsave(&ring->push_lock, flags);
+        chrdev_ring_cmd_stat(ring, 0, -ENODEV);
+        spin_unlock_irqrestore(&ring->push_lock, flags);
+        smp_store_release(&cmd->busy, false);
+        return -ENODEV;
+    }
+    mdev = nic->mdev;
+    memset(cmd->in, 0, sizeof(cmd->in));
+    MLX5_SET(query_vport_counter_in, cmd->in, opcode, MLX5_CMD_OP_QUERY_VPORT_COUNTER);
+    if (nic->vport) {
+        MLX5_SET(query_vport_counter_in, cmd->in, other_vport, 1);
+        MLX5_SET(query_vport_counter_in, cmd->in, vport_number, nic->vport);
+    }
+    if (MLX5_CAP_GEN(mdev, num_ports) == 2)
+        MLX5_SET(query_vport_counter_in, cmd->in, port_num, nic->port);
+    cmd->ring = ring;
+    cmd->target = target;
+
+    inflight = atomic_inc_return(&ring->inflight);
+    if (inflight > READ_ONCE(ring->hdr->inflight_max))
+        WRITE_ONCE(ring->hdr->inflight_max, inflight);
+    atomic_inc(&nic->async_inflight);
+    cmd->t_submit = rdtsc_ordered();
+    err = mlx5_cmd_exec_cb(&ring->actx[target], cmd->in, sizeof(cmd->in), cmd->out, sizeof(cmd->out),
+                           chrdev_async_done, &cmd->work);
+    chrdev_nic_exit(nic);
+    if (err) {
+        // 没有提交成功，不会有回调
+        unsigned long flags;
+
+        spin_lock_irqsave(&ring->push_lock, flags);
+        chrdev_ring_cmd_stat(ring, rdtsc_ordered() - cmd->t_submit, err);
+        spin_unlock_irqrestore(&ring->push_lock, flags);
+        smp_store_release(&cmd->busy, false);
+        atomic_dec(&ring->inflight);
+        if (atomic_dec_and_test(&nic->async_inflight))
+            wake_up(&nic->async_wq);
+    }
+    return err;
+}
+
+// 异步流水线采样线程：每个周期为每个目标提交一个命令，不等待完成；
+// 在途命令已满时等待完成回调释放槽位，停止时由chrdev_ring_stop等待剩余的命令
+static int chrdev_ring_async_thread(void *data)
+{
+    struct chrdev_ring *ring = data;
+    ktime_t next = ktime_get();
+
+    while (!kthread_should_stop()) {
+        u32 i;
+
+        for (i = 0; i < ring->nr_targets; i++) {
+            struct chrdev_async_cmd *cmd = NULL;
+
+            wait_event_interruptible(ring->async_wq,
+                                     (cmd = chrdev_async_get(ring)) || kthread_should_stop());
+            if (!cmd)
+                return 0;
+            chrdev_async_submit(ring, cmd, i);
+        }
+        if (!chrdev_ring_sleep(ring, &next))
+            break;
+    }
+    return 0;
+}
+
+// 释放异步流水线：等待所有在途命令的回调结束
+static void chrdev_ring_async_free(struct chrdev_ring *ring)
+{
+    u32 i;
+
+    if (!ring->actx)
+        return;
+    for (i = 0; i < ring->nr_targets; i++)
+        mlx5_cmd_cleanup_async_ctx(&ring->actx[i]);
+    kfree(ring->actx);
+    kfree(ring->cmds);
+    ring->actx = NULL;
+    ring->cmds = NULL;
+}
+
+static int chrdev_ring_async_alloc(struct chrdev_ring *ring)
+{
+    u32 i;
+
+    ring->actx = kcalloc(ring->nr_targets, sizeof(*ring->actx), GFP_KERNEL);
+    ring->cmds = kcalloc(ring->depth, sizeof(*ring->cmds), GFP_KERNEL);
+    if (!ring->actx || !ring->cmds) {
+        kfree(ring->actx);
+        kfree(ring->cmds);
+        ring->actx = NULL;
+        ring->cmds = NULL;
+        return -ENOMEM;
+    }
+    for (i = 0; i < ring->nr_targets; i++) {
+        struct chrdev_nic *nic = ring->targets[i].nic;
+
+        if (!chrdev_nic_enter(nic)) {
+            while (i--)
+                mlx5_cmd_cleanup_async_ctx(&ring->actx[i]);
+            kfree(ring->actx);
+            kfree(ring->cmds);
+            ring->actx = NULL;
+            ring->cmds = NULL;
+            return -ENODEV;
+        }
+        mlx5_cmd_init_async_ctx(nic->mdev, &ring->actx[i]);
+        chrdev_nic_exit(nic);
+    }
+    atomic_set(&ring->inflight, 0);
+    memset(ring->last_tsc, 0, sizeof(ring->last_tsc));
+    return 0;
+}
+
+static void chrdev_ring_stop(struct chrdev_ring *ring)
+{
+    if (!ring->thread)
+        return;
+    kthread_stop(ring->thread);
+    ring->thread = NULL;
+    chrdev_ring_async_free(ring);
+    WRITE_ONCE(ring->hdr->running, 0);
+}
+
+static void chrdev_ring_free(struct chrdev_ring *ring)
+{
+    chrdev_ring_stop(ring);
+    chrdev_put_targets(ring->targets, &ring->nr_targets);
+    kfree(ring->out);
+    vfree(ring->hdr);
+    kfree(ring);
+}
+
+// 配置采样环：首次调用分配内存，之后只允许在停止状态下修改目标设备和周期
+static long chrdev_ioctl_ring_config(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_ring_config cfg;
+    struct chrdev_ring *ring = cf->ring;
+    struct chrdev_bound *targets;
+    u32 nr, i;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+        return -EFAULT;
+    if (cfg.period_ns < CHRDEV_RING_MIN_PERIOD)
+        return -EINVAL;
+    if (!cfg.nr_slots || cfg.nr_slots > CHRDEV_RING_MAX_SLOTS || !is_power_of_2(cfg.nr_slots))
+        return -EINVAL;
+    if (cfg.depth > CHRDEV_RING_MAX_DEPTH)
+        return -EINVAL;
+    if (ring && ring->thread)
+        return -EBUSY;
+    if (ring && ring->mask + 1 != cfg.nr_slots)
+        return -EBUSY;   // 已mmap的内存不能重新分配
+    targets = kcalloc(CHRDEV_MAX_TARGETS, sizeof(*targets), GFP_KERNEL);   // 目标数较多，不放在栈上
+    if (!targets)
+        return -ENOMEM;
+
+    // 已绑定目标时采样所有绑定的目标，否则按cfg中的bus/slot/func查找（端口1）
+    if (cf->nr_targets) {
+        nr = cf->nr_targets;
+        for (i = 0; i < nr; i++) {
+            targets[i] = cf->targets[i];
+            chrdev_nic_hold(targets[i].nic);
+        }
+    } else {
+        struct chrdev_target t = { .bus = cfg.bus, .slot = cfg.slot, .func = cfg.func };
+        int err = chrdev_bind_one(&targets[0], &t);
+        if (err) {
+            kfree(targets);
+            return err;
+        }
+        nr = 1;
+    }
+
+    if (!ring) {
+        ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+        if (!ring)
+            goto err_nomem;
+        ring->out = kzalloc(MLX5_ST_SZ_BYTES(query_vport_counter_out), GFP_KERNEL);
+        ring->size = PAGE_ALIGN(CHRDEV_RING_HDR_SIZE +
+                                (size_t)cfg.nr_slots * sizeof(struct chrdev_ring_sample));
+        ring->hdr = vmalloc_user(ring->size);   // 已清零
+        if (!ring->out || !ring->hdr) {
+            kfree(ring->out);
+            vfree(ring->hdr);
+            kfree(ring);
+            goto err_nomem;
+        }
+        ring->samples = (void *)ring->hdr + CHRDEV_RING_HDR_SIZE;
+        ring->mask = cfg.nr_slots - 1;
+        ring->hdr->magic = CHRDEV_RING_MAGIC;
+        ring->hdr->version = CHRDEV_RING_VERSION;
+        ring->hdr->nr_slots = cfg.nr_slots;
+        init_waitqueue_head(&ring->async_wq);
+        spin_lock_init(&ring->push_lock);
+        cf->ring = ring;
+    }
+
+    chrdev_put_targets(ring->targets, &ring->nr_targets);
+    memcpy(ring->targets, targets, nr * sizeof(targets[0]));
+    ring->nr_targets = nr;
+    WRITE_ONCE(ring->hdr->nr_targets, nr);
+    ring->period_ns = cfg.period_ns;
+    WRITE_ONCE(ring->hdr->period_ns, cfg.period_ns);
+    ring->depth = max_t(u32, cfg.depth, 1);
+    WRITE_ONCE(ring->hdr->depth, ring->depth);
+    kfree(targets);
+    return 0;
+
+err_nomem:
+    chrdev_put_targets(targets, &nr);
+    kfree(targets);
+    return -ENOMEM;
+}
+
+static long chrdev_ioctl_ring_start(struct chrdev_file *cf)
+{
+    struct chrdev_ring *ring = cf->ring;
+    struct task_struct *t;
+
+    if (!ring)
+        return -EINVAL;
+    if (ring->thread)
+        return 0;
+    if (ring->depth > 1) {
+        int err = chrdev_ring_async_alloc(ring);
+
+        if (err)
+            return err;
+        t = kthread_run(chrdev_ring_async_thread, ring, "chrdev_ring_async");
+    } else {
+        t = kthread_run(chrdev_ring_thread, ring, "chrdev_ring");
+    }
+    if (IS_ERR(t)) {
+        chrdev_ring_async_free(ring);
+        return PTR_ERR(t);
+    }
+    ring->thread = t;
+    WRITE_ONCE(ring->hdr->running, 1);
+    return 0;
+}
+
+// ==================== 窗口统计 ====================
+
+// 值（Mbps）到直方图桶下标，与用户态rtbw_hist_index相同的分桶方式
+static inline int chrdev_summary_bucket(u64 v)
+{
+    int e;
+
+    if (v < CHRDEV_SUMMARY_SUB)
+        return v;
+    e = fls64(v) - 1;
+    if (e > CHRDEV_SUMMARY_MAX_EXP)
+        return CHRDEV_SUMMARY_BUCKETS - 1;
+    return CHRDEV_SUMMARY_SUB + (e - CHRDEV_SUMMARY_SUB_BITS) * CHRDEV_SUMMARY_SUB +
+           ((v >> (e - CHRDEV_SUMMARY_SUB_BITS)) & (CHRDEV_SUMMARY_SUB - 1));
+}
+
+// 计入一个速率采样：top[]在窗口内是按mbps的最小堆（全0也是合法的堆），窗口结束时再排序
+static void chrdev_summary_dir_add(struct chrdev_summary_dir *d, u64 bytes, u64 dt_ns, u32 offset_us)
+{
+    struct chrdev_summary_top *top = d->top;
+    u64 mbps = div64_u64(bytes * 8000, dt_ns);
+    u32 v = min_t(u64, mbps, U32_MAX);
+    int i = 0;
+
+    d->bytes += bytes;
+    if (v > d->peak_mbps)
+        d->peak_mbps = v;
+    d->hist[chrdev_summary_bucket(v)]++;
+    if (v <= top[0].mbps)
+        return;
+    // 替换堆顶并下沉
+    for (;;) {
+        int c = 2 * i + 1;
+
+        if (c >= CHRDEV_SUMMARY_TOPK)
+            break;
+        if (c + 1 < CHRDEV_SUMMARY_TOPK && top[c + 1].mbps < top[c].mbps)
+            c++;
+        if (top[c].mbps >= v)
+            break;
+        top[i] = top[c];
+        i = c;
+    }
+    top[i].mbps = v;
+    top[i].offset_us = offset_us;
+}
+
+static void chrdev_summary_dir_finish(struct chrdev_summary_dir *d, u64 window_ns)
+{
+    struct chrdev_summary_top *top = d->top;
+    int i, j;
+
+    d->mean_mbps = min_t(u64, div64_u64(d->bytes * 8000, window_ns), U32_MAX);
+    // TOP-K降序（K很小，插入排序）
+    for (i = 1; i < CHRDEV_SUMMARY_TOPK; i++) {
+        struct chrdev_summary_top x = top[i];
+
+        for (j = i; j > 0 && top[j - 1].mbps < x.mbps; j--)
+            top[j] = top[j - 1];
+        top[j] = x;
+    }
+}
+
+static void chrdev_summary_begin(struct chrdev_summary_state *s, u64 start_ns)
+{
+    struct chrdev_summary *c = s->cur;
+
+    memset(c, 0, s->rec_size);
+    c->magic = CHRDEV_SUMMARY_MAGIC;
+    c->version = CHRDEV_SUMMARY_VERSION;
+    c->size = s->rec_size;
+    c->nr_targets = s->nr_targets;
+    c->period_ns = s->period_ns;
+    c->start_ns = start_ns;
+}
+
+// 结束当前窗口并放入队列（满则丢弃最旧的），然后开始下一个窗口
+static void chrdev_summary_close(struct chrdev_summary_state *s, u64 now_ns)
+{
+    struct chrdev_summary *c = s->cur;
+    u64 end = c->start_ns + s->window_ns;
+    u32 i;
+
+    c->end_ns = end;
+    c->seq = s->seq++;
+    for (i = 0; i < s->nr_targets; i++) {
+        chrdev_summary_dir_finish(&c->targets[i].rx, s->window_ns);
+        chrdev_summary_dir_finish(&c->targets[i].tx, s->window_ns);
+    }
+
+    mutex_lock(&s->q_lock);
+    if (s->head - s->tail == CHRDEV_SUMMARY_SLOTS) {
+        s->tail++;
+        s->lost++;
+    }
+    c->lost = s->lost;
+    memcpy(s->slots + (s->head % CHRDEV_SUMMARY_SLOTS) * SUMMARY_REC_MAX, c, s->rec_size);
+    WRITE_ONCE(s->head, s->head + 1);
+    mutex_unlock(&s->q_lock);
+    wake_up_interruptible(&s->wq);
+
+    // 窗口首尾相接；落后超过一个窗口时（如长时间被抢占）从当前时刻重新开始
+    chrdev_summary_begin(s, now_ns - end < s->window_ns ? end : now_ns);
+}
+
+static void chrdev_summary_add(struct chrdev_summary_state *s, u32 i, u64 t, u64 tx, u64 rx)
+{
+    struct chrdev_summary *c = s->cur;
+
+    if (t >= c->start_ns + s->window_ns)
+        chrdev_summary_close(s, t);
+    c = s->cur;
+    if (s->have_prev[i] && t > s->prev_ns[i]) {
+        struct chrdev_summary_target *st = &c->targets[i];
+        u64 dt = t - s->prev_ns[i];
+        // 计数器单位为4字节；计数器回退（如网卡复位）时记为0
+        u64 drx = rx > s->prev_rx[i] ? (rx - s->prev_rx[i]) << 2 : 0;
+        u64 dtx = tx > s->prev_tx[i] ? (tx - s->prev_tx[i]) << 2 : 0;
+        u32 off = t > c->start_ns ? div_u64(t - c->start_ns, 1000) : 0;
+
+        chrdev_summary_dir_add(&st->rx, drx, dt, off);
+        chrdev_summary_dir_add(&st->tx, dtx, dt, off);
+        st->samples++;
+    }
+    s->prev_ns[i] = t;
+    s->prev_tx[i] = tx;
+    s->prev_rx[i] = rx;
+    s->have_prev[i] = true;
+}
+
+// 采样线程：与采样环相同的绝对截止时间调度，只是把采样直接累计进窗口统计
+static int chrdev_summary_thread(void *data)
+{
+    struct chrdev_summary_state *s = data;
+    ktime_t next = ktime_get();
+
+    chrdev_summary_begin(s, ktime_to_ns(next));
+    while (!kthread_should_stop()) {
+        struct chrdev_reading r;
+        u64 t0, t1, t2;
+        ktime_t now;
+        u32 i;
+
+        t0 = ktime_get_ns();
+        for (i = 0; i < s->nr_targets; i++) {
+            t1 = ktime_get_ns();
+            if (chrdev_query_counters(&s->targets[i], s->out, 0, 0, &r)) {
+                s->cur->targets[i].errors++;
+                continue;
+            }
+            t2 = ktime_get_ns();
+            chrdev_summary_add(s, i, t1 + ((t2 - t1) >> 1), r.tx, r.rx);
+        }
+        t2 = ktime_get_ns() - t0;
+        if (t2 > s->cur->max_read_ns)
+            s->cur->max_read_ns = min_t(u64, t2, U32_MAX);
+
+        next = ktime_add_ns(next, s->period_ns);
+        now = ktime_get();
+        if (ktime_before(next, now)) {
+            s->cur->missed += div_u64(ktime_to_ns(ktime_sub(now, next)), s->period_ns) + 1;
+            next = now;
+        }
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop()) {
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+        schedule_hrtimeout_range(&next, 0, HRTIMER_MODE_ABS);
+    }
+    return 0;
+}
+
+// 停止后未结束的窗口被丢弃，已完成的窗口仍可读取
+static void chrdev_summary_stop(struct chrdev_summary_state *s)
+{
+    if (!s->thread)
+        return;
+    kthread_stop(s->thread);
+    s->thread = NULL;
+    WRITE_ONCE(s->running, false);
+    wake_up_interruptible(&s->wq);
+}
+
+static void chrdev_summary_free(struct chrdev_summary_state *s)
+{
+    chrdev_summary_stop(s);
+    chrdev_put_targets(s->targets, &s->nr_targets);
+    kfree(s->out);
+    kvfree(s->cur);
+    vfree(s->slots);
+    kfree(s);
+}
+
+static struct chrdev_summary_state *chrdev_summary_alloc(void)
+{
+    struct chrdev_summary_state *s = kzalloc(sizeof(*s), GFP_KERNEL);
+
+    if (!s)
+        return NULL;
+    s->out = kzalloc(MLX5_ST_SZ_BYTES(query_vport_counter_out), GFP_KERNEL);
+    s->cur = kvzalloc(SUMMARY_REC_MAX, GFP_KERNEL);
+    s->slots = vzalloc(CHRDEV_SUMMARY_SLOTS * SUMMARY_REC_MAX);
+    if (!s->out || !s->cur || !s->slots) {
+        kfree(s->out);
+        kvfree(s->cur);
+        vfree(s->slots);
+        kfree(s);
+        return NULL;
+    }
+    mutex_init(&s->q_lock);
+    init_waitqueue_head(&s->wq);
+    return s;
+}
+
+// 启动窗口统计：采样当前绑定的所有目标；重新启动时清空未读的窗口
+static long chrdev_ioctl_summary_start(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_summary_config cfg;
+    struct chrdev_summary_state *s = cf->summary;
+    struct task_struct *t;
+    u32 i;
+
+    if (copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+        return -EFAULT;
+    if (cfg.period_ns < CHRDEV_RING_MIN_PERIOD || cfg.window_ms < CHRDEV_SUMMARY_MIN_WINDOW ||
+        (u64)cfg.window_ms * NSEC_PER_MSEC < 2ULL * cfg.period_ns)
+        return -EINVAL;
+    if (!cf->nr_targets)
+        return -ENODEV;
+    if (s && s->thread)
+        return -EBUSY;
+    if (!s) {
+        s = chrdev_summary_alloc();
+        if (!s)
+            return -ENOMEM;
+        // 初始化完成后再发布，read/poll不持有cf->lock
+        smp_store_release(&cf->summary, s);
+    }
+
+    chrdev_put_targets(s->targets, &s->nr_targets);
+    for (i = 0; i < cf->nr_targets; i++) {
+        s->targets[i] = cf->targets[i];
+        chrdev_nic_hold(s->targets[i].nic);
+    }
+    s->nr_targets = cf->nr_targets;
+    s->period_ns = cfg.period_ns;
+    s->window_ns = (u64)cfg.window_ms * NSEC_PER_MSEC;
+    s->seq = 0;
+    memset(s->have_prev, 0, sizeof(s->have_prev));
+
+    mutex_lock(&s->q_lock);
+    s->rec_size = sizeof(struct chrdev_summary) + s->nr_targets * sizeof(struct chrdev_summary_target);
+    s->head = s->tail = s->lost = 0;
+    WRITE_ONCE(s->running, true);
+    mutex_unlock(&s->q_lock);
+
+    t = kthread_run(chrdev_summary_thread, s, "chrdev_summary");
+    if (IS_ERR(t)) {
+        WRITE_ONCE(s->running, false);
+        return PTR_ERR(t);
+    }
+    s->thread = t;
+    return 0;
+}
+
+static bool chrdev_summary_readable(struct chrdev_summary_state *s)
+{
+    return READ_ONCE(s->head) != READ_ONCE(s->tail) || !READ_ONCE(s->running);
+}
+
+// 读取已完成的窗口：尽可能多的完整记录
+static ssize_t chr_dev_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct chrdev_file *cf = filp->private_data;
+    struct chrdev_summary_state *s = smp_load_acquire(&cf->summary);
+    size_t done = 0;
+    int ret;
+
+    if (!s)
+        return -EINVAL;
+    for (;;) {
+        mutex_lock(&s->q_lock);
+        if (count < s->rec_size) {
+            mutex_unlock(&s->q_lock);
+            return -EINVAL;
+        }
+        while (s->tail != s->head && count - done >= s->rec_size) {
+            if (copy_to_user(buf + done, s->slots + (s->tail % CHRDEV_SUMMARY_SLOTS) * SUMMARY_REC_MAX,
+                             s->rec_size)) {
+                mutex_unlock(&s->q_lock);
+                return done ? done : -EFAULT;
+            }
+            done += s->rec_size;
+            WRITE_ONCE(s->tail, s->tail + 1);
+        }
+        mutex_unlock(&s->q_lock);
+        if (done)
+            return done;
+        if (!READ_ONCE(s->running))
+            return 0;
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(s->wq, chrdev_summary_readable(s));
+        if (ret)
+            return ret;
+    }
+}
+
+static __poll_t chr_dev_poll(struct file *filp, poll_table *wait)
+{
+    struct chrdev_file *cf = filp->private_data;
+    struct chrdev_summary_state *s = smp_load_acquire(&cf->summary);
+
+    if (!s)
+        return EPOLLERR;
+    poll_wait(filp, &s->wq, wait);
+    if (READ_ONCE(s->head) != READ_ONCE(s->tail))
+        return EPOLLIN | EPOLLRDNORM;
+    if (!READ_ONCE(s->running))
+        return EPOLLHUP;
+    return 0;
+}
+
+// 核心：ioctl实现（无传入参数，两个int64_t传出参数）
+// 已绑定目标时直接查询绑定的设备；未绑定时按传入的bus/slot/func逐次查找（兼容旧用法）
+static long chrdev_ioctl_get_two_int64(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_bound legacy = {0};
+    const struct chrdev_bound *b = &cf->targets[0];
 
     // 2. 校验参数是否为有效指针（传出参数需要用户态提供有效缓冲区）
     if (!arg) {
@@ -42,31 +1220,27 @@ static long chr_dev_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
         return -EFAULT;  // 内存拷贝失败
     }
 
-    int devfn = PCI_DEVFN(user_data.slot, user_data.func);
-    struct pci_dev *pdev = pci_get_domain_bus_and_slot(0, user_data.bus, devfn);
-    if (!pdev)
-	return -EFAULT;
-    void *mdev = pci_get_drvdata(pdev);
-    if (!mdev)
-	return -EFAULT;
+    if (!cf->nr_targets) {
+        struct chrdev_target t = { .bus = user_data.bus, .slot = user_data.slot, .func = user_data.func };
+        if (chrdev_bind_one(&legacy, &t))
+            return -EFAULT;
+        b = &legacy;
+    }
 
 
     //printk("%d %d %d %p %p\n", user_data.bus, user_data.slot, user_data.func, pdev, mdev);
 
     // 3. 处理我们定义的ioctl命令（传出两个int64_t参数）
-    if (cmd == CHRDEV_IOCTL_GET_TWO_INT64) {
+    {
 	int err;
 	//int sz = MLX5_ST_SZ_BYTES(query_vport_counter_out);
-	err = mlx5_core_query_vport_counter(mdev, 0, 0, 1, &out);
+	struct chrdev_reading r;
+	err = chrdev_query_counters(b, cf->out, cf->max_age_ns, 0, &r);
+	if (legacy.nic)
+	    chrdev_nic_put(legacy.nic);
 	if (!err) {
-#define MLX5_SUM_CNT(p, cntr1, cntr2)   \
-        (MLX5_GET64(query_vport_counter_out, p, cntr1) + \
-        MLX5_GET64(query_vport_counter_out, p, cntr2))
-	    user_data.val1 = MLX5_SUM_CNT(&out, transmitted_ib_unicast.octets,
-                         transmitted_ib_multicast.octets) >> 2;
-	    user_data.val2 = MLX5_SUM_CNT(&out, received_ib_unicast.octets,
-                         received_ib_multicast.octets) >> 2;
-
+	    user_data.val1 = r.tx;
+	    user_data.val2 = r.rx;
 	} else {
 	    printk(KERN_ERR "query counter failed!\n");
 	    return -EFAULT;
@@ -86,18 +1260,191 @@ static long chr_dev_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned
         //printk(KERN_INFO "ioctl success: val1=%lld, val2=%lld\n", user_data.val1, user_data.val2);
         return 0;  // 处理成功
     }
+}
+
+// 批量查询所有绑定目标的计数器（一次内核调用）
+static long chrdev_ioctl_get_batch(struct chrdev_file *cf, unsigned long arg)
+{
+    struct chrdev_batch *batch;
+    u32 i, nr = cf->nr_targets;
+    long ret = 0;
+
+    if (!nr)
+        return -ENODEV;
+    batch = kmalloc(sizeof(*batch), GFP_KERNEL);
+    if (!batch)
+        return -ENOMEM;
+    batch->nr = nr;
+    batch->reserved = 0;
+    for (i = 0; i < nr; i++) {
+        struct chrdev_counter *c = &batch->counters[i];
+        struct chrdev_reading r = {0};
+
+        c->err = chrdev_query_counters(&cf->targets[i], cf->out, cf->max_age_ns, cf->options, &r);
+        c->tx = r.tx;
+        c->rx = r.rx;
+        c->tsc = r.tsc;
+        c->bracket_cycles = r.cycles;
+        c->hw_clock = r.hw;
+        c->hw_khz = r.hw ? cf->targets[i].nic->hw_khz : 0;
+        c->flags = (!c->err && !r.cycles) ? CHRDEV_COUNTER_CACHED : 0;
+    }
+    if (copy_to_user((void __user *)arg, batch,
+                     offsetof(struct chrdev_batch, counters) + nr * sizeof(batch->counters[0])))
+        ret = -EFAULT;
+    kfree(batch);
+    return ret;
+}
+
+static long chr_dev_unlocked_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct chrdev_file *cf = filp->private_data;
+    long ret;
+
+    // 1. 校验命令码的魔数
+    if (_IOC_TYPE(cmd) != CHRDEV_MAGIC) {
+        printk(KERN_ERR "ioctl magic number error!\n");
+        return -EINVAL;  // 非法参数
+    }
+
+    switch (cmd) {
+    case CHRDEV_IOCTL_GET_TWO_INT64:
+        // 无竞争的mutex开销远小于固件命令，换取与解绑并发时的安全
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_get_two_int64(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_BIND_TARGET:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_bind_target(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_BIND_TARGETS:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_bind_targets(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_GET_BATCH:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_get_batch(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_UNBIND_TARGET:
+        mutex_lock(&cf->lock);
+        chrdev_unbind_target(cf);
+        mutex_unlock(&cf->lock);
+        return 0;
+    case CHRDEV_IOCTL_RING_CONFIG:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_ring_config(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_RING_START:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_ring_start(cf);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_RING_STOP:
+        mutex_lock(&cf->lock);
+        if (cf->ring)
+            chrdev_ring_stop(cf->ring);
+        mutex_unlock(&cf->lock);
+        return 0;
+    case CHRDEV_IOCTL_SUMMARY_START:
+        mutex_lock(&cf->lock);
+        ret = chrdev_ioctl_summary_start(cf, arg);
+        mutex_unlock(&cf->lock);
+        return ret;
+    case CHRDEV_IOCTL_SUMMARY_STOP:
+        mutex_lock(&cf->lock);
+        if (cf->summary)
+            chrdev_summary_stop(cf->summary);
+        mutex_unlock(&cf->lock);
+        return 0;
+    case CHRDEV_IOCTL_SET_OPTIONS: {
+        u32 opts;
+
+        if (copy_from_user(&opts, (void __user *)arg, sizeof(opts)))
+            return -EFAULT;
+        if (opts & ~CHRDEV_OPT_HW_CLOCK)
+            return -EINVAL;
+        mutex_lock(&cf->lock);
+        cf->options = opts;
+        mutex_unlock(&cf->lock);
+        return 0;
+    }
+    case CHRDEV_IOCTL_SET_MAX_AGE: {
+        u32 max_age;
+
+        if (copy_from_user(&max_age, (void __user *)arg, sizeof(max_age)))
+            return -EFAULT;
+        mutex_lock(&cf->lock);
+        cf->max_age_ns = max_age;
+        mutex_unlock(&cf->lock);
+        return 0;
+    }
+    }
 
     // 未知命令
     printk(KERN_ERR "unknown ioctl command!\n");
     return -EINVAL;
 }
 
+// 映射采样环（只允许映射整个环，且必须先RING_CONFIG）
+static int chr_dev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct chrdev_file *cf = filp->private_data;
+    int ret = -EINVAL;
+
+    mutex_lock(&cf->lock);
+    if (cf->ring && vma->vm_pgoff == 0 &&
+        vma->vm_end - vma->vm_start == cf->ring->size)
+        ret = remap_vmalloc_range(vma, cf->ring->hdr, 0);
+    mutex_unlock(&cf->lock);
+    return ret;
+}
+
+static int chr_dev_open(struct inode *inode, struct file *filp)
+{
+    struct chrdev_file *cf = kzalloc(sizeof(*cf), GFP_KERNEL);
+
+    if (!cf)
+        return -ENOMEM;
+    cf->out = kzalloc(MLX5_ST_SZ_BYTES(query_vport_counter_out), GFP_KERNEL);
+    if (!cf->out) {
+        kfree(cf);
+        return -ENOMEM;
+    }
+    cf->max_age_ns = READ_ONCE(coalesce_ns);
+    mutex_init(&cf->lock);
+    filp->private_data = cf;
+    return 0;
+}
+
+// 最后一个引用（含mmap）释放时才会调用，此时可以安全地停止线程并释放环
+static int chr_dev_release(struct inode *inode, struct file *filp)
+{
+    struct chrdev_file *cf = filp->private_data;
+
+    if (cf->ring)
+        chrdev_ring_free(cf->ring);
+    if (cf->summary)
+        chrdev_summary_free(cf->summary);
+    chrdev_unbind_target(cf);
+    kfree(cf->out);
+    kfree(cf);
+    return 0;
+}
+
 // file_operations 结构体（绑定ioctl操作）
 static const struct file_operations chr_dev_fops = {
     .owner          = THIS_MODULE,
     .unlocked_ioctl = chr_dev_unlocked_ioctl,  // 绑定现代ioctl函数
-    .open           = NULL,
-    .release        = NULL,
+    .mmap           = chr_dev_mmap,
+    .read           = chr_dev_read,
+    .poll           = chr_dev_poll,
+    .open           = chr_dev_open,
+    .release        = chr_dev_release,
 };
 
 // 驱动入口函数（加载驱动）
@@ -145,10 +1492,19 @@ static int __init chrdev_ioctl_init(void)
         goto err_device_create;
     }
 
+    // 6. 跟踪mlx5_core的解绑，解绑后不再使用其mlx5_core_dev
+    ret = bus_register_notifier(&pci_bus_type, &chrdev_pci_nb);
+    if (ret < 0) {
+        printk(KERN_ERR "register pci notifier failed! ret: %d\n", ret);
+        goto err_notifier;
+    }
+
     printk(KERN_INFO "chrdev with ioctl init success!\n");
     return 0;
 
     // 异常处理（反向释放资源）
+err_notifier:
+    device_destroy(dev_class, dev_num);
 err_device_create:
     class_destroy(dev_class);
 err_class_create:
@@ -163,6 +1519,7 @@ err_alloc:
 static void __exit chrdev_ioctl_exit(void)
 {
     // 释放所有资源
+    bus_unregister_notifier(&pci_bus_type, &chrdev_pci_nb);
     device_destroy(dev_class, dev_num);
     class_destroy(dev_class);
     cdev_del(&chr_dev);
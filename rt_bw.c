@@ -3,351 +3,492 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/syscall.h>
-#include <sched.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/ioctl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/stat.h>
 #include "chrdev_ioctl_common.h"  // 包含共用头文件
+#include "rtbw.h"
 
-// ==================== 可配置参数 ====================
-#define CPU_CORE_DFT 127                // 绑定的CPU核心
-#define CPU_FREQ_GHZ 2.7           // CPU主频（GHz）
-#define SAMPLING_LOOP 1000         // 空循环次数（调小到1000，≈0.33微秒/次）
-#define DEFAULT_RDMA_DEV "mlx5_0"  // 默认RDMA设备名
-#define RDMA_PORT 1                // RDMA端口号
-#define CACHE_SIZE 10000000         // 缓存大小（支持1秒内百万级采样）
-#define PRINT_INTERVAL_S 2.0       // 1秒打印一次峰值
-// =============================================================================
-
-// 带宽缓存结构体
-typedef struct {
-    double rx_bw_gbps;
-    double tx_bw_gbps;
-    int delta_us;
-} BandwidthCache;
+// rt_bw：librtbw的命令行客户端，解析参数、打开采样，每个打印周期在回调中打印统计
 
 // 全局变量
-char rdma_dev_name[64] = {0};
-int rcv_fd = -1;                   // 预打开的接收计数器文件描述符
-int xmit_fd = -1;                  // 预打开的发送计数器文件描述符
-int counter_fd = -1;                  // 预打开的发送计数器文件描述符
-BandwidthCache *bw_cache = NULL;
-int cache_idx = 0;
-uint64_t start_cycle = 0;
-struct chrdev_ioctl_out_args user_data;  // 用户态缓冲区，用于接收传出参数
-
-// 1. 获取CPU cycle值（RDTSCP）
-static inline uint64_t get_cycle(void) {
-    uint32_t lo, hi;
-    __asm__ __volatile__ ("rdtscp" : "=a"(lo), "=d"(hi) : : "rcx");
-    return (uint64_t)hi << 32 | lo;
+rtbw *handle = NULL;                     // 采样句柄（librtbw）
+rtbw_counters reported;                  // 已上报的各项累计计数
+
+static const char *now_str(char *buf, int size) {
+    time_t now = time(NULL);
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", localtime(&now));
+    return buf;
 }
 
-static double CPU_FREQ;
-static double calibrate_tsc_hz(void) {
-  struct timespec a,b; clock_gettime(CLOCK_MONOTONIC_RAW,&a);
-  uint64_t c1=get_cycle(); struct timespec req={.tv_nsec=200*1000*1000}; nanosleep(&req,NULL);
-  uint64_t c2=get_cycle(); clock_gettime(CLOCK_MONOTONIC_RAW,&b);
-  double dt=(b.tv_sec-a.tv_sec)+(b.tv_nsec-a.tv_nsec)/1e9; return (c2-c1)/dt;
+// 4. 统计并打印1秒内的峰值带宽（统计已在采样时增量完成，这里只做格式化）
+// 拼接一个方向的TOP8
+static int format_top(char *buf, int size, const char *time_buf, const char *name,
+                      const char *dir, const rtbw_stream *st) {
+    rtbw_top_entry top[RTBW_TOPK];
+    int n = rtbw_topk_sorted(&st->top, top);
+    int off = snprintf(buf, size, "[%s] %s %s TOP8：", time_buf, name, dir);
+    for (int i = 0; i < n && off < size; i++)
+        off += snprintf(buf + off, size - off, "  %u：%u，%.2f Gbps",
+                        top[i].us, top[i].sample_idx, top[i].value);
+    if (off < size)
+        off += snprintf(buf + off, size - off, "\n");
+    return off < size ? off : size - 1;
 }
 
-uint64_t read_rdma_counter_1(int fd) {
-    int ret;
-    ret = ioctl(fd, CHRDEV_IOCTL_GET_TWO_INT64, &user_data);
-    if (ret < 0) {
-        perror("ioctl failed");
-        exit(EXIT_FAILURE);
+// 窗口/时长（纳秒）格式化为带单位的短字符串
+static const char *fmt_ns(char *buf, int size, double ns) {
+    if (ns >= 1e9)
+        snprintf(buf, size, "%.3gs", ns / 1e9);
+    else if (ns >= 1e6)
+        snprintf(buf, size, "%.3gms", ns / 1e6);
+    else if (ns >= 1e3)
+        snprintf(buf, size, "%.3gus", ns / 1e3);
+    else
+        snprintf(buf, size, "%.0fns", ns);
+    return buf;
+}
+
+// 拼接一个方向各尺度的峰值或突发统计
+static int format_burst(char *buf, int size, const rtbw_window *w, const rtbw_burst *b, int bursts) {
+    const rtbw_burst_config *cfg = w->burst;
+    double tsc_ghz = w->tsc_hz / 1e9;
+    char win[16], t1[16], t2[16];
+    int off = 0;
+    for (int k = 0; k < cfg->nr && off < size; k++) {
+        const rtbw_burst_level *l = &b->lv[k];
+        fmt_ns(win, sizeof(win), cfg->window_ns[k]);
+        if (!bursts)
+            off += snprintf(buf + off, size - off, " %s %.2f", win,
+                            rtbw_burst_gbps(cfg, k, l->peak));
+        else if (l->bursts)
+            off += snprintf(buf + off, size - off, " %s %u次/总%s/最长%s/%.2fMB", win, l->bursts,
+                            fmt_ns(t1, sizeof(t1), l->burst_time / tsc_ghz),
+                            fmt_ns(t2, sizeof(t2), l->burst_max / tsc_ghz), l->burst_bytes / 1e6);
     }
-    return user_data.val1;
+    if (off == 0)
+        off = snprintf(buf, size, " 无");
+    return off < size ? off : size - 1;
 }
 
-// 3. 绑定进程到固定CPU核心
-void bind_cpu(int core_id) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(core_id, &cpuset);
-    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) < 0) {
-        perror("sched_setaffinity failed");
-        exit(EXIT_FAILURE);
+// 各尺度窗口的峰值带宽，以及超过阈值的突发次数/时长/字节数
+static void print_burst(const rtbw_window *w, const rtbw_series *s, const char *time_buf) {
+    char rx[512], tx[512];
+    format_burst(rx, sizeof(rx), w, &s->rx_burst, 0);
+    format_burst(tx, sizeof(tx), w, &s->tx_burst, 0);
+    printf("[%s] %s 多尺度峰值 - RX:%s Gbps, TX:%s Gbps\n", time_buf, s->name, rx, tx);
+    if (w->burst->threshold_gbps > 0) {
+        format_burst(rx, sizeof(rx), w, &s->rx_burst, 1);
+        format_burst(tx, sizeof(tx), w, &s->tx_burst, 1);
+        printf("[%s] %s 突发（>= %.1f Gbps） - RX:%s, TX:%s\n", time_buf, s->name,
+               w->burst->threshold_gbps, rx, tx);
     }
 }
 
-// 4. 统计并打印1秒内的峰值带宽
-void print_peak_bandwidth(uint64_t elapsed_cycle) {
-    if (cache_idx == 0) return;
+void print_peak_bandwidth(const rtbw_window *w, const rtbw_series *s) {
+    const rtbw_stats *st = &s->stats;
+    uint32_t n = st->samples;
+    if (n == 0) return;
 
-    double elapsed_s = (double)elapsed_cycle / (CPU_FREQ * 1000000000.0);
-    double rx_peak_gbps = 0.0, tx_peak_gbps = 0.0;
-    //for (int i = 0; i < cache_idx; i++) {
-    //    if (bw_cache[i].rx_bw_gbps > rx_peak_gbps) rx_peak_gbps = bw_cache[i].rx_bw_gbps;
-    //    if (bw_cache[i].tx_bw_gbps > tx_peak_gbps) tx_peak_gbps = bw_cache[i].tx_bw_gbps;
-    //}
+    double elapsed_s = (double)(w->end_tsc - w->start_tsc) / w->tsc_hz;
 
     char time_buf[32];
-    time_t now = time(NULL);
-    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    //printf("[%s] 1秒周期内峰值带宽 - RX: %.2f Gbps, TX: %.2f Gbps (采样次数: %d, 实际耗时: %.3f 秒, 平均采样间隔: %.2f 微秒)\n",
-    //       time_buf, rx_peak_gbps, tx_peak_gbps, cache_idx, elapsed_s,
-    //       (elapsed_s * 1000000) / cache_idx); // 计算平均采样间隔（微秒）
-    //fflush(stdout);
-
-    // -------------------------- 1. 单循环完成RX/TX TOP8筛选 --------------------------
-    typedef struct {
-        double bw_value;    // 带宽值
-        int sample_idx;     // 对应的原始采样索引
-	int us;
-    } BW_TOP_T;
-
-    #define TOP_NUM 8  // TOP8数量，便于修改
-    BW_TOP_T rx_top[TOP_NUM] = {0};
-    BW_TOP_T tx_top[TOP_NUM] = {0};
-
-    // 初始化top数组：带宽值设为-1.0，索引设为-1（区分有效/无效数据）
-    for (int i = 0; i < TOP_NUM; i++) {
-        rx_top[i].bw_value = 0;
-        tx_top[i].bw_value = 0;
-        rx_top[i].sample_idx = -1;
-        tx_top[i].sample_idx = -1;
-    }
-    int rx_flag = 0;
-    int tx_flag = 0;
-
-    // 单轮遍历bw_cache，同时筛选RX和TX的TOP8
-    for (int i = 0; i < cache_idx; i++) {
-        double current_rx = bw_cache[i].rx_bw_gbps;
-        double current_tx = bw_cache[i].tx_bw_gbps;
-        int current_sample_idx = i;
-
-        // 处理RX TOP8插入
-        for (int j = 0; j < TOP_NUM; j++) {
-            if (current_rx > rx_top[j].bw_value) {
-                rx_flag = 1;
-                for (int k = TOP_NUM - 1; k > j; k--) {
-                    rx_top[k] = rx_top[k-1];
-                }
-                rx_top[j].bw_value = current_rx;
-                rx_top[j].sample_idx = current_sample_idx;
-                rx_top[j].us = bw_cache[i].delta_us;
-                break;
-            }
-        }
-
-        // 处理TX TOP8插入
-        for (int j = 0; j < TOP_NUM; j++) {
-            if (current_tx > tx_top[j].bw_value) {
-                tx_flag = 1;
-                for (int k = TOP_NUM - 1; k > j; k--) {
-                    tx_top[k] = tx_top[k-1];
-                }
-                tx_top[j].bw_value = current_tx;
-                tx_top[j].sample_idx = current_sample_idx;
-                tx_top[j].us = bw_cache[i].delta_us;
-                break;
-            }
-        }
-    }
+    now_str(time_buf, sizeof(time_buf));
 
-    // -------------------------- 2. 拼接TOP8字符串（无循环打印，仅拼接） --------------------------
     #define TOP_STR_BUF_SIZE 1024  // 足够容纳RX+TX TOP8的字符串内容
-    char top_str_buf[TOP_STR_BUF_SIZE] = {0};  // 总拼接缓冲区
-    int buf_offset = 0;                        // 缓冲区偏移量，用于逐段拼接
-
-    if (rx_flag) {
-    // 拼接RX带宽TOP8标题
-    buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                           "[%s] RX TOP8：", time_buf);
-
-    // 拼接RX TOP8有效数据（无循环打印，仅循环拼接）
-    int valid_rx_count = 0;
-    for (int i = 0; i < TOP_NUM; i++) {
-        if (rx_top[i].sample_idx != -1) {
-            valid_rx_count++;
-            // 逐段拼接RX TOP8每条数据，更新偏移量避免缓冲区溢出
-            buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                                   "  %d：%d，%.2f Gbps",
-                                   rx_top[i].us, rx_top[i].sample_idx, rx_top[i].bw_value);
-        }
-    }
-    buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset, "\n");
-    // 若无可效RX数据，拼接提示信息
-    if (valid_rx_count == 0) {
-        buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                               "  无有效RX带宽采样数据\n");
-    }
-    }
-    if (tx_flag) {
-
-    // 拼接TX带宽TOP8标题
-    buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                           "[%s] TX TOP8：", time_buf);
-
-    // 拼接TX TOP8有效数据（无循环打印，仅循环拼接）
-    int valid_tx_count = 0;
-    for (int i = 0; i < TOP_NUM; i++) {
-        if (tx_top[i].sample_idx != -1) {
-            valid_tx_count++;
-            // 逐段拼接TX TOP8每条数据，更新偏移量
-            buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                                   "  %d：%d，%.2f Gbps",
-                                   tx_top[i].us, tx_top[i].sample_idx, tx_top[i].bw_value);
+    char top_str_buf[TOP_STR_BUF_SIZE] = {0};
+    int buf_offset = 0;
+    if (st->rx.top.n)
+        buf_offset += format_top(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
+                                 time_buf, s->name, "RX", &st->rx);
+    if (st->tx.top.n)
+        buf_offset += format_top(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
+                                 time_buf, s->name, "TX", &st->tx);
+
+    printf("[%s] %s 周期内峰值带宽 - RX: %.2f Gbps, TX: %.2f Gbps (采样次数: %u, 实际耗时: %.3f 秒, 平均采样间隔: %.2f 微秒)\n",
+           time_buf, s->name, st->rx.max, st->tx.max, n, elapsed_s,
+           (elapsed_s * 1000000) / n); // 计算平均采样间隔（微秒）
+    printf("[%s] %s 分布 - RX: 均值 %.2f p50 %.2f p99 %.2f p99.9 %.2f Gbps, TX: 均值 %.2f p50 %.2f p99 %.2f p99.9 %.2f Gbps\n",
+           time_buf, s->name,
+           rtbw_stream_mean(&st->rx, n),
+           rtbw_hist_percentile(&st->rx.hist, n, 0.50, st->rx.max),
+           rtbw_hist_percentile(&st->rx.hist, n, 0.99, st->rx.max),
+           rtbw_hist_percentile(&st->rx.hist, n, 0.999, st->rx.max),
+           rtbw_stream_mean(&st->tx, n),
+           rtbw_hist_percentile(&st->tx.hist, n, 0.50, st->tx.max),
+           rtbw_hist_percentile(&st->tx.hist, n, 0.99, st->tx.max),
+           rtbw_hist_percentile(&st->tx.hist, n, 0.999, st->tx.max));
+
+    //-------------------------- 单次printf输出完整TOP8字符串 --------------------------
+    printf("%s", top_str_buf);
+
+    if (w->burst->nr)
+        print_burst(w, s, time_buf);
+}
+
+// VF按某个方向的周期峰值从高到低排序（qsort的比较函数通过rank_series取序列）
+static const rtbw_series *rank_series;
+
+static int cmp_vf_rx(const void *a, const void *b) {
+    double x = rank_series[*(const int *)a].stats.rx.max, y = rank_series[*(const int *)b].stats.rx.max;
+    return (x < y) - (x > y);
+}
+
+static int cmp_vf_tx(const void *a, const void *b) {
+    double x = rank_series[*(const int *)a].stats.tx.max, y = rank_series[*(const int *)b].stats.tx.max;
+    return (x < y) - (x > y);
+}
+
+// SR-IOV：VF数量多时不逐个打印完整统计，每个方向只列出峰值最高的TOP8个VF（峰值/均值/p99）
+static void print_vf_ranking(const rtbw_window *w, const int *vf, int nr_vf) {
+    char time_buf[32];
+    now_str(time_buf, sizeof(time_buf));
+
+    int order[RTBW_MAX_TARGETS], n = 0;
+    rank_series = w->series;
+    for (int k = 0; k < nr_vf; k++)
+        if (w->series[vf[k]].stats.samples)
+            order[n++] = vf[k];
+    for (int dir = 0; dir < 2 && n; dir++) {
+        char buf[2048];
+        int off = snprintf(buf, sizeof(buf), "[%s] VF %s峰值TOP%d（共%d个VF）：", time_buf,
+                           dir ? "TX" : "RX", RTBW_TOPK, nr_vf);
+        qsort(order, n, sizeof(order[0]), dir ? cmp_vf_tx : cmp_vf_rx);
+        for (int k = 0; k < n && k < RTBW_TOPK && off < (int)sizeof(buf); k++) {
+            const rtbw_stats *st = &w->series[order[k]].stats;
+            const rtbw_stream *s = dir ? &st->tx : &st->rx;
+            off += snprintf(buf + off, sizeof(buf) - off, "  %s %.2f（均值 %.2f，p99 %.2f）",
+                            w->series[order[k]].name, s->max, rtbw_stream_mean(s, st->samples),
+                            rtbw_hist_percentile(&s->hist, st->samples, 0.99, s->max));
         }
+        printf("%s Gbps\n", buf);
     }
-    buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset, "\n");
-    // 若无可效TX数据，拼接提示信息
-    if (valid_tx_count == 0) {
-        buf_offset += snprintf(top_str_buf + buf_offset, TOP_STR_BUF_SIZE - buf_offset,
-                               "  无有效TX带宽采样数据\n");
-    }
+}
+
+// 打印所有NIC以及节点汇总（只有一个NIC时汇总与其相同，不重复打印）
+// VF目标汇总为一份排行，PF和非SR-IOV目标逐个打印
+void print_all_bandwidth(const rtbw_window *w, const rtbw_engine *e) {
+    int vf[RTBW_MAX_TARGETS], nr_vf = 0;
+    for (int i = 0; i < w->nr_targets; i++) {
+        if (e->target_vport[i])
+            vf[nr_vf++] = i;
+        else
+            print_peak_bandwidth(w, &w->series[i]);
     }
+    if (nr_vf)
+        print_vf_ranking(w, vf, nr_vf);
+    if (w->nr_targets > 1)
+        print_peak_bandwidth(w, &w->series[w->nr_targets]);
+    fflush(stdout);
+}
 
-    rx_peak_gbps = rx_top[0].bw_value;
-    tx_peak_gbps = tx_top[0].bw_value;
-    printf("[%s] 1秒周期内峰值带宽 - RX: %.2f Gbps, TX: %.2f Gbps (采样次数: %d, 实际耗时: %.3f 秒, 平均采样间隔: %.2f 微秒)\n",
-           time_buf, rx_peak_gbps, tx_peak_gbps, cache_idx, elapsed_s,
-           (elapsed_s * 1000000) / cache_idx); // 计算平均采样间隔（微秒）
+// 本打印周期的采样间隔/读计数器耗时分布、最长间隔和采样线程的上下文切换
+static void print_health(const rtbw_window *w) {
+    const rtbw_health *h = &w->health;
+    char time_buf[32], csw[96] = "";
+    now_str(time_buf, sizeof(time_buf));
+    if (h->ctxsw_valid)
+        snprintf(csw, sizeof(csw), "，采样线程上下文切换 非自愿 %lu 自愿 %lu", h->nivcsw, h->nvcsw);
+    double max_iv = h->max_interval / 1e3, max_rd = h->max_read / 1e3;
+    printf("[%s] 采样自检 - 间隔 p50 %.2f p99 %.2f p99.9 %.2f 最长 %.1f us（周期内 %.3f 秒处），"
+           "超过2倍周期 %u 次；读计数器 p50 %.2f p99 %.2f 最长 %.1f us%s\n", time_buf,
+           rtbw_hist_percentile(&h->interval, h->rounds, 0.50, max_iv),
+           rtbw_hist_percentile(&h->interval, h->rounds, 0.99, max_iv),
+           rtbw_hist_percentile(&h->interval, h->rounds, 0.999, max_iv), max_iv,
+           h->max_at > w->start_tsc ? (h->max_at - w->start_tsc) / w->tsc_hz : 0.0, h->stalls,
+           rtbw_hist_percentile(&h->read, h->reads, 0.50, max_rd),
+           rtbw_hist_percentile(&h->read, h->reads, 0.99, max_rd), max_rd, csw);
+}
 
-    //-------------------------- 3. 单次printf输出完整TOP8字符串 --------------------------
-    printf("%s", top_str_buf);
-    double tsc_hz = calibrate_tsc_hz();
-    fprintf(stderr,"TSC ~= %.3f GHz\n", tsc_hz/1e9);
+// 本打印周期的采样周期变化：统计中的采样间隔随周期变化，峰值在放宽周期时是更长区间的平均值
+static void print_adapt(const rtbw_window *w, const rtbw_engine *e) {
+    char time_buf[32], cur[16], max[16];
+    now_str(time_buf, sizeof(time_buf));
+    printf("[%s] 自适应采样 - 当前周期 %s，本周期调整 %lu 次（累计 %lu），最长周期 %s，最细周期（%lu 纳秒）占比 %.1f%%\n",
+           time_buf, fmt_ns(cur, sizeof(cur), w->period_ns), w->period_changes, w->period_changes_total,
+           fmt_ns(max, sizeof(max), w->max_period_ns), e->period_ns, 100.0 * w->fine_ratio);
     fflush(stdout);
+}
 
-    cache_idx = 0;
+// 一项累计计数有增加时打印本周期的增量
+static void report_counter(const char *fmt, uint64_t now, uint64_t *last) {
+    if (now == *last)
+        return;
+    fprintf(stderr, fmt, now - *last, now);
+    *last = now;
 }
 
-int main(int argc, char *argv[]) {
-    // 分配缓存内存
-    bw_cache = (BandwidthCache *)malloc(CACHE_SIZE * sizeof(BandwidthCache));
-    if (bw_cache == NULL) {
-        perror("malloc bw_cache failed");
-        exit(EXIT_FAILURE);
-    }
-    memset(bw_cache, 0, CACHE_SIZE * sizeof(BandwidthCache));
-
-    // 处理RDMA设备名参数
-    char bdf_str[8];
-    if (argc >= 2) {
-        strncpy(bdf_str, argv[1], 7);
-        bdf_str[8] = '\0';
-    } else {
-        printf("no RDMA bdf, quit\n");
-	exit(1);
+// 每个打印周期的回调（在librtbw的聚合线程中，本程序即主线程）
+static void on_window(rtbw *h, const rtbw_window *w, void *arg) {
+    (void)arg;
+    rtbw_engine *e = rtbw_get_engine(h);
+    print_all_bandwidth(w, e);
+    print_health(w);
+    if (e->idle_period_ns > e->period_ns)
+        print_adapt(w, e);
+    if (e->backend->report) {
+        char time_buf[32];
+        rtbw_engine_report(e, now_str(time_buf, sizeof(time_buf)));
+        fflush(stdout);
     }
+    fprintf(stderr, "TSC ~= %.6f GHz\n", w->tsc_hz / 1e9);
+    const rtbw_counters *c = &w->counters;
+    report_counter("采样队列已满，丢弃采样 %lu 轮（累计 %lu）\n", c->dropped, &reported.dropped);
+    report_counter("采样错过截止时间 %lu 次（累计 %lu）\n", c->missed, &reported.missed);
+    report_counter("内核采样环已满，丢失采样 %lu 次（累计 %lu）\n", c->lost, &reported.lost);
+    report_counter("采样时间区间过宽，剔除采样 %lu 个（累计 %lu）\n", c->rejected, &reported.rejected);
+    report_counter("遥测发送失败，丢弃数据报 %lu 个（累计 %lu）\n", c->telemetry_dropped, &reported.telemetry_dropped);
+    report_counter("上一次飞行记录尚未写完，忽略触发 %lu 次（累计 %lu）\n", c->flight_suppressed,
+                   &reported.flight_suppressed);
+    report_counter("写盘跟不上，trace丢弃记录 %lu 条（累计 %lu）\n", c->trace_dropped, &reported.trace_dropped);
+}
 
-    int loop = SAMPLING_LOOP;
-    if (argc >= 3) {
-        loop = atoi(argv[2]);
-	loop = loop == 0 ? SAMPLING_LOOP : loop;
-    }
+static void on_stop_signal(int sig) {
+    (void)sig;
+    rtbw_stop(handle);
+}
 
-    int bus, slot, func;
-    int ret = sscanf(bdf_str, "%x:%x.%x", &user_data.bus, &user_data.slot, &user_data.func);
-    if (ret != 3) {
-        printf("bdf pattern error, quit\n");
-	exit(1);
-    }
+// CPU核心参数：核心号、auto或none，出错返回-3
+static int parse_core(const char *s) {
+    if (!strcmp(s, "auto"))
+        return RTBW_CORE_AUTO;
+    if (!strcmp(s, "none") || !strcmp(s, "-1"))
+        return RTBW_CORE_NONE;
+    char *end;
+    long core = strtol(s, &end, 10);
+    return (end == s || *end || core < 0 || core >= CPU_SETSIZE) ? -3 : (int)core;
+}
 
-    printf("%d  %d  %d\n", user_data.bus, user_data.slot, user_data.func);
+static void usage(const char *prog) {
+    printf("用法: %s [-B 后端] [-r 周期纳秒[,在途数]] [-i spin|pause|tpause] [-c 核心|auto|none] [目标[,...]] [采样周期纳秒] [CPU核心]\n", prog);
+    printf("  -c     采样线程的CPU核心：核心号、auto（默认，网卡本地节点上隔离且SMT兄弟空闲的核心）或none（不绑核）；\n"
+           "         也可以作为最后一个位置参数给出（同样接受auto/none；写-1时须放在--之后）\n");
+    printf("  多个目标用逗号分隔，由同一个绑核的采样循环批量读取（最多%d个）\n", RTBW_MAX_TARGETS);
+    printf("  -B     计数器来源（默认ioctl）：\n");
+    for (int i = 0; rtbw_backends[i]; i++)
+        printf("           %-6s 目标：%s\n", rtbw_backends[i]->name, rtbw_backends[i]->target_help);
+    printf("  -P 路径 替换ioctl后端的设备文件或sysfs后端的根目录（如rtbw_standin提供的替身）\n");
+    printf("  -r ns[,N] ioctl后端使用内核共享内存采样环，按ns纳秒周期采样（不再每次采样调用ioctl）；\n"
+           "         N>1时内核最多N个异步固件命令同时在途，周期可以小于单个命令的延迟（最多%d）\n",
+           CHRDEV_RING_MAX_DEPTH);
+    printf("  -C ns  ioctl后端：与其他进程合并固件查询，接受不超过ns纳秒的共享结果（采样时刻随结果返回）\n");
+    printf("  -i     采样线程等待截止时间的方式（默认pause；tpause需CPU支持WAITPKG）\n");
+    printf("  -X ns  剔除采样时刻不确定区间超过ns纳秒的采样（ioctl后端的区间由内核紧贴固件命令测得）\n");
+    printf("  -D     ioctl后端：用网卡内部时钟给采样计时（每次查询多两次PCIe读）\n");
+    printf("  -A ns[,Mbps] 自适应采样：所有目标速率都不超过Mbps（默认%.0f）时逐步放宽周期，最长ns纳秒，\n"
+           "         期间睡眠而不自旋；出现流量后下一次采样即回到最细周期，每次改变周期都记入输出和trace\n",
+           RTBW_ACTIVE_MBPS_DFT);
+    printf("  -F     TSC不满足constant_tsc/nonstop_tsc时仍然运行（结果可能不准确）\n");
+    printf("  -R 列表 同时统计多个时间尺度的滑动窗口峰值，如10us,100us,1ms,10ms（每个尺度须是上一个的整数倍）\n");
+    printf("  -T Gbps 配合-R：统计各尺度窗口速率不低于该值的突发次数、时长和字节数\n");
+    printf("  -m 名称 把每个打印周期的峰值/分位数/丢弃计数发布到POSIX共享内存（如/rtbw，顺序锁保护，见rtbw_metrics.h）\n");
+    printf("  -H 端口 在127.0.0.1:端口以Prometheus文本格式提供同样的指标（GET /metrics）\n");
+    printf("  -w 文件 把原始采样记录写入二进制trace（Ctrl-C结束时写索引），可用rtbw_dump查看或-B synth trace:文件回放\n");
+    printf("  -U 地址:端口[,主机名] 每个打印周期把各序列的峰值/分位数/突发次数以二进制UDP发给rtbw_collector\n");
+    printf("  -E 条件 飞行记录：内存中保留最近的原始采样，触发时把触发前后的采样转储为trace（格式同-w）\n");
+    printf("         条件为逗号分隔的 键=值：above=Gbps、below=Gbps（win=窗口，默认%dus）、back（计数器倒退）、\n",
+           RTBW_FLIGHT_WINDOW_DFT / 1000);
+    printf("         fifo=路径（写入即触发），pre=秒（默认%.0f）、post=秒（默认%.0f）、dir=转储目录；SIGUSR1总是触发\n",
+           RTBW_FLIGHT_PRE_DFT, RTBW_FLIGHT_POST_DFT);
+}
 
-    counter_fd = open("/dev/chrdev_ioctl_dev", O_RDWR);
-    if (counter_fd < 0) {
-        perror("open device failed");
-        return -1;
+int main(int argc, char *argv[]) {
+    rtbw_config cfg;
+    rtbw_config_init(&cfg);
+    rtbw_flight_config flight_cfg;
+    char *telemetry_dest = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "B:P:r:C:c:i:A:X:Dw:E:U:R:T:m:H:Fh")) != -1) {
+        switch (opt) {
+        case 'P':
+            cfg.path = optarg;
+            break;
+        case 'm':
+            cfg.metrics_name = optarg;
+            break;
+        case 'H':
+            cfg.metrics_port = atoi(optarg);
+            if (cfg.metrics_port <= 0 || cfg.metrics_port > 65535) {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'C':
+            cfg.coalesce_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'X':
+            cfg.max_bracket_ns = strtoull(optarg, NULL, 0);
+            break;
+        case 'D':
+            cfg.hw_clock = 1;
+            break;
+        case 'A': {
+            char *end;
+            cfg.idle_period_ns = strtoull(optarg, &end, 0);
+            cfg.active_mbps = *end == ',' ? atof(end + 1) : RTBW_ACTIVE_MBPS_DFT;
+            if (cfg.idle_period_ns == 0 || (*end && *end != ',') || cfg.active_mbps < 0) {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        }
+        case 'w':
+            cfg.trace_path = optarg;
+            break;
+        case 'E':
+            if (rtbw_flight_parse(&flight_cfg, optarg) < 0)
+                exit(1);
+            cfg.flight = &flight_cfg;
+            break;
+        case 'U':
+            telemetry_dest = optarg;
+            break;
+        case 'R':
+            cfg.burst_list = optarg;
+            break;
+        case 'T':
+            cfg.burst_threshold = atof(optarg);
+            break;
+        case 'B':
+            cfg.backend = rtbw_backend_find(optarg);
+            if (!cfg.backend) {
+                printf("未知后端：%s\n", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'i':
+            if (!strcmp(optarg, "spin"))
+                cfg.idle = RTBW_IDLE_SPIN;
+            else if (!strcmp(optarg, "pause"))
+                cfg.idle = RTBW_IDLE_PAUSE;
+            else if (!strcmp(optarg, "tpause"))
+                cfg.idle = RTBW_IDLE_TPAUSE;
+            else {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'F':
+            cfg.force_tsc = 1;
+            break;
+        case 'c':
+            cfg.core = parse_core(optarg);
+            if (cfg.core == -3) {
+                usage(argv[0]);
+                exit(1);
+            }
+            break;
+        case 'r': {
+            char *end;
+            cfg.ring_period_ns = strtoul(optarg, &end, 0);
+            cfg.ring_depth = *end == ',' ? strtoul(end + 1, NULL, 0) : 1;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if (telemetry_dest) {
+        char *host = strchr(telemetry_dest, ',');
+        if (host)
+            *host++ = '\0';
+        cfg.telemetry_dest = telemetry_dest;
+        cfg.telemetry_host = host;
     }
-    printf("open device /dev/chrdev_ioctl_dev success (fd=%d)\n", counter_fd);
 
-    double tsc_hz = calibrate_tsc_hz();
-    fprintf(stderr,"TSC ~= %.3f GHz\n", tsc_hz/1e9);
-    CPU_FREQ = tsc_hz > 0 ? tsc_hz/1e9 : CPU_FREQ_GHZ;
+    // 剩余的位置参数：目标列表 [采样周期纳秒] [CPU核心]
+    argc -= optind - 1;
+    argv += optind - 1;
 
-    // 绑定CPU核心
-    int CPU_CORE = CPU_CORE_DFT;
+    if (argc >= 3) {
+        cfg.period_ns = strtoull(argv[2], NULL, 0);
+        cfg.period_ns = cfg.period_ns == 0 ? RTBW_PERIOD_NS_DFT : cfg.period_ns;
+    }
+    // 采样线程绑定的CPU核心（聚合线程限定在网卡本地的其他CPU上）
     if (argc >= 4) {
-        CPU_CORE = atoi(argv[3]);
-	CPU_CORE = CPU_CORE == 0 ? CPU_CORE_DFT : CPU_CORE;
+        cfg.core = parse_core(argv[3]);
+        if (cfg.core == -3) {
+            usage(argv[0]);
+            exit(1);
+        }
     }
 
-    bind_cpu(CPU_CORE);
-    printf("已绑定进程到CPU核心 %d\n", CPU_CORE);
-    printf("RDMA设备：%s，端口：%d\n", bdf_str, RDMA_PORT);
-    printf("CPU主频：%.2f GHz\n", CPU_FREQ);
-    printf("采样空循环次数：%d，打印间隔：%.1f秒\n", loop, PRINT_INTERVAL_S);
+    if (argc < 2 && !cfg.backend->default_targets) {
+        printf("no target, quit\n");
+        exit(1);
+    }
+    if (argc < 2)
+        printf("未指定目标，使用默认目标：%s\n", cfg.backend->default_targets);
+    cfg.targets = argc >= 2 ? argv[1] : NULL;
+    handle = rtbw_open(&cfg);
+    if (!handle) {
+        printf("quit\n");
+        exit(1);
+    }
+    rtbw_engine *e = rtbw_get_engine(handle);
+
+    double tsc_hz = rtbw_clock_hz();
+    fprintf(stderr,"TSC ~= %.6f GHz（%s）\n", tsc_hz/1e9, rtbw_clock_source_name());
+    if (!e->ring_period_ns && e->core >= 0)
+        printf("采样线程绑定到CPU核心 %d（网卡NUMA节点 %d）\n", e->core, e->node);
+    else if (!e->ring_period_ns)
+        printf("采样线程不绑核（网卡NUMA节点 %d）\n", e->node);
+    for (int i = 0; i < e->nr_targets; i++)
+        printf("采样目标（%s）：%s\n", e->backend->name, e->target_name[i]);
+    printf("CPU主频：%.2f GHz\n", tsc_hz / 1e9);
+    if (e->ring_period_ns)
+        printf("内核采样环周期：%u 纳秒（%s，在途命令 %u），打印间隔：%.1f秒\n", e->ring_period_ns,
+               e->ring_depth > 1 ? "异步流水线" : "同步查询", e->ring_depth, cfg.window_s);
+    else
+        printf("采样周期：%lu 纳秒（等待方式：%s），打印间隔：%.1f秒\n", e->period_ns,
+               e->idle == RTBW_IDLE_SPIN ? "spin" :
+               e->idle == RTBW_IDLE_PAUSE ? "pause" :
+               rtbw_sched_has_tpause() ? "tpause" : "pause（不支持tpause）",
+               cfg.window_s);
+    if (e->idle_period_ns > e->period_ns)
+        printf("自适应采样：速率不超过 %.1f Mbps 时周期逐步放宽到最长 %lu 纳秒%s\n", e->active_mbps,
+               e->idle_period_ns, e->exclusive ? "（SCHED_FIFO）" : "");
+    else if (e->idle_period_ns)
+        printf("自适应采样最长周期不大于采样周期，不启用\n");
+    if (cfg.max_bracket_ns)
+        printf("采样时刻不确定区间超过 %lu 纳秒的采样将被剔除\n", cfg.max_bracket_ns);
+    if (e->hw_clock)
+        printf("采样时刻取自网卡内部时钟\n");
+    if (cfg.trace_path)
+        printf("原始采样记录写入：%s\n", cfg.trace_path);
+    if (cfg.flight)
+        printf("飞行记录：触发前 %.1f 秒、后 %.1f 秒，转储到 %s（kill -USR1 %d 手动触发）\n",
+               flight_cfg.pre_s, flight_cfg.post_s, flight_cfg.dir, getpid());
+    if (cfg.metrics_name)
+        printf("指标发布到共享内存：%s\n", cfg.metrics_name);
+    if (cfg.metrics_port)
+        printf("Prometheus指标：http://127.0.0.1:%d/metrics\n", cfg.metrics_port);
+    if (cfg.telemetry_dest)
+        printf("遥测发送到：%s\n", cfg.telemetry_dest);
     printf("------------------------------------------------------------\n");
 
-    // 初始化变量
-    uint64_t t1, t2, cycle_diff;
-    uint64_t rcv1, rcv2, xmit1, xmit2;
-    double time_diff_s;
-    uint64_t rcv_diff, xmit_diff;
-    double rx_bw_gbps, tx_bw_gbps;
-    uint64_t interval = PRINT_INTERVAL_S * CPU_FREQ * 1000000000;
-
-    // 初始化1秒周期起始cycle
-    start_cycle = get_cycle();
-
-    // 步骤1：读取初始cycle和RDMA counter
-    t1 = get_cycle();
-    read_rdma_counter_1(counter_fd);
-    uint64_t tmp = get_cycle();
-    t2 = t1 + ((tmp - t1) >> 1);
-
-    // 无限采样循环
-    while (1) {
-	t1 = t2;
-	xmit1 = user_data.val1;
-	rcv1 = user_data.val2;
-
-        // 步骤2：微秒级等待（空循环，无syscall开销）
-        for (uint64_t i = 0; i < loop; i++) {
-            __asm__ __volatile__ ("nop"); // 空操作，避免编译器优化
-        }
+    rtbw_on_window(handle, on_window, NULL);
+    struct sigaction sa = { .sa_handler = on_stop_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
-        // 步骤3：读取当前cycle和RDMA counter
-        t2 = get_cycle();
-	read_rdma_counter_1(counter_fd);
-	tmp = get_cycle();
-	t2 = t2 + ((tmp - t2) >> 1);
-	xmit2 = user_data.val1;
-	rcv2 = user_data.val2;
-
-        // 步骤4：计算时间差和带宽
-        cycle_diff = t2 - t1;
-        time_diff_s = (double)cycle_diff / (CPU_FREQ);
-        rcv_diff = (rcv2 > rcv1) ? (rcv2 - rcv1) : 0;
-        xmit_diff = (xmit2 > xmit1) ? (xmit2 - xmit1) : 0;
-        rx_bw_gbps = (rcv_diff * 8.0 * 4) / (time_diff_s);
-        tx_bw_gbps = (xmit_diff * 8.0 * 4) / (time_diff_s);
-
-        // 步骤5：存入缓存（纯内存操作）
-        if (cache_idx < CACHE_SIZE) {
-            bw_cache[cache_idx].rx_bw_gbps = rx_bw_gbps;
-            bw_cache[cache_idx].tx_bw_gbps = tx_bw_gbps;
-            bw_cache[cache_idx].delta_us = time_diff_s / 1000;
-            cache_idx++;
-        } else {
-            fprintf(stderr, "缓存已满，丢弃本次采样数据\n");
-        }
+    if (rtbw_run(handle) < 0)
+        exit(EXIT_FAILURE);
 
-        // 步骤6：判断是否达到1秒打印周期
-        uint64_t current_cycle = get_cycle();
-        uint64_t elapsed_s = (current_cycle - start_cycle);
-        if (elapsed_s >= interval) {
-            print_peak_bandwidth(elapsed_s);
-            start_cycle = current_cycle;
-
-	    t2 = get_cycle();
-	    read_rdma_counter_1(counter_fd);
-	    tmp = get_cycle();
-	    t2 = t2 + ((tmp - t2) >> 1);
-        }
+    // 停止采样；trace需要写出索引，进行中的飞行记录转储需要写完
+    rtbw_counters c;
+    rtbw_get_counters(handle, &c);
+    if (rtbw_close(handle) < 0) {
+        fprintf(stderr, "trace写入失败：%s\n", cfg.trace_path);
+    } else if (cfg.trace_path) {
+        struct stat st;
+        if (stat(cfg.trace_path, &st) == 0)
+            printf("trace已写入：%s（%.1f MB，丢弃记录 %lu 条）\n", cfg.trace_path,
+                   st.st_size / 1e6, c.trace_dropped);
     }
-
-    // 关闭文件描述符（实际不会执行）
-    close(counter_fd);
-    close(rcv_fd);
-    close(xmit_fd);
-    free(bw_cache);
     return 0;
 }
@@ -0,0 +1,720 @@
+#define _GNU_SOURCE
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chrdev_ioctl_common.h"
+#include "rtbw.h"
+#include "rtbw_trace.h"
+#include "rtbw_telemetry.h"
+
+#define REPORTER_IDLE_US 100       // 聚合线程无数据时的休眠时间
+
+// 应用标记环的一个槽位（有界多生产者队列：seq == 位置时可写，== 位置 + 1时可读）
+typedef struct {
+    uint64_t seq;
+    uint64_t tsc;
+    uint32_t phase;
+} rtbw_mark_slot;
+
+struct rtbw {
+    // 应用线程写（rtbw_mark）
+    _Alignas(RTBW_CACHELINE) uint64_t mark_head;
+    uint64_t marks_dropped;
+    // 聚合线程独占
+    _Alignas(RTBW_CACHELINE) uint64_t mark_tail;
+    rtbw_mark_slot mark[RTBW_MARK_SLOTS];
+
+    rtbw_engine engine;
+    rtbw_config cfg;
+    int nr_targets;
+    rtbw_series *series;                // series[nr_targets]为节点汇总，在设备节点上分配
+    rtbw_burst_config burst_cfg;
+    double tsc_ghz;                     // TSC频率（GHz），只由聚合线程更新
+    uint64_t window_cycles;             // 打印周期（TSC周期）
+    uint64_t max_bracket;               // 采样时刻不确定区间的上限（TSC周期），0不限制
+    uint64_t rejected;
+
+    // 输出
+    rtbw_trace_writer *trace;
+    rtbw_flight *flight;
+    rtbw_telemetry *telemetry;
+    rtbw_metrics *metrics;
+    rtbw_metrics_server *metrics_server;    // -H的HTTP线程，NULL未启用
+    rtbw_window_fn fn[RTBW_MAX_CALLBACKS];
+    void *fn_arg[RTBW_MAX_CALLBACKS];
+    int nr_fn;
+
+    // 聚合状态：周期边界由记录自身的tsc决定，回调期间采样线程照常采样，边界处没有盲区
+    uint64_t window_start_tsc;
+    rtbw_sample prev_sample[RTBW_MAX_TARGETS];
+    int have_prev[RTBW_MAX_TARGETS];
+    // 节点汇总：各目标自上次汇总以来的有效增量和各自的采样区间（记录可以按任意顺序到达）
+    uint64_t node_rx_words[RTBW_MAX_TARGETS], node_tx_words[RTBW_MAX_TARGETS];
+    uint64_t node_cycles[RTBW_MAX_TARGETS];     // 该目标各有效区间之和，0表示还没有增量
+    uint64_t node_begin[RTBW_MAX_TARGETS];      // 该目标第一个有效区间的起点
+    uint64_t node_last;                         // 各目标最新的有效采样时刻中的最大者
+    uint64_t node_end;                          // 上一次汇总的终点，0表示还没有汇总过
+    int node_ready;                             // 已有增量的目标数
+    // 自适应采样：采样线程通过事件记录告知的周期，按记录时刻划分到打印周期
+    uint64_t adapt_period_ns;           // 当前周期（纳秒）
+    uint64_t adapt_changes, adapt_changes_total;
+    uint64_t adapt_max_ns;              // 本打印周期内用过的最长周期
+    uint64_t adapt_since;               // 当前周期在本打印周期内的起点（TSC）
+    uint64_t adapt_fine_cycles;         // 本打印周期内以最细周期采样的时长
+    // 采样自检
+    rtbw_health health;
+    uint64_t health_prev_tsc;
+    uint64_t nvcsw, nivcsw;             // 上一个周期结束时采样线程的上下文切换计数
+    uint64_t stalls_total;
+    // 应用标记
+    uint64_t marks;
+    uint32_t phase;
+    int phase_slot;                     // 当前阶段在win.phases中的下标，-1表示本周期还没有
+    rtbw_window win;
+
+    pthread_t thread;
+    int threaded;
+    int started;
+    int stop;
+};
+
+void rtbw_config_init(rtbw_config *cfg) {
+    *cfg = (rtbw_config) {
+        .backend = &rtbw_backend_ioctl,
+        .period_ns = RTBW_PERIOD_NS_DFT,
+        .core = RTBW_CORE_AUTO,
+        .idle = RTBW_IDLE_PAUSE,
+        .ring_depth = 1,
+        .active_mbps = RTBW_ACTIVE_MBPS_DFT,
+        .window_s = RTBW_WINDOW_S_DFT,
+        .queue_slots = RTBW_QUEUE_SLOTS_DFT,
+    };
+}
+
+// ==================== 应用标记 ====================
+
+void rtbw_mark(rtbw *h, uint32_t phase) {
+    uint64_t tsc = rtbw_rdtscp();
+    uint64_t pos = __atomic_load_n(&h->mark_head, __ATOMIC_RELAXED);
+    rtbw_mark_slot *s;
+    for (;;) {
+        s = &h->mark[pos & (RTBW_MARK_SLOTS - 1)];
+        int64_t dif = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&h->mark_head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            // 环满：聚合线程还没有取走一圈之前的标记
+            __atomic_fetch_add(&h->marks_dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&h->mark_head, __ATOMIC_RELAXED);
+        }
+    }
+    s->tsc = tsc;
+    s->phase = phase;
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+// 当前阶段在本周期阶段表中的位置，表满时返回-1
+static int phase_slot(rtbw *h) {
+    rtbw_window *w = &h->win;
+    if (h->phase_slot >= 0)
+        return h->phase_slot;
+    for (int k = 0; k < w->nr_phases; k++)
+        if (w->phases[k].phase == h->phase)
+            return h->phase_slot = k;
+    if (w->nr_phases == RTBW_WINDOW_PHASES)
+        return -1;
+    w->phases[w->nr_phases] = (rtbw_phase_stat) { .phase = h->phase };
+    return h->phase_slot = w->nr_phases++;
+}
+
+static void process_mark(rtbw *h, const rtbw_sample *ev) {
+    if (h->trace)
+        rtbw_trace_add(h->trace, ev);
+    if (h->flight)
+        rtbw_flight_add(h->flight, ev);
+    h->marks++;
+    if (h->phase != ev->tx) {
+        h->phase = ev->tx;
+        h->phase_slot = -1;
+    }
+}
+
+// 把时刻不晚于tsc的标记按顺序并入采样流（应用线程之间的先后以取得槽位的顺序为准）
+static inline void merge_marks(rtbw *h, uint64_t tsc) {
+    for (;;) {
+        rtbw_mark_slot *s = &h->mark[h->mark_tail & (RTBW_MARK_SLOTS - 1)];
+        if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != h->mark_tail + 1 || s->tsc > tsc)
+            return;
+        rtbw_sample ev = { .tsc = s->tsc, .tx = s->phase, .target = RTBW_TARGET_MARK };
+        __atomic_store_n(&s->seq, h->mark_tail + RTBW_MARK_SLOTS, __ATOMIC_RELEASE);
+        h->mark_tail++;
+        process_mark(h, &ev);
+    }
+}
+
+// ==================== 聚合 ====================
+
+// 记入一个采样：只追加整数差值（TSC周期、4字节计数），换算成Gbps推迟到块满或周期结束时成批进行
+static inline void store_bandwidth(rtbw *h, rtbw_series *s, uint64_t cycle_diff, uint64_t rcv_diff, uint64_t xmit_diff) {
+    rtbw_stats_push(&s->stats, cycle_diff, rcv_diff, xmit_diff, h->tsc_ghz);
+}
+
+// 记入多尺度窗口（字节数，按采样区间的TSC时间划分）
+static inline void store_burst(rtbw *h, rtbw_series *s, uint64_t t_begin, uint64_t t_end,
+                               uint64_t rx_bytes, uint64_t tx_bytes) {
+    if (!h->burst_cfg.nr)
+        return;
+    rtbw_burst_add(&s->rx_burst, t_begin, t_end, rx_bytes);
+    rtbw_burst_add(&s->tx_burst, t_begin, t_end, tx_bytes);
+}
+
+static void reset_series(rtbw_series *s) {
+    rtbw_stats_reset(&s->stats);
+    rtbw_burst_reset_window(&s->rx_burst);
+    rtbw_burst_reset_window(&s->tx_burst);
+}
+
+// 初始化各序列（统计结构大小固定，无需大块缓存）
+static void init_series(rtbw *h) {
+    for (int i = 0; i <= h->nr_targets; i++) {
+        rtbw_series *s = &h->series[i];
+        if (i < h->nr_targets)
+            snprintf(s->name, sizeof(s->name), "%s", h->engine.target_name[i]);
+        else
+            snprintf(s->name, sizeof(s->name), "节点汇总");
+        rtbw_stats_reset(&s->stats);
+        rtbw_burst_init(&s->rx_burst, &h->burst_cfg);
+        rtbw_burst_init(&s->tx_burst, &h->burst_cfg);
+    }
+}
+
+// 周期事件：之前的区间按旧周期计时，之后的采样间隔按新周期
+static void note_period(rtbw *h, const rtbw_sample *r) {
+    if (h->adapt_since && h->adapt_period_ns == h->engine.period_ns && r->tsc > h->adapt_since)
+        h->adapt_fine_cycles += r->tsc - h->adapt_since;
+    h->adapt_since = r->tsc;
+    h->adapt_period_ns = r->tx;
+    if (h->adapt_period_ns > h->adapt_max_ns)
+        h->adapt_max_ns = h->adapt_period_ns;
+    h->adapt_changes++;
+    h->adapt_changes_total++;
+}
+
+static void note_health(rtbw *h, const rtbw_sample *r) {
+    rtbw_health *hl = &h->health;
+    uint64_t read_ns = r->read_cycles / h->tsc_ghz;
+    hl->read.count[rtbw_hist_index(read_ns)]++;
+    hl->reads++;
+    if (read_ns > hl->max_read)
+        hl->max_read = read_ns;
+    if (h->health_prev_tsc && r->tsc > h->health_prev_tsc) {
+        uint64_t ns = (r->tsc - h->health_prev_tsc) / h->tsc_ghz;
+        hl->interval.count[rtbw_hist_index(ns)]++;
+        hl->rounds++;
+        if (ns > hl->max_interval) {
+            hl->max_interval = ns;
+            hl->max_at = r->tsc;
+        }
+        if (ns > 2 * h->adapt_period_ns)
+            hl->stalls++;
+    }
+    h->health_prev_tsc = r->tsc;
+}
+
+// 本周期采样线程的上下文切换（procfs读取失败时ctxsw_valid为0）
+static void note_ctxsw(rtbw *h) {
+    rtbw_health *hl = &h->health;
+    uint64_t nvcsw, nivcsw;
+    hl->ctxsw_valid = rtbw_engine_ctxsw(&h->engine, &nvcsw, &nivcsw) == 0;
+    if (!hl->ctxsw_valid)
+        return;
+    hl->nvcsw = nvcsw - h->nvcsw;
+    hl->nivcsw = nivcsw - h->nivcsw;
+    h->nvcsw = nvcsw;
+    h->nivcsw = nivcsw;
+}
+
+void rtbw_get_counters(rtbw *h, rtbw_counters *c) {
+    *c = (rtbw_counters) {
+        .dropped = rtbw_engine_dropped(&h->engine),
+        .missed = rtbw_sched_missed(&h->engine.sched),
+        .lost = rtbw_engine_lost(&h->engine),
+        .rejected = h->rejected,
+        .trace_dropped = h->trace ? rtbw_trace_dropped(h->trace) : 0,
+        .flight_suppressed = h->flight ? rtbw_flight_suppressed(h->flight) : 0,
+        .telemetry_dropped = h->telemetry ? rtbw_telemetry_dropped(h->telemetry) : 0,
+        .marks = h->marks,
+        .marks_dropped = __atomic_load_n(&h->marks_dropped, __ATOMIC_RELAXED),
+    };
+}
+
+static void fill_metrics_dir(rtbw_metrics_dir *d, const rtbw_stream *s, uint32_t n) {
+    d->max = s->max;
+    d->mean = rtbw_stream_mean(s, n);
+    d->p50 = rtbw_hist_percentile(&s->hist, n, 0.50, s->max);
+    d->p99 = rtbw_hist_percentile(&s->hist, n, 0.99, s->max);
+    d->p999 = rtbw_hist_percentile(&s->hist, n, 0.999, s->max);
+}
+
+// 把本周期各序列的统计发布到指标段（在回调和重置统计之前，采样线程不参与）
+static void publish_metrics(rtbw *h, const rtbw_window *w) {
+    rtbw_metrics *m = h->metrics;
+    const rtbw_health *hl = &w->health;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rtbw_metrics_begin(m);
+    for (int i = 0; i <= h->nr_targets; i++) {
+        rtbw_metrics_series *ms = &m->series[i];
+        const rtbw_stats *st = &h->series[i].stats;
+        ms->samples = st->samples;
+        fill_metrics_dir(&ms->rx, &st->rx, st->samples);
+        fill_metrics_dir(&ms->tx, &st->tx, st->samples);
+    }
+    m->windows++;
+    m->window_end_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    m->window_s = (w->end_tsc - w->start_tsc) / w->tsc_hz;
+    m->dropped = w->counters.dropped;
+    m->missed = w->counters.missed;
+    m->lost = w->counters.lost;
+    m->trace_dropped = w->counters.trace_dropped;
+    m->period_ns = w->period_ns;
+    m->period_changes = w->period_changes_total;
+    m->interval_p99_us = rtbw_hist_percentile(&hl->interval, hl->rounds, 0.99, hl->max_interval / 1e3);
+    m->interval_max_us = hl->max_interval / 1e3;
+    m->read_p99_us = rtbw_hist_percentile(&hl->read, hl->reads, 0.99, hl->max_read / 1e3);
+    m->stalls = h->stalls_total;
+    if (hl->ctxsw_valid)
+        m->nivcsw = h->nivcsw;
+    rtbw_metrics_end(m);
+}
+
+static void fill_tm_dir(rtbw *h, struct rtbw_tm_dir *d, const rtbw_stream *s, uint32_t n, const rtbw_burst *b) {
+    *d = (struct rtbw_tm_dir) {
+        .max = s->max, .mean = rtbw_stream_mean(s, n),
+        .p50 = rtbw_hist_percentile(&s->hist, n, 0.50, s->max),
+        .p99 = rtbw_hist_percentile(&s->hist, n, 0.99, s->max),
+        .p999 = rtbw_hist_percentile(&s->hist, n, 0.999, s->max),
+    };
+    if (h->burst_cfg.nr) {
+        d->burst_peak = rtbw_burst_gbps(&h->burst_cfg, 0, b->lv[0].peak);
+        d->bursts = b->lv[0].bursts;
+    }
+}
+
+// 每个序列一条遥测记录，周期边界按当前的TSC/实时时钟对应关系换算
+static void send_telemetry(rtbw *h, const rtbw_window *w) {
+    struct timespec ts;
+    uint64_t now_tsc = rtbw_rdtscp();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double now_ns = (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+    double ns_per_cycle = 1e9 / w->tsc_hz;
+    struct rtbw_tm_record rec = {
+        .start_ns = now_ns - (double)(int64_t)(now_tsc - w->start_tsc) * ns_per_cycle,
+        .end_ns = now_ns - (double)(int64_t)(now_tsc - w->end_tsc) * ns_per_cycle,
+        .burst_window_ns = h->burst_cfg.nr ? h->burst_cfg.window_ns[0] : 0,
+    };
+    for (int i = 0; i <= h->nr_targets; i++) {
+        const rtbw_series *s = &h->series[i];
+        memcpy(rec.name, s->name, sizeof(rec.name));
+        rec.samples = s->stats.samples;
+        rec.vport = i < h->nr_targets ? h->engine.target_vport[i] : 0;
+        rec.flags = i == h->nr_targets ? RTBW_TM_NODE : 0;
+        fill_tm_dir(h, &rec.rx, &s->stats.rx, rec.samples, &s->rx_burst);
+        fill_tm_dir(h, &rec.tx, &s->stats.tx, rec.samples, &s->tx_burst);
+        rtbw_telemetry_add(h->telemetry, &rec);
+    }
+    rtbw_telemetry_flush(h->telemetry);
+}
+
+// 一个打印周期结束：
+// 1. 对照CLOCK_MONOTONIC_RAW修正TSC频率（不睡眠，不影响采样线程），用它换算各序列尚未换算的差值
+// 2. 填写rtbw_window，发布指标、发送遥测，按注册顺序调用回调
+// 3. 清零各序列和本周期的自检/自适应/阶段统计
+static void report_window(rtbw *h, uint64_t window_end) {
+    rtbw_window *w = &h->win;
+    double tsc_hz = rtbw_clock_refine();
+    h->tsc_ghz = tsc_hz / 1e9;
+    h->window_cycles = h->cfg.window_s * tsc_hz;
+    for (int i = 0; i <= h->nr_targets; i++)
+        rtbw_stats_flush(&h->series[i].stats, h->tsc_ghz);
+
+    if (h->adapt_since && h->adapt_period_ns == h->engine.period_ns && window_end > h->adapt_since)
+        h->adapt_fine_cycles += window_end - h->adapt_since;
+    uint64_t elapsed = window_end - h->window_start_tsc;
+    w->index++;
+    w->start_tsc = h->window_start_tsc;
+    w->end_tsc = window_end;
+    w->tsc_hz = tsc_hz;
+    w->period_ns = h->adapt_period_ns;
+    w->max_period_ns = h->adapt_max_ns;
+    w->period_changes = h->adapt_changes;
+    w->period_changes_total = h->adapt_changes_total;
+    w->fine_ratio = elapsed ? (double)h->adapt_fine_cycles / elapsed : 1.0;
+    note_ctxsw(h);
+    h->stalls_total += h->health.stalls;
+    w->health = h->health;
+    rtbw_get_counters(h, &w->counters);
+    w->phase = h->phase;
+
+    publish_metrics(h, w);
+    if (h->telemetry)
+        send_telemetry(h, w);
+    for (int k = 0; k < h->nr_fn; k++)
+        h->fn[k](h, w, h->fn_arg[k]);
+
+    for (int i = 0; i <= h->nr_targets; i++)
+        reset_series(&h->series[i]);
+    // 保留上一轮时刻，下一周期的第一个间隔跨过边界
+    memset(&h->health, 0, sizeof(h->health));
+    h->adapt_changes = 0;
+    h->adapt_max_ns = h->adapt_period_ns;
+    h->adapt_since = window_end;
+    h->adapt_fine_cycles = 0;
+    w->nr_phases = 0;
+    h->phase_slot = -1;
+}
+
+// 节点汇总：每个目标都有了新的有效增量时汇总一次，不要求同一轮的记录按目标顺序到达
+// （内核异步流水线中各目标的命令交错完成，失败和乱序的采样不写入环）。
+// 速率 = 各目标按各自区间换算的速率之和，区间为上次汇总的终点到本次各目标最新采样时刻；
+// 阶段归类的字节数为各目标的实际增量之和
+static void node_flush(rtbw *h) {
+    int n = h->nr_targets;
+    uint64_t begin = h->node_end, end = h->node_last;
+    uint64_t rx_words = 0, tx_words = 0;
+    double rx_rate = 0, tx_rate = 0;
+    if (!begin) {
+        begin = h->node_begin[0];
+        for (int i = 1; i < n; i++)
+            if (h->node_begin[i] < begin)
+                begin = h->node_begin[i];
+    }
+    for (int i = 0; i < n; i++) {
+        rx_rate += (double)h->node_rx_words[i] / h->node_cycles[i];
+        tx_rate += (double)h->node_tx_words[i] / h->node_cycles[i];
+        rx_words += h->node_rx_words[i];
+        tx_words += h->node_tx_words[i];
+        h->node_rx_words[i] = h->node_tx_words[i] = h->node_cycles[i] = 0;
+    }
+    h->node_ready = 0;
+    if (end <= begin)
+        return;
+    h->node_end = end;
+
+    rtbw_series *node = &h->series[n];
+    uint64_t cycles = end - begin;
+    uint64_t rx = (uint64_t)(rx_rate * cycles + 0.5), tx = (uint64_t)(tx_rate * cycles + 0.5);
+    store_bandwidth(h, node, cycles, rx, tx);
+    store_burst(h, node, begin, end, rx * 4, tx * 4);
+    int k = phase_slot(h);
+    if (k >= 0) {
+        rtbw_phase_stat *ps = &h->win.phases[k];
+        ps->rounds++;
+        ps->cycles += cycles;
+        ps->rx_bytes += rx_words * 4;
+        ps->tx_bytes += tx_words * 4;
+    }
+}
+
+// 处理一条记录；各目标的增量计入各自的序列和节点汇总，然后检查打印周期
+static void process_sample(rtbw *h, const rtbw_sample *r) {
+    uint32_t i = r->target;
+    int n = h->nr_targets;
+    if (i == RTBW_TARGET_PERIOD) {
+        note_period(h, r);
+        return;
+    }
+    if (i >= (uint32_t)n)
+        return;
+    if (i == 0)
+        note_health(h, r);
+    // 时间区间过宽的采样整条剔除（不作为下一个差值的起点），下一个有效采样的差值跨过它，总字节数不变
+    if (h->max_bracket && r->err == 0 && r->read_cycles > h->max_bracket) {
+        h->rejected++;
+    } else if (r->err == 0) {
+        const rtbw_sample *p = &h->prev_sample[i];
+        if (h->have_prev[i] && r->tsc > p->tsc) {
+            uint64_t rcv_diff = (r->rx > p->rx) ? (r->rx - p->rx) : 0;
+            uint64_t xmit_diff = (r->tx > p->tx) ? (r->tx - p->tx) : 0;
+            store_bandwidth(h, &h->series[i], r->tsc - p->tsc, rcv_diff, xmit_diff);
+            store_burst(h, &h->series[i], p->tsc, r->tsc, rcv_diff * 4, xmit_diff * 4);
+            if (!h->node_cycles[i]) {
+                h->node_begin[i] = p->tsc;
+                h->node_ready++;
+            }
+            h->node_rx_words[i] += rcv_diff;
+            h->node_tx_words[i] += xmit_diff;
+            h->node_cycles[i] += r->tsc - p->tsc;
+            if (r->tsc > h->node_last)
+                h->node_last = r->tsc;
+            if (h->node_ready == n)
+                node_flush(h);
+        }
+        h->prev_sample[i] = *r;
+        h->have_prev[i] = 1;
+    } else {
+        h->have_prev[i] = 0;
+    }
+    // 同一轮的记录依次到达时只在最后一个目标处检查，周期边界不会把一轮拆开；
+    // 内核环中记录交错到达，按每条记录检查（某个目标一直失败时打印周期照常结束）
+    if (i != (uint32_t)n - 1 && !h->engine.ring_period_ns)
+        return;
+
+    if (h->window_start_tsc == 0) {
+        h->window_start_tsc = r->tsc;
+        h->adapt_since = r->tsc;
+    } else if (r->tsc > h->window_start_tsc && r->tsc - h->window_start_tsc >= h->window_cycles) {
+        report_window(h, r->tsc);
+        h->window_start_tsc = r->tsc;
+    }
+}
+
+static void reporter_idle(void) {
+    struct timespec req = { .tv_nsec = REPORTER_IDLE_US * 1000 };
+    nanosleep(&req, NULL);
+}
+
+// 聚合主循环（不绑核）：批量取出采样线程推送的记录，rtbw_stop后返回
+static void run_reporter(rtbw *h) {
+    rtbw_spsc *q = &h->engine.q;
+    while (!__atomic_load_n(&h->stop, __ATOMIC_RELAXED)) {
+        uint64_t n = rtbw_spsc_available(q);
+        if (n == 0) {
+            reporter_idle();
+            continue;
+        }
+        for (uint64_t i = 0; i < n; i++) {
+            const rtbw_sample *r = rtbw_spsc_peek(q, i);
+            merge_marks(h, r->tsc);
+            if (h->trace)
+                rtbw_trace_add(h->trace, r);
+            if (h->flight)
+                rtbw_flight_add(h->flight, r);
+            process_sample(h, r);
+        }
+        rtbw_spsc_release(q, n);
+    }
+}
+
+// 后台聚合线程：只绑定库自己创建的线程，应用线程的绑定不变
+static void *reporter_thread(void *arg) {
+    rtbw *h = arg;
+    rtbw_engine_bind_reporter(&h->engine, pthread_self());
+    run_reporter(h);
+    return NULL;
+}
+
+// ==================== 打开/启动/关闭 ====================
+
+static int check_config(const rtbw_config *cfg) {
+    if ((cfg->ring_period_ns || cfg->coalesce_ns || cfg->hw_clock) && cfg->backend != &rtbw_backend_ioctl) {
+        fprintf(stderr, "内核采样环、合并查询和网卡时钟只适用于ioctl后端\n");
+        return -1;
+    }
+    if (cfg->ring_period_ns && cfg->ring_period_ns < CHRDEV_RING_MIN_PERIOD) {
+        fprintf(stderr, "内核采样环周期不能小于 %d 纳秒\n", CHRDEV_RING_MIN_PERIOD);
+        return -1;
+    }
+    if (cfg->ring_period_ns && (cfg->ring_depth < 1 || cfg->ring_depth > CHRDEV_RING_MAX_DEPTH)) {
+        fprintf(stderr, "在途命令数须在1到%d之间\n", CHRDEV_RING_MAX_DEPTH);
+        return -1;
+    }
+    if (cfg->ring_period_ns && cfg->idle_period_ns) {
+        fprintf(stderr, "自适应采样不适用于内核采样环\n");
+        return -1;
+    }
+    if (cfg->period_ns == 0 || cfg->window_s <= 0 || cfg->queue_slots < RTBW_MAX_TARGETS + 1 ||
+        (cfg->queue_slots & (cfg->queue_slots - 1))) {
+        fprintf(stderr, "采样周期、打印周期或队列槽位数无效\n");
+        return -1;
+    }
+    return 0;
+}
+
+rtbw *rtbw_open(const rtbw_config *cfg) {
+    rtbw_config c = *cfg;
+    if (!c.backend)
+        c.backend = &rtbw_backend_ioctl;
+    if (check_config(&c) < 0)
+        return NULL;
+    // TSC频率在后端打开（测量ioctl延迟、启动合成模型）之前确定
+    if (rtbw_clock_init(c.force_tsc) < 0)
+        return NULL;
+    double tsc_hz = rtbw_clock_hz();
+    rtbw_engine *e;
+
+    // 句柄按页分配：标记环的生产者/消费者各占一个cache line
+    rtbw *h = rtbw_numa_alloc(sizeof(*h), -1);
+    if (!h) {
+        perror("alloc rtbw failed");
+        return NULL;
+    }
+    h->cfg = c;
+    h->tsc_ghz = tsc_hz / 1e9;
+    h->window_cycles = c.window_s * tsc_hz;
+    h->max_bracket = c.max_bracket_ns * tsc_hz / 1e9;
+    h->phase_slot = -1;
+    for (uint64_t k = 0; k < RTBW_MARK_SLOTS; k++)
+        h->mark[k].seq = k;
+    if (c.burst_list && rtbw_burst_parse(&h->burst_cfg, c.burst_list, c.burst_threshold, tsc_hz) < 0)
+        goto fail;
+
+    e = &h->engine;
+    e->period_ns = c.period_ns;
+    e->core = c.core;
+    e->idle = c.idle;
+    e->ring_period_ns = c.ring_period_ns;
+    e->ring_depth = c.ring_depth;
+    e->path = c.path;
+    e->coalesce_ns = c.coalesce_ns;
+    e->hw_clock = c.hw_clock;
+    e->idle_period_ns = c.idle_period_ns;
+    e->active_mbps = c.active_mbps;
+    if (rtbw_engine_open(e, c.backend, c.targets) < 0) {
+        fprintf(stderr, "open backend %s failed\n", c.backend->name);
+        goto fail;
+    }
+    h->nr_targets = e->nr_targets;
+    // 先确定放置再分配和初始化统计，统计内存在设备节点上（调用线程的绑定不变）
+    rtbw_engine_place(e);
+    h->series = rtbw_numa_alloc((h->nr_targets + 1) * sizeof(rtbw_series), e->node);
+    if (!h->series) {
+        perror("alloc series failed");
+        goto fail_engine;
+    }
+    init_series(h);
+    h->adapt_period_ns = h->adapt_max_ns = e->ring_period_ns ? e->ring_period_ns : e->period_ns;
+    h->win.nr_targets = h->nr_targets;
+    h->win.series = h->series;
+    h->win.burst = &h->burst_cfg;
+
+    if (c.trace_path) {
+        h->trace = rtbw_trace_create(c.trace_path, e);
+        if (!h->trace)
+            goto fail_outputs;
+    }
+    if (c.flight) {
+        // 缓冲区按最细的采样周期估算（自适应采样放宽周期时能覆盖更长的时间）
+        h->flight = rtbw_flight_create(c.flight, e, h->adapt_period_ns);
+        if (!h->flight)
+            goto fail_outputs;
+    }
+    // 指标段总是创建（没有名称时在进程内），rtbw_latest直接返回它
+    h->metrics = rtbw_metrics_create(c.metrics_name, e);
+    if (!h->metrics)
+        goto fail_outputs;
+    if (c.metrics_port) {
+        h->metrics_server = rtbw_metrics_serve(h->metrics, c.metrics_port);
+        if (!h->metrics_server)
+            goto fail_outputs;
+    }
+    if (c.telemetry_dest) {
+        h->telemetry = rtbw_telemetry_create(c.telemetry_dest, c.telemetry_host);
+        if (!h->telemetry)
+            goto fail_outputs;
+    }
+    return h;
+
+fail_outputs:
+    if (h->flight)
+        rtbw_flight_close(h->flight);
+    if (h->trace)
+        rtbw_trace_close(h->trace, tsc_hz);
+    if (h->metrics_server)
+        rtbw_metrics_server_close(h->metrics_server);
+    if (h->metrics)
+        rtbw_metrics_close(h->metrics, c.metrics_name);
+    rtbw_numa_free(h->series, (h->nr_targets + 1) * sizeof(rtbw_series));
+fail_engine:
+    e->backend->close(e);
+fail:
+    rtbw_numa_free(h, sizeof(*h));
+    return NULL;
+}
+
+rtbw_engine *rtbw_get_engine(rtbw *h) {
+    return &h->engine;
+}
+
+int rtbw_on_window(rtbw *h, rtbw_window_fn fn, void *arg) {
+    if (h->nr_fn == RTBW_MAX_CALLBACKS || h->started) {
+        fprintf(stderr, "回调已满或采样已启动\n");
+        return -1;
+    }
+    h->fn[h->nr_fn] = fn;
+    h->fn_arg[h->nr_fn++] = arg;
+    return 0;
+}
+
+static int begin(rtbw *h) {
+    if (h->started) {
+        fprintf(stderr, "采样已启动\n");
+        return -1;
+    }
+    if (rtbw_engine_start(&h->engine, h->cfg.queue_slots) < 0)
+        return -1;
+    h->started = 1;
+    return 0;
+}
+
+int rtbw_start(rtbw *h) {
+    if (begin(h) < 0)
+        return -1;
+    if (pthread_create(&h->thread, NULL, reporter_thread, h) != 0) {
+        perror("pthread_create reporter failed");
+        return -1;
+    }
+    h->threaded = 1;
+    return 0;
+}
+
+// 在调用线程上聚合：期间临时绑定到设备本地的CPU，返回前恢复调用者原来的绑定
+int rtbw_run(rtbw *h) {
+    cpu_set_t saved;
+    int restore = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0;
+    if (begin(h) < 0)
+        return -1;
+    rtbw_engine_bind_reporter(&h->engine, pthread_self());
+    run_reporter(h);
+    if (restore)
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+    return 0;
+}
+
+void rtbw_stop(rtbw *h) {
+    __atomic_store_n(&h->stop, 1, __ATOMIC_RELAXED);
+}
+
+const rtbw_metrics *rtbw_latest(rtbw *h) {
+    return h->metrics;
+}
+
+// 采样线程退出后关闭后端；trace需要写出索引，进行中的飞行记录转储需要写完。
+// HTTP线程先退出，再释放指标段
+int rtbw_close(rtbw *h) {
+    int ret = 0;
+    rtbw_stop(h);
+    if (h->threaded)
+        pthread_join(h->thread, NULL);
+    if (h->started)
+        rtbw_engine_stop(&h->engine);
+    else
+        h->engine.backend->close(&h->engine);
+    if (h->flight)
+        rtbw_flight_close(h->flight);
+    if (h->metrics_server)
+        rtbw_metrics_server_close(h->metrics_server);
+    rtbw_metrics_close(h->metrics, h->cfg.metrics_name);
+    if (h->telemetry)
+        rtbw_telemetry_close(h->telemetry);
+    if (h->trace && rtbw_trace_close(h->trace, rtbw_clock_refine()) < 0)
+        ret = -1;
+    rtbw_numa_free(h->series, (h->nr_targets + 1) * sizeof(rtbw_series));
+    rtbw_numa_free(h, sizeof(*h));
+    return ret;
+}
@@ -0,0 +1,143 @@
+#ifndef RTBW_H
+#define RTBW_H
+
+#include <stdint.h>
+#include "rtbw_stats.h"
+#include "rtbw_burst.h"
+#include "rtbw_engine.h"
+#include "rtbw_metrics.h"
+#include "rtbw_flight.h"
+
+// librtbw：进程内的带宽采样库（librtbw.a / librtbw.so），rt_bw是它的一个客户端
+// 1. rtbw_open：校准TSC、打开计数器后端和目标、确定采样核心，创建trace/飞行记录/指标/遥测等输出
+// 2. rtbw_on_window注册回调，rtbw_start在后台聚合线程运行（或rtbw_run在调用线程运行）：
+//    绑核的采样线程读计数器，聚合线程换算带宽、按打印周期统计，每个周期结束时依次调用回调
+// 3. rtbw_latest：最近一个周期的指标段，顺序锁保护，直接读取不复制（见rtbw_metrics_read_begin）
+// 4. rtbw_mark：应用在任意线程给采样流打上阶段号，只有一次rdtsc和一次无竞争的CAS；
+//    聚合线程按时刻把标记并入采样流（trace和飞行记录中为RTBW_TARGET_MARK事件），
+//    并把节点汇总的字节数按阶段归类到rtbw_window.phases
+// 飞行记录的SIGUSR1和TSC校准是进程全局的，同一进程同时只使用一个句柄
+
+#define RTBW_WINDOW_S_DFT 2.0               // 默认打印周期（秒）
+#define RTBW_PERIOD_NS_DFT 5000             // 默认采样周期（纳秒）
+#define RTBW_QUEUE_SLOTS_DFT (1 << 20)      // 采样线程→聚合线程队列槽位数
+#define RTBW_ACTIVE_MBPS_DFT 10.0           // 自适应采样默认的有流量阈值
+#define RTBW_MAX_CALLBACKS 8
+#define RTBW_MARK_SLOTS 4096                // 标记环槽位数（2的幂），聚合线程来不及取出时丢弃并计数
+#define RTBW_WINDOW_PHASES 16               // 每个周期最多归类的阶段数，之后出现的阶段不再归类
+
+typedef struct {
+    const rtbw_backend *backend;        // NULL为ioctl后端
+    const char *targets;                // 逗号分隔的目标列表，NULL使用后端的默认目标
+    const char *path;                   // 替换ioctl后端的设备文件或sysfs后端的根目录
+    uint64_t period_ns;                 // 采样周期
+    int core;                           // 采样核心，RTBW_CORE_AUTO自动选择，-1不绑核
+    rtbw_idle_mode idle;                // 等待截止时间的方式
+    uint32_t ring_period_ns;            // ioctl后端：内核采样环周期，0不使用
+    uint32_t ring_depth;                // ioctl后端：在途固件命令数
+    uint32_t coalesce_ns;               // ioctl后端：与其他进程合并查询
+    int hw_clock;                       // ioctl后端：用网卡内部时钟计时
+    uint64_t idle_period_ns;            // 自适应采样的最长周期，0不启用
+    double active_mbps;                 // 自适应采样的有流量阈值
+    int force_tsc;                      // TSC不可靠时仍然运行
+    double window_s;                    // 打印周期（秒）
+    uint64_t queue_slots;
+    uint64_t max_bracket_ns;            // 剔除采样时刻不确定区间超过该值的采样，0不限制
+    const char *burst_list;             // 多尺度窗口，如"10us,100us,1ms"，NULL不统计
+    double burst_threshold;             // 突发阈值（Gbps），0不统计突发
+    const char *trace_path;             // 原始采样记录，NULL不记录
+    const rtbw_flight_config *flight;   // 飞行记录（rtbw_flight_parse），NULL不启用
+    const char *telemetry_dest;         // 遥测 地址:端口，NULL不发送
+    const char *telemetry_host;         // 遥测中的主机名，NULL使用gethostname
+    const char *metrics_name;           // 指标段的POSIX共享内存名称，NULL只在进程内
+    int metrics_port;                   // Prometheus端口，0不提供
+} rtbw_config;
+
+// 一条带宽序列（每个目标一条，外加节点汇总）
+typedef struct {
+    char name[RTBW_NAME_LEN];
+    rtbw_stats stats;                   // 本周期的流式统计
+    rtbw_burst rx_burst, tx_burst;      // 多尺度滑动窗口（burst_list）
+} rtbw_series;
+
+// 采样自检：每轮（第一个目标的记录）的采样间隔和读计数器耗时
+typedef struct {
+    rtbw_hist interval;                 // 相邻两轮的间隔（纳秒）
+    rtbw_hist read;                     // 读计数器耗时（纳秒）
+    uint32_t rounds, reads;
+    uint64_t max_interval, max_read;    // 纳秒
+    uint64_t max_at;                    // 最长间隔的结束时刻（TSC）
+    uint32_t stalls;                    // 间隔超过当前周期2倍的次数
+    int ctxsw_valid;                    // 采样线程的上下文切换计数是否读取成功
+    uint64_t nvcsw, nivcsw;             // 本周期采样线程的自愿/非自愿上下文切换
+} rtbw_health;
+
+// 累计计数
+typedef struct {
+    uint64_t dropped;                   // 采样队列满丢弃的轮数
+    uint64_t missed;                    // 采样错过截止时间次数
+    uint64_t lost;                      // 后端丢失的采样数
+    uint64_t rejected;                  // 因时间区间过宽剔除的采样数
+    uint64_t trace_dropped;             // trace写盘跟不上丢弃的记录数
+    uint64_t flight_suppressed;         // 上一次转储未写完而被忽略的触发次数
+    uint64_t telemetry_dropped;         // 遥测发送失败丢弃的数据报数
+    uint64_t marks;                     // 已并入采样流的标记数
+    uint64_t marks_dropped;             // 标记环满丢弃的标记数
+} rtbw_counters;
+
+// 一个阶段在本周期内的节点汇总
+typedef struct {
+    uint32_t phase;
+    uint32_t rounds;                    // 计入的节点汇总次数（每个目标都有新的有效增量时汇总一次）
+    uint64_t cycles;                    // 这些轮的采样间隔之和（TSC周期）
+    uint64_t rx_bytes, tx_bytes;
+} rtbw_phase_stat;
+
+// 一个打印周期的结果（回调期间有效，返回后各序列清零）
+typedef struct {
+    uint64_t index;                     // 周期序号，从1开始
+    uint64_t start_tsc, end_tsc;        // 周期边界（采样时刻）
+    double tsc_hz;                      // 本周期换算所用的TSC频率
+    int nr_targets;
+    const rtbw_series *series;          // nr_targets + 1条，最后一条为节点汇总
+    const rtbw_burst_config *burst;
+    rtbw_health health;
+    // 自适应采样
+    uint64_t period_ns;                 // 周期结束时的采样周期
+    uint64_t max_period_ns;             // 本周期内用过的最长周期
+    uint64_t period_changes;            // 本周期的调整次数
+    uint64_t period_changes_total;
+    double fine_ratio;                  // 以最细周期采样的时长占比
+    rtbw_counters counters;
+    // 应用标记
+    uint32_t phase;                     // 周期结束时的阶段
+    int nr_phases;
+    rtbw_phase_stat phases[RTBW_WINDOW_PHASES];
+} rtbw_window;
+
+typedef struct rtbw rtbw;
+typedef void (*rtbw_window_fn)(rtbw *h, const rtbw_window *w, void *arg);
+
+void rtbw_config_init(rtbw_config *cfg);
+// 失败时打印原因并返回NULL
+rtbw *rtbw_open(const rtbw_config *cfg);
+// 打开后的引擎（目标名称、NUMA节点、采样核心等），应用不修改其中的配置
+rtbw_engine *rtbw_get_engine(rtbw *h);
+// 注册周期回调（在rtbw_start/rtbw_run之前），回调在聚合线程中按注册顺序调用
+int rtbw_on_window(rtbw *h, rtbw_window_fn fn, void *arg);
+// 启动采样线程和后台聚合线程
+int rtbw_start(rtbw *h);
+// 启动采样线程，在调用线程聚合，直到rtbw_stop（期间调用线程绑定到设备本地的CPU，返回前恢复）
+int rtbw_run(rtbw *h);
+// 让聚合停止（可在信号处理函数和回调中调用）
+void rtbw_stop(rtbw *h);
+// 给采样流打上阶段号（任意线程，不阻塞）
+void rtbw_mark(rtbw *h, uint32_t phase);
+// 最近一个周期的指标段（rtbw_close时释放，之后不能再读取）
+const rtbw_metrics *rtbw_latest(rtbw *h);
+// 累计计数（在回调中或聚合停止之后调用）
+void rtbw_get_counters(rtbw *h, rtbw_counters *c);
+// 停止采样和聚合，关闭各输出；trace写入失败时返回-1
+int rtbw_close(rtbw *h);
+
+#endif // RTBW_H
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include "chrdev_ioctl_common.h"  // 包含共用头文件
+#include "rtbw_target.h"
+
+// 低开销常驻代理：采样和窗口统计都在内核线程中完成（CHRDEV_IOCTL_SUMMARY_START），
+// 本进程以低优先级阻塞在poll()上，每个窗口被唤醒一次，读取一条汇总记录并打印。
+// 不绑核、不自旋，适合无法为监控单独隔离CPU的机器。
+
+#define CHRDEV_PATH "/dev/chrdev_ioctl_dev"
+#define DEFAULT_PERIOD_NS 10000    // 内核采样周期（纳秒）
+#define DEFAULT_WINDOW_MS 1000     // 窗口长度（毫秒）
+#define AGENT_NICE 10
+
+static volatile sig_atomic_t stop_requested;
+static char target_name[CHRDEV_MAX_TARGETS][32];
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// 桶的代表值（桶内中点，Mbps），与内核chrdev_summary_bucket对应
+static double bucket_mbps(int idx) {
+    if (idx < CHRDEV_SUMMARY_SUB)
+        return idx;
+    int e = (idx - CHRDEV_SUMMARY_SUB) / CHRDEV_SUMMARY_SUB + CHRDEV_SUMMARY_SUB_BITS;
+    int mant = (idx - CHRDEV_SUMMARY_SUB) % CHRDEV_SUMMARY_SUB;
+    double width = (double)(1ULL << (e - CHRDEV_SUMMARY_SUB_BITS));
+    return (CHRDEV_SUMMARY_SUB + mant) * width + width / 2;
+}
+
+// 直方图分位数（Gbps），不超过峰值
+static double percentile_gbps(const struct chrdev_summary_dir *d, uint32_t total, double q) {
+    uint64_t need = (uint64_t)(q * total + 0.5), acc = 0;
+    if (total == 0)
+        return 0;
+    if (need == 0)
+        need = 1;
+    for (int i = 0; i < CHRDEV_SUMMARY_BUCKETS; i++) {
+        acc += d->hist[i];
+        if (acc >= need) {
+            double v = bucket_mbps(i);
+            return (v < d->peak_mbps ? v : d->peak_mbps) / 1000.0;
+        }
+    }
+    return d->peak_mbps / 1000.0;
+}
+
+static void print_dir(const char *time_buf, const char *name, const char *dir,
+                      const struct chrdev_summary_dir *d, uint32_t samples) {
+    char top[512];
+    int off = 0;
+    for (int i = 0; i < CHRDEV_SUMMARY_TOPK && d->top[i].mbps && off < (int)sizeof(top); i++)
+        off += snprintf(top + off, sizeof(top) - off, "  %u：%.2f", d->top[i].offset_us,
+                        d->top[i].mbps / 1000.0);
+    printf("[%s] %s %s - 峰值 %.2f 均值 %.2f p50 %.2f p99 %.2f Gbps, %.2f MB, TOP%d（微秒：Gbps）:%s\n",
+           time_buf, name, dir, d->peak_mbps / 1000.0, d->mean_mbps / 1000.0,
+           percentile_gbps(d, samples, 0.5), percentile_gbps(d, samples, 0.99),
+           d->bytes / 1e6, CHRDEV_SUMMARY_TOPK, off ? top : " 无");
+}
+
+static void print_summary(const struct chrdev_summary *s, uint64_t *expect_seq) {
+    char time_buf[32];
+    time_t now = time(NULL);
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    if (s->seq != *expect_seq)
+        printf("[%s] 跳过 %llu 个窗口（读取落后，内核累计丢弃 %llu）\n", time_buf,
+               (unsigned long long)(s->seq - *expect_seq), (unsigned long long)s->lost);
+    *expect_seq = s->seq + 1;
+    printf("[%s] 窗口 #%llu（%.0f 毫秒，周期 %u 纳秒，错过 %u 次，最慢一轮查询 %.1f 微秒）\n", time_buf,
+           (unsigned long long)s->seq, (s->end_ns - s->start_ns) / 1e6, s->period_ns, s->missed,
+           s->max_read_ns / 1e3);
+    for (uint32_t i = 0; i < s->nr_targets; i++) {
+        const struct chrdev_summary_target *t = &s->targets[i];
+        print_dir(time_buf, target_name[i], "RX", &t->rx, t->samples);
+        print_dir(time_buf, target_name[i], "TX", &t->tx, t->samples);
+        if (t->errors)
+            printf("[%s] %s 查询失败 %u 次\n", time_buf, target_name[i], t->errors);
+    }
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    printf("用法: %s [-P 设备文件] [-p 周期ns] [-w 窗口ms] 目标[,目标...]\n", prog);
+    printf("  目标：[domain:]bus:slot.func[@端口][/vfN或/vfN-M]（VF范围展开为每个VF一个目标）\n");
+    printf("  -P：默认%s\n", CHRDEV_PATH);
+    printf("  -p：内核采样周期（默认%d纳秒，最小%d）\n", DEFAULT_PERIOD_NS, CHRDEV_RING_MIN_PERIOD);
+    printf("  -w：窗口长度（默认%d毫秒），每个窗口打印一次峰值/均值/分位数/TOP\n", DEFAULT_WINDOW_MS);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = CHRDEV_PATH;
+    struct chrdev_summary_config cfg = { .period_ns = DEFAULT_PERIOD_NS, .window_ms = DEFAULT_WINDOW_MS };
+    int opt;
+    while ((opt = getopt(argc, argv, "P:p:w:h")) != -1) {
+        switch (opt) {
+        case 'P':
+            path = optarg;
+            break;
+        case 'p':
+            cfg.period_ns = strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            cfg.window_ms = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    // 1. 解析并绑定目标
+    struct chrdev_target_set set = { 0 };
+    char *list = strdup(argv[optind]);
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        struct chrdev_target t;
+        int count = rtbw_parse_target(tok, &t);
+        if (count < 0) {
+            fprintf(stderr, "bdf pattern error: %s\n", tok);
+            exit(1);
+        }
+        if (set.nr + count > CHRDEV_MAX_TARGETS) {
+            fprintf(stderr, "too many targets (max %d)\n", CHRDEV_MAX_TARGETS);
+            exit(1);
+        }
+        for (int k = 0; k < count; k++, set.nr++) {
+            set.targets[set.nr] = t;
+            if (t.vport) {
+                set.targets[set.nr].vport += k;
+                snprintf(target_name[set.nr], sizeof(target_name[0]), "%04x:%02x:%02x.%x/%d/vf%d",
+                         t.domain, t.bus, t.slot, t.func, t.port, set.targets[set.nr].vport - 1);
+            } else {
+                snprintf(target_name[set.nr], sizeof(target_name[0]), "%04x:%02x:%02x.%x/%d",
+                         t.domain, t.bus, t.slot, t.func, t.port);
+            }
+        }
+    }
+    free(list);
+
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror("open device failed");
+        exit(EXIT_FAILURE);
+    }
+    if (ioctl(fd, CHRDEV_IOCTL_BIND_TARGETS, &set) < 0) {
+        perror("ioctl bind targets failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // 2. 启动内核窗口统计
+    if (ioctl(fd, CHRDEV_IOCTL_SUMMARY_START, &cfg) < 0) {
+        perror("ioctl summary start failed");
+        exit(EXIT_FAILURE);
+    }
+    if (setpriority(PRIO_PROCESS, 0, AGENT_NICE) < 0)
+        perror("setpriority failed");
+    printf("内核窗口统计：%u个目标，采样周期 %u 纳秒，窗口 %u 毫秒\n", set.nr, cfg.period_ns, cfg.window_ms);
+    fflush(stdout);
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // 3. 每个窗口唤醒一次，读取所有已完成的窗口
+    size_t rec_size = sizeof(struct chrdev_summary) + set.nr * sizeof(struct chrdev_summary_target);
+    size_t buf_size = rec_size * CHRDEV_SUMMARY_SLOTS;
+    char *buf = malloc(buf_size);
+    if (!buf) {
+        perror("alloc summary buffer failed");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t expect_seq = 0;
+    int stopped = 0;
+    for (;;) {
+        if (stop_requested && !stopped) {
+            // 停止后内核丢弃未结束的窗口，读完已完成的窗口后read返回0
+            if (ioctl(fd, CHRDEV_IOCTL_SUMMARY_STOP) < 0)
+                perror("ioctl summary stop failed");
+            stopped = 1;
+        }
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (!stopped && poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll failed");
+            break;
+        }
+        ssize_t n = read(fd, buf, buf_size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("read summary failed");
+            break;
+        }
+        if (n == 0)
+            break;
+        for (ssize_t off = 0; off + (ssize_t)rec_size <= n; off += rec_size) {
+            const struct chrdev_summary *s = (const void *)(buf + off);
+            if (s->magic != CHRDEV_SUMMARY_MAGIC || s->version != CHRDEV_SUMMARY_VERSION || s->size != rec_size) {
+                fprintf(stderr, "summary版本不匹配 (magic=%#x version=%u size=%u)\n",
+                        s->magic, s->version, s->size);
+                exit(EXIT_FAILURE);
+            }
+            print_summary(s, &expect_seq);
+        }
+    }
+    free(buf);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,309 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "chrdev_ioctl_common.h"  // 包含共用头文件
+#include "rtbw_target.h"
+#include "rtbw_engine.h"
+
+// ioctl后端：通过/dev/chrdev_ioctl_dev批量查询绑定目标的vport计数器
+// ring_period_ns非0时改为内核线程采样，采样线程只把共享内存环中的记录转发到引擎队列；
+// ring_depth > 1时内核以异步流水线查询（见chrdev_ioctl_common.h），每个打印周期报告固件命令延迟
+// 批量查询的采样时刻和时间区间取自内核（紧贴固件命令）；hw_clock时改用网卡内部时钟计时：
+// 每个目标以第一次采样为锚点，把设备时钟的增量按频率换算成TSC周期，采样间隔不受主机侧时间戳抖动影响
+
+#define CHRDEV_PATH "/dev/chrdev_ioctl_dev"
+#define RING_SLOTS (1 << 20)       // 共享内存采样环槽位数上限（不超过引擎队列）
+#define RING_IDLE_US 100           // 内核环为空时的休眠时间
+#define LATENCY_PROBES 1000
+
+_Static_assert(RTBW_MAX_TARGETS == CHRDEV_MAX_TARGETS, "目标数上限必须与内核一致");
+
+typedef struct {
+    int fd;
+    uint32_t nr;
+    struct chrdev_batch batch;                  // 批量查询结果
+    struct chrdev_target targets[CHRDEV_MAX_TARGETS];
+    const struct chrdev_ring_header *ring_hdr;  // 内核环头（环模式），丢失计数和命令统计
+    struct chrdev_ring_header last;             // 上次报告时的命令统计（报告线程）
+    int hw_clock;
+    uint64_t hw0[CHRDEV_MAX_TARGETS], hw_tsc0[CHRDEV_MAX_TARGETS];  // 设备时钟锚点（hw0为0表示未建立）
+    double hw_ratio[CHRDEV_MAX_TARGETS];        // 每个设备时钟tick的TSC周期数
+} ioctl_ctx;
+
+// 设备时钟换算到TSC时间轴
+static inline uint64_t ioctl_hw_tsc(ioctl_ctx *c, uint32_t i, const struct chrdev_counter *k) {
+    if (__builtin_expect(!c->hw0[i], 0)) {
+        c->hw0[i] = k->hw_clock;
+        c->hw_tsc0[i] = k->tsc;
+        c->hw_ratio[i] = rtbw_clock_hz() / (k->hw_khz * 1e3);
+    }
+    return c->hw_tsc0[i] + (uint64_t)((int64_t)(k->hw_clock - c->hw0[i]) * c->hw_ratio[i]);
+}
+
+// 一次ioctl读取所有绑定目标的计数器；ioctl本身失败时本轮所有目标记为读取失败（计入统计，不退出）
+static inline void ioctl_read(void *arg, rtbw_sample *out) {
+    ioctl_ctx *c = arg;
+    if (__builtin_expect(ioctl(c->fd, CHRDEV_IOCTL_GET_BATCH, &c->batch) < 0, 0)) {
+        int err = -errno;
+        for (uint32_t i = 0; i < c->nr; i++)
+            out[i].err = err;
+        return;
+    }
+    for (uint32_t i = 0; i < c->nr; i++) {
+        const struct chrdev_counter *k = &c->batch.counters[i];
+        out[i].tx = k->tx;
+        out[i].rx = k->rx;
+        out[i].err = k->err;
+        out[i].tsc = k->tsc;
+        out[i].read_cycles = k->bracket_cycles;
+        if (c->hw_clock && k->hw_clock && k->hw_khz)
+            out[i].tsc = ioctl_hw_tsc(c, i, k);
+    }
+}
+
+// 测量ioctl的平均耗时（TSC周期数），ioctl失败返回-1
+static double measure_latency_cycles(ioctl_ctx *c, int batched) {
+    struct chrdev_ioctl_out_args user_data = {
+        .bus = c->targets[0].bus, .slot = c->targets[0].slot, .func = c->targets[0].func,
+    };
+    uint64_t t1 = rtbw_rdtscp();
+    for (int i = 0; i < LATENCY_PROBES; i++) {
+        int ret = batched ? ioctl(c->fd, CHRDEV_IOCTL_GET_BATCH, &c->batch) :
+                            ioctl(c->fd, CHRDEV_IOCTL_GET_TWO_INT64, &user_data);
+        if (ret < 0) {
+            perror(batched ? "ioctl batch failed" : "ioctl failed");
+            return -1;
+        }
+    }
+    return (double)(rtbw_rdtscp() - t1) / LATENCY_PROBES;
+}
+
+static int ioctl_open(rtbw_engine *e, const char *targets) {
+    ioctl_ctx *c = calloc(1, sizeof(*c));
+    if (!c) {
+        perror("alloc ioctl backend failed");
+        return -1;
+    }
+    c->fd = -1;
+    e->ctx = c;
+
+    char *list = strdup(targets);
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        struct chrdev_target t;
+        int count = rtbw_parse_target(tok, &t);
+        if (count < 0) {
+            fprintf(stderr, "bdf pattern error: %s\n", tok);
+            free(list);
+            return -1;
+        }
+        if (e->nr_targets + count > CHRDEV_MAX_TARGETS) {
+            fprintf(stderr, "too many targets (max %d)\n", CHRDEV_MAX_TARGETS);
+            free(list);
+            return -1;
+        }
+        // VF范围展开为每个VF一个目标，由内核在一次GET_BATCH中依次查询
+        for (int k = 0; k < count; k++) {
+            int n = e->nr_targets++;
+            c->targets[n] = t;
+            if (t.vport)
+                c->targets[n].vport += k;
+            e->target_vport[n] = c->targets[n].vport;
+            if (t.vport)
+                snprintf(e->target_name[n], RTBW_NAME_LEN, "%04x:%02x:%02x.%x/%d/vf%d",
+                         t.domain, t.bus, t.slot, t.func, t.port, c->targets[n].vport - 1);
+            else
+                snprintf(e->target_name[n], RTBW_NAME_LEN, "%04x:%02x:%02x.%x/%d",
+                         t.domain, t.bus, t.slot, t.func, t.port);
+        }
+    }
+    free(list);
+    c->nr = e->nr_targets;
+    snprintf(e->dev_sysfs, sizeof(e->dev_sysfs), "/sys/bus/pci/devices/%04x:%02x:%02x.%x",
+             c->targets[0].domain, c->targets[0].bus, c->targets[0].slot, c->targets[0].func);
+
+    const char *path = e->path ? e->path : CHRDEV_PATH;
+    c->fd = open(path, O_RDWR);
+    if (c->fd < 0) {
+        perror("open device failed");
+        return -1;
+    }
+    printf("open device %s success (fd=%d)\n", path, c->fd);
+
+    // 测量绑定前（每次ioctl做PCI查找）的延迟，然后绑定目标，之后的ioctl只发固件命令
+    double unbound_cycles = (e->nr_targets == 1 && c->targets[0].domain == 0 && !c->targets[0].vport) ?
+                            measure_latency_cycles(c, 0) : 0;
+    if (unbound_cycles < 0)
+        return -1;
+    struct chrdev_target_set set = { .nr = e->nr_targets };
+    memcpy(set.targets, c->targets, e->nr_targets * sizeof(c->targets[0]));
+    if (ioctl(c->fd, CHRDEV_IOCTL_BIND_TARGETS, &set) < 0) {
+        perror("ioctl bind targets failed");
+        return -1;
+    }
+    if (e->coalesce_ns && ioctl(c->fd, CHRDEV_IOCTL_SET_MAX_AGE, &e->coalesce_ns) < 0) {
+        perror("ioctl set max age failed");
+        return -1;
+    }
+    if (e->hw_clock) {
+        __u32 opts = CHRDEV_OPT_HW_CLOCK;
+        if (ioctl(c->fd, CHRDEV_IOCTL_SET_OPTIONS, &opts) < 0) {
+            perror("ioctl set options failed");
+            return -1;
+        }
+        c->hw_clock = 1;
+    }
+    double bound_cycles = measure_latency_cycles(c, 1);
+    if (bound_cycles < 0)
+        return -1;
+    double ghz = rtbw_clock_hz() / 1e9;
+    if (unbound_cycles > 0)
+        printf("ioctl平均延迟：绑定前 %.0f 纳秒，绑定后 %.0f 纳秒\n",
+               unbound_cycles / ghz, bound_cycles / ghz);
+    else
+        printf("ioctl平均延迟：%.0f 纳秒（%d个目标）\n", bound_cycles / ghz, e->nr_targets);
+    return 0;
+}
+
+RTBW_DEFINE_SAMPLER(ioctl_sampler, ioctl_read)
+
+// 共享内存采样环模式：内核线程按周期采样，这里只把记录搬到引擎队列，无syscall
+// 每次搬运内核环积压和引擎队列空闲槽位中较少的部分，引擎队列满时暂停消费，内核环满后由内核记入overrun；
+// 内核环不大于引擎队列，积压总能在报告线程腾出空间后被搬走
+// 配置、映射或启动内核环失败时向引擎报告启动失败并退出线程（rtbw_engine_start返回-1）
+static void *ioctl_ring_forward(rtbw_engine *e) {
+    ioctl_ctx *c = e->ctx;
+    uint32_t nr_slots = e->q.mask + 1 < RING_SLOTS ? e->q.mask + 1 : RING_SLOTS;
+    struct chrdev_ring_config cfg = {
+        .period_ns = e->ring_period_ns, .nr_slots = nr_slots, .depth = e->ring_depth,
+    };
+    if (ioctl(c->fd, CHRDEV_IOCTL_RING_CONFIG, &cfg) < 0) {
+        perror("ioctl ring config failed");
+        rtbw_engine_ready(e, -1);
+        return NULL;
+    }
+    size_t map_size = CHRDEV_RING_HDR_SIZE + (size_t)nr_slots * sizeof(struct chrdev_ring_sample);
+    map_size = (map_size + 4095) & ~(size_t)4095;
+    void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap ring failed");
+        rtbw_engine_ready(e, -1);
+        return NULL;
+    }
+    struct chrdev_ring_header *hdr = map;
+    const struct chrdev_ring_sample *ring = (const void *)((char *)map + CHRDEV_RING_HDR_SIZE);
+    if (hdr->magic != CHRDEV_RING_MAGIC || hdr->version != CHRDEV_RING_VERSION) {
+        fprintf(stderr, "ring版本不匹配 (magic=%#x version=%u)\n", hdr->magic, hdr->version);
+        goto fail;
+    }
+    uint64_t mask = hdr->nr_slots - 1;
+    __atomic_store_n(&c->ring_hdr, hdr, __ATOMIC_RELEASE);
+    if (ioctl(c->fd, CHRDEV_IOCTL_RING_START) < 0) {
+        perror("ioctl ring start failed");
+        __atomic_store_n(&c->ring_hdr, NULL, __ATOMIC_RELEASE);
+        goto fail;
+    }
+    rtbw_engine_ready(e, 0);
+
+    struct timespec idle = { .tv_nsec = RING_IDLE_US * 1000 };
+    uint64_t tail = __atomic_load_n(&hdr->tail, __ATOMIC_RELAXED);
+    while (!__atomic_load_n(&e->stop, __ATOMIC_RELAXED)) {
+        uint64_t head = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+        uint64_t n = head - tail, space, pos;
+        if (n && n > (space = rtbw_spsc_space(&e->q)))
+            n = space;
+        if (n == 0 || rtbw_spsc_reserve(&e->q, n, &pos) < 0) {
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        for (uint64_t i = 0; i < n; i++, tail++) {
+            const struct chrdev_ring_sample *k = &ring[tail & mask];
+            rtbw_sample *r = rtbw_spsc_slot(&e->q, pos + i);
+            r->tsc = k->tsc;
+            r->tx = k->tx;
+            r->rx = k->rx;
+            r->read_cycles = k->read_cycles;
+            r->target = k->target;
+            r->err = 0;
+        }
+        rtbw_spsc_publish(&e->q, n);
+        // 归还已消费的槽位
+        __atomic_store_n(&hdr->tail, tail, __ATOMIC_RELEASE);
+    }
+    if (ioctl(c->fd, CHRDEV_IOCTL_RING_STOP) < 0)
+        perror("ioctl ring stop failed");
+    __atomic_store_n(&c->ring_hdr, NULL, __ATOMIC_RELEASE);
+    munmap(map, map_size);
+    return NULL;
+fail:
+    munmap(map, map_size);
+    rtbw_engine_ready(e, -1);
+    return NULL;
+}
+
+static void *ioctl_thread(void *arg) {
+    rtbw_engine *e = arg;
+    if (e->ring_period_ns)
+        return ioctl_ring_forward(e);
+    return ioctl_sampler(arg);
+}
+
+static uint64_t ioctl_lost(rtbw_engine *e) {
+    ioctl_ctx *c = e->ctx;
+    const struct chrdev_ring_header *hdr = __atomic_load_n(&c->ring_hdr, __ATOMIC_ACQUIRE);
+    return hdr ? __atomic_load_n(&hdr->overrun, __ATOMIC_RELAXED) : 0;
+}
+
+// 本打印周期内的固件命令数、失败数、平均/最大延迟和延迟分布（环模式）
+// 延迟为提交到完成，异步流水线中包含在固件中的排队时间，明显大于单个命令的耗时说明命令在争用
+static void ioctl_report(rtbw_engine *e, const char *time_buf) {
+    ioctl_ctx *c = e->ctx;
+    const struct chrdev_ring_header *hdr = __atomic_load_n(&c->ring_hdr, __ATOMIC_ACQUIRE);
+    if (!hdr)
+        return;
+    struct chrdev_ring_header now = *hdr, *last = &c->last;
+    uint64_t cmds = now.cmds - last->cmds;
+    double us_per_cycle = 1e6 / rtbw_clock_hz();
+    char hist[512];
+    int off = 0;
+    for (int k = 0; k < CHRDEV_RING_LAT_BUCKETS && off < (int)sizeof(hist); k++) {
+        uint64_t n = now.lat_hist[k] - last->lat_hist[k];
+        if (!n)
+            continue;
+        if (k == 0)
+            off += snprintf(hist + off, sizeof(hist) - off, " <1us:%lu", n);
+        else if (k == CHRDEV_RING_LAT_BUCKETS - 1)
+            off += snprintf(hist + off, sizeof(hist) - off, " >=%luus:%lu", 1UL << (k - 1), n);
+        else
+            off += snprintf(hist + off, sizeof(hist) - off, " %lu-%luus:%lu", 1UL << (k - 1), 1UL << k, n);
+    }
+    printf("[%s] 固件命令（在途上限 %u，最多 %u）- %lu 次，失败 %lu，平均延迟 %.1f us，累计最大 %.1f us，分布:%s\n",
+           time_buf, now.depth, now.inflight_max, cmds, (uint64_t)(now.cmd_errors - last->cmd_errors),
+           cmds ? (now.lat_sum - last->lat_sum) * us_per_cycle / cmds : 0.0, now.lat_max * us_per_cycle,
+           off ? hist : " 无");
+    *last = now;
+}
+
+static void ioctl_close(rtbw_engine *e) {
+    ioctl_ctx *c = e->ctx;
+    if (c->fd >= 0)
+        close(c->fd);
+    free(c);
+    e->ctx = NULL;
+}
+
+const rtbw_backend rtbw_backend_ioctl = {
+    .name = "ioctl",
+    .target_help = "[domain:]bus:slot.func[@端口][/vfN或/vfN-M]",
+    .open = ioctl_open,
+    .sampler = ioctl_thread,
+    .lost = ioctl_lost,
+    .report = ioctl_report,
+    .close = ioctl_close,
+};
@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "rtbw_engine.h"
+#include "rtbw_trace.h"
+
+// 合成/回放后端：不需要网卡和OFED模块，按流量模型或文件生成计数器
+// 计数器是当前TSC时刻的闭式函数（回放为线性插值），读一次只有几十纳秒，
+// 可以用来压测整条采样→统计→报告流水线
+// 目标格式（逗号分隔，每个目标一个模型，RX/TX使用同一模型）：
+//   const:<Gbps>                              恒定速率
+//   burst:<峰值Gbps>:<周期us>:<占空比%>[:<基线Gbps>]  方波突发
+//   noise:<均值Gbps>:<幅度Gbps>                每次读取在[均值-幅度, 均值+幅度]内均匀随机
+//   replay:<文件>                              每行"<纳秒> <TX字节> <RX字节>"（累计值），循环回放
+//   trace:<文件>[@目标下标]                     回放rt_bw -w录制的二进制trace中的一个目标
+
+#define GBPS_TO_WORDS(g) ((g) * 1e9 / 8 / 4)   // 计数器单位为4字节
+
+typedef enum {
+    SYNTH_CONST,
+    SYNTH_BURST,
+    SYNTH_NOISE,
+    SYNTH_REPLAY,
+} synth_model;
+
+typedef struct {
+    synth_model model;
+    double rate;            // 速率（4字节/秒）：const的速率、burst的峰值、noise的均值
+    double base;            // burst的基线速率
+    double amp;             // noise的幅度
+    double period;          // burst周期（秒）
+    double on;              // burst每个周期的高电平时长（秒）
+    // noise状态
+    uint64_t rng;
+    double acc_tx, acc_rx;
+    double last_t;
+    // replay数据（单位已换算为4字节）
+    size_t n, pos;
+    double *t;              // 相对首行的时间（秒）
+    double *tx, *rx;
+} synth_target;
+
+typedef struct {
+    int nr;
+    uint64_t start_tsc;
+    double inv_hz;
+    synth_target t[RTBW_MAX_TARGETS];
+} synth_ctx;
+
+static inline double synth_uniform(uint64_t *s) {
+    // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return (double)((*s * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// 回放：elapsed秒时的累计值，超过文件时长后循环并累加整圈的增量，保持单调
+static inline void synth_replay(synth_target *g, double elapsed, double *tx, double *rx) {
+    double dur = g->t[g->n - 1];
+    double loops = floor(elapsed / dur);
+    double tt = elapsed - loops * dur;
+    if (tt < g->t[g->pos])
+        g->pos = 0;
+    while (g->pos + 2 < g->n && g->t[g->pos + 1] <= tt)
+        g->pos++;
+    size_t p = g->pos;
+    double f = (tt - g->t[p]) / (g->t[p + 1] - g->t[p]);
+    *tx = loops * g->tx[g->n - 1] + g->tx[p] + f * (g->tx[p + 1] - g->tx[p]);
+    *rx = loops * g->rx[g->n - 1] + g->rx[p] + f * (g->rx[p + 1] - g->rx[p]);
+}
+
+static inline void synth_read(void *arg, rtbw_sample *out) {
+    synth_ctx *c = arg;
+    double elapsed = (double)(rtbw_rdtsc() - c->start_tsc) * c->inv_hz;
+    for (int i = 0; i < c->nr; i++) {
+        synth_target *g = &c->t[i];
+        double tx, rx;
+        switch (g->model) {
+        case SYNTH_CONST:
+            tx = rx = g->rate * elapsed;
+            break;
+        case SYNTH_BURST: {
+            double cycles = floor(elapsed / g->period);
+            double in = elapsed - cycles * g->period;
+            double high = cycles * g->on + (in < g->on ? in : g->on);
+            tx = rx = g->base * elapsed + (g->rate - g->base) * high;
+            break;
+        }
+        case SYNTH_NOISE: {
+            double dt = elapsed - g->last_t;
+            g->last_t = elapsed;
+            g->acc_tx += fmax(0, g->rate + g->amp * (2 * synth_uniform(&g->rng) - 1)) * dt;
+            g->acc_rx += fmax(0, g->rate + g->amp * (2 * synth_uniform(&g->rng) - 1)) * dt;
+            tx = g->acc_tx;
+            rx = g->acc_rx;
+            break;
+        }
+        default:
+            synth_replay(g, elapsed, &tx, &rx);
+            break;
+        }
+        out[i].tx = (uint64_t)tx;
+        out[i].rx = (uint64_t)rx;
+        out[i].err = 0;
+    }
+}
+
+// 读取回放文件，时间和计数都换算成相对首行的值
+static int synth_load(synth_target *g, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror("open replay file failed");
+        return -1;
+    }
+    size_t cap = 1024;
+    g->t = malloc(cap * sizeof(double));
+    g->tx = malloc(cap * sizeof(double));
+    g->rx = malloc(cap * sizeof(double));
+    unsigned long long ns, tx, rx, ns0 = 0, tx0 = 0, rx0 = 0, prev = 0;
+    char line[256];
+    while (g->t && g->tx && g->rx && fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%llu %llu %llu", &ns, &tx, &rx) != 3)
+            continue;
+        if (g->n == 0) {
+            ns0 = ns;
+            tx0 = tx;
+            rx0 = rx;
+        } else if (ns <= prev) {
+            fprintf(stderr, "%s: 时间必须递增：%s", path, line);
+            fclose(f);
+            return -1;
+        }
+        if (g->n == cap) {
+            cap *= 2;
+            g->t = realloc(g->t, cap * sizeof(double));
+            g->tx = realloc(g->tx, cap * sizeof(double));
+            g->rx = realloc(g->rx, cap * sizeof(double));
+            if (!g->t || !g->tx || !g->rx)
+                break;
+        }
+        prev = ns;
+        g->t[g->n] = (ns - ns0) / 1e9;
+        g->tx[g->n] = (tx >= tx0 ? tx - tx0 : 0) / 4.0;
+        g->rx[g->n] = (rx >= rx0 ? rx - rx0 : 0) / 4.0;
+        g->n++;
+    }
+    fclose(f);
+    if (!g->t || !g->tx || !g->rx) {
+        perror("alloc replay buffer failed");
+        return -1;
+    }
+    if (g->n < 2) {
+        fprintf(stderr, "%s: 至少需要两行有效数据\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// 读取二进制trace中一个目标的记录（跳过读取失败的记录），时间按文件头中的TSC频率换算
+static int synth_load_trace(synth_target *g, char *arg) {
+    uint32_t target = 0;
+    char *at = strrchr(arg, '@');
+    if (at) {
+        *at = '\0';
+        target = atoi(at + 1);
+    }
+    rtbw_trace_reader *r = rtbw_trace_open(arg);
+    if (!r)
+        return -1;
+    const struct rtbw_trace_header *h = rtbw_trace_header(r);
+    if (target >= h->nr_targets) {
+        fprintf(stderr, "%s: 只有%u个目标\n", arg, h->nr_targets);
+        rtbw_trace_free(r);
+        return -1;
+    }
+    size_t cap = 1024;
+    g->t = malloc(cap * sizeof(double));
+    g->tx = malloc(cap * sizeof(double));
+    g->rx = malloc(cap * sizeof(double));
+    rtbw_sample s, first = { 0 };
+    uint64_t prev_tsc = 0;
+    int ret = 0;
+    while (g->t && g->tx && g->rx && (ret = rtbw_trace_next(r, &s)) > 0) {
+        if (s.target != target || s.err)
+            continue;
+        if (g->n == 0)
+            first = s;
+        else if (s.tsc <= prev_tsc)
+            continue;
+        if (g->n == cap) {
+            cap *= 2;
+            g->t = realloc(g->t, cap * sizeof(double));
+            g->tx = realloc(g->tx, cap * sizeof(double));
+            g->rx = realloc(g->rx, cap * sizeof(double));
+            if (!g->t || !g->tx || !g->rx)
+                break;
+        }
+        prev_tsc = s.tsc;
+        g->t[g->n] = (double)(s.tsc - first.tsc) / h->tsc_hz;
+        g->tx[g->n] = s.tx >= first.tx ? s.tx - first.tx : 0;
+        g->rx[g->n] = s.rx >= first.rx ? s.rx - first.rx : 0;
+        g->n++;
+    }
+    rtbw_trace_free(r);
+    if (!g->t || !g->tx || !g->rx) {
+        perror("alloc replay buffer failed");
+        return -1;
+    }
+    if (ret < 0)
+        fprintf(stderr, "%s: 文件损坏，只回放前%zu条记录\n", arg, g->n);
+    if (g->n < 2) {
+        fprintf(stderr, "%s: 目标%u至少需要两条有效记录\n", arg, target);
+        return -1;
+    }
+    return 0;
+}
+
+static int synth_parse(synth_target *g, char *spec, uint64_t seed) {
+    char *arg = strchr(spec, ':');
+    if (!arg)
+        return -1;
+    *arg++ = '\0';
+    memset(g, 0, sizeof(*g));
+    g->rng = seed | 1;
+    if (!strcmp(spec, "replay")) {
+        g->model = SYNTH_REPLAY;
+        return synth_load(g, arg);
+    }
+    if (!strcmp(spec, "trace")) {
+        g->model = SYNTH_REPLAY;
+        return synth_load_trace(g, arg);
+    }
+    double v[4] = { 0 };
+    int n = sscanf(arg, "%lf:%lf:%lf:%lf", &v[0], &v[1], &v[2], &v[3]);
+    if (!strcmp(spec, "const") && n == 1 && v[0] >= 0) {
+        g->model = SYNTH_CONST;
+        g->rate = GBPS_TO_WORDS(v[0]);
+    } else if (!strcmp(spec, "burst") && n >= 3 && v[1] > 0 && v[2] >= 0 && v[2] <= 100) {
+        g->model = SYNTH_BURST;
+        g->rate = GBPS_TO_WORDS(v[0]);
+        g->period = v[1] / 1e6;
+        g->on = g->period * v[2] / 100;
+        g->base = GBPS_TO_WORDS(v[3]);
+    } else if (!strcmp(spec, "noise") && n == 2 && v[0] >= 0 && v[1] >= 0) {
+        g->model = SYNTH_NOISE;
+        g->rate = GBPS_TO_WORDS(v[0]);
+        g->amp = GBPS_TO_WORDS(v[1]);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int synth_open(rtbw_engine *e, const char *targets) {
+    synth_ctx *c = calloc(1, sizeof(*c));
+    if (!c) {
+        perror("alloc synth backend failed");
+        return -1;
+    }
+    e->ctx = c;
+
+    char *list = strdup(targets);
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (c->nr == RTBW_MAX_TARGETS) {
+            fprintf(stderr, "too many targets (max %d)\n", RTBW_MAX_TARGETS);
+            free(list);
+            return -1;
+        }
+        snprintf(e->target_name[c->nr], RTBW_NAME_LEN, "%s", tok);
+        if (synth_parse(&c->t[c->nr], tok, rtbw_rdtsc() + c->nr) < 0) {
+            fprintf(stderr, "流量模型错误：%s\n", e->target_name[c->nr]);
+            free(list);
+            return -1;
+        }
+        c->nr++;
+    }
+    free(list);
+    e->nr_targets = c->nr;
+    c->inv_hz = 1.0 / rtbw_clock_hz();
+    c->start_tsc = rtbw_rdtsc();
+    return 0;
+}
+
+RTBW_DEFINE_SAMPLER(synth_sampler, synth_read)
+
+static void synth_close(rtbw_engine *e) {
+    synth_ctx *c = e->ctx;
+    for (int i = 0; i < c->nr; i++) {
+        free(c->t[i].t);
+        free(c->t[i].tx);
+        free(c->t[i].rx);
+    }
+    free(c);
+    e->ctx = NULL;
+}
+
+const rtbw_backend rtbw_backend_synth = {
+    .name = "synth",
+    .target_help = "const:Gbps | burst:峰值Gbps:周期us:占空比%[:基线Gbps] | noise:均值Gbps:幅度Gbps | replay:文件 | trace:文件[@目标]",
+    .default_targets = "burst:100:1000:10",
+    .open = synth_open,
+    .sampler = synth_sampler,
+    .close = synth_close,
+};
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "rtbw_engine.h"
+
+// sysfs后端：读取/sys/class/infiniband/<设备>/ports/<端口>/counters/port_rcv_data和port_xmit_data
+// 不需要chrdev_with_ioctl模块
+// 1. 所有目标的接收/发送计数器文件预先打开，并注册到io_uring（固定文件 + 固定缓冲区）
+// 2. 每次采样把全部读请求作为一批提交，同一次io_uring_enter等待全部完成，
+//    无论监视多少个计数器，每次采样约一次进入内核
+// 3. 解析用定宽十进制解析（8位一组的SWAR乘法合并），不逐位循环
+// 打开时实测io_uring与逐个pread的每轮耗时并选择较快的一种；
+// io_uring不可用（内核过旧或被io_uring_disabled禁止）时直接使用pread
+
+#define DEFAULT_RDMA_DEV "mlx5_0"  // 默认RDMA设备名
+#define SYSFS_ROOT "/sys/class/infiniband"
+#define RDMA_PORT 1                // 默认RDMA端口号（设备名@端口 可覆盖）
+#define SYSFS_BUF_SIZE 32          // 每个计数器的读缓冲区（最多20位十进制 + 换行）
+#define SYSFS_MAX_FILES (RTBW_MAX_TARGETS * 2)
+#define SYSFS_PROBE_ROUNDS 64      // 启动时比较两种读取方式，每种测3组，每组的轮数
+
+typedef struct {
+    int fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *sqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_size, cq_map_size, sqes_size;
+} sysfs_uring;
+
+typedef struct {
+    int nr;
+    int fd[SYSFS_MAX_FILES];        // 预打开的计数器文件：2i为接收，2i+1为发送
+    int res[SYSFS_MAX_FILES];       // 本轮每个读请求的结果（字节数或负的errno）
+    int use_uring;
+    sysfs_uring ring;               // io_uring出错且在途请求已收回后拆除（fd为-1），改用pread
+    int uring_err;                  // io_uring出错后无法收回在途请求：不再使用缓冲区，每轮报告该错误
+    _Alignas(64) char buf[SYSFS_MAX_FILES][SYSFS_BUF_SIZE];  // 注册为固定缓冲区
+} sysfs_ctx;
+
+// 8个ASCII数字（低地址为高位）→ 数值：相邻位两两合并，三次乘法完成
+static inline uint64_t sysfs_swar8(uint64_t v) {
+    v = (v & 0x0f0f0f0f0f0f0f0fULL) * 2561 >> 8;
+    v = (v & 0x00ff00ff00ff00ffULL) * 6553601 >> 16;
+    return (v & 0x0000ffff0000ffffULL) * 42949672960001ULL >> 32;
+}
+
+// 8个字节是否全是'0'~'9'
+static inline int sysfs_swar8_digits(uint64_t v) {
+    // 高4位为3（0x30~0x3f），且加6后高4位仍为3（排除0x3a~0x3f）
+    return ((v & 0xf0f0f0f0f0f0f0f0ULL) == 0x3030303030303030ULL) &
+           (((v + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) == 0x3030303030303030ULL);
+}
+
+// 定宽十进制解析：数字右对齐到24个'0'中，按三组8位解析；格式错误返回-EINVAL
+static inline int sysfs_parse(const char *s, int len, uint64_t *out) {
+    uint64_t w[3] = { 0x3030303030303030ULL, 0x3030303030303030ULL, 0x3030303030303030ULL };
+    if (len > 0 && s[len - 1] == '\n')
+        len--;
+    if (len <= 0 || len > 20)
+        return -EINVAL;
+    memcpy((char *)w + sizeof(w) - len, s, len);
+    if (!(sysfs_swar8_digits(w[0]) & sysfs_swar8_digits(w[1]) & sysfs_swar8_digits(w[2])))
+        return -EINVAL;
+    *out = sysfs_swar8(w[0]) * 10000000000000000ULL + sysfs_swar8(w[1]) * 100000000ULL + sysfs_swar8(w[2]);
+    return 0;
+}
+
+static void sysfs_uring_free(sysfs_uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_size);
+    if (r->sq_map && r->sq_map != MAP_FAILED)
+        munmap(r->sq_map, r->sq_map_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+// 解析本轮各计数器文件的结果，写入采样记录
+static inline void sysfs_store(sysfs_ctx *c, rtbw_sample *out) {
+    for (int t = 0; t < c->nr; t++) {
+        int ret_rx = c->res[2 * t] < 0 ? c->res[2 * t] : sysfs_parse(c->buf[2 * t], c->res[2 * t], &out[t].rx);
+        int ret_tx = c->res[2 * t + 1] < 0 ? c->res[2 * t + 1] :
+                     sysfs_parse(c->buf[2 * t + 1], c->res[2 * t + 1], &out[t].tx);
+        out[t].err = ret_rx ? ret_rx : ret_tx;
+    }
+}
+
+static inline void sysfs_pread_read(void *arg, rtbw_sample *out);
+
+// io_uring_enter出错：本轮的请求不能留给下一轮（下一轮会把它们的完成计入自己，
+// 而内核仍在写同一组固定缓冲区）。未提交的SQE从提交队列撤回，已提交的等到全部完成，
+// 然后拆除io_uring，之后改用pread；等待也失败时不再读取，每轮报告错误
+static void sysfs_uring_abort(sysfs_ctx *c, unsigned unsubmitted, unsigned inflight, unsigned head, int err) {
+    sysfs_uring *r = &c->ring;
+    __atomic_store_n(r->sq_tail, *r->sq_tail - unsubmitted, __ATOMIC_RELEASE);
+    while (inflight) {
+        int ret = syscall(__NR_io_uring_enter, r->fd, 0, inflight, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            fprintf(stderr, "io_uring失败（%s），无法收回在途的读请求，停止读取sysfs\n", strerror(err));
+            c->uring_err = -err;
+            return;
+        }
+        unsigned cq_tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail && inflight; head++)
+            inflight--;
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    fprintf(stderr, "io_uring失败（%s），改用pread\n", strerror(err));
+    sysfs_uring_free(r);
+}
+
+// io_uring：提交2*nr个读请求（SQE在打开时已填好，这里只排入提交队列），等待全部完成
+static inline void sysfs_uring_read(void *arg, rtbw_sample *out) {
+    sysfs_ctx *c = arg;
+    sysfs_uring *r = &c->ring;
+    if (__builtin_expect(r->fd < 0 || c->uring_err, 0)) {
+        if (r->fd < 0) {
+            sysfs_pread_read(c, out);
+            return;
+        }
+        for (int t = 0; t < c->nr; t++)
+            out[t].err = c->uring_err;
+        return;
+    }
+    unsigned n = 2 * c->nr, tail = *r->sq_tail, mask = *r->sq_mask;
+    for (unsigned i = 0; i < n; i++)
+        r->sq_array[(tail + i) & mask] = i;
+    __atomic_store_n(r->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+    unsigned submit = n, done = 0, head = *r->cq_head;
+    while (done < n) {
+        int ret = syscall(__NR_io_uring_enter, r->fd, submit, n - done, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                continue;
+            int err = errno;
+            for (unsigned i = 0; i < n; i++)
+                c->res[i] = -err;
+            sysfs_uring_abort(c, submit, n - submit - done, head, err);
+            break;
+        }
+        submit -= ret;
+        unsigned cq_tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; head++, done++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            c->res[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    sysfs_store(c, out);
+}
+
+// 退回方式：每个计数器一次pread（从偏移0读取，避免lseek）
+static inline void sysfs_pread_read(void *arg, rtbw_sample *out) {
+    sysfs_ctx *c = arg;
+    for (int i = 0; i < 2 * c->nr; i++) {
+        ssize_t len = pread(c->fd[i], c->buf[i], SYSFS_BUF_SIZE - 1, 0);
+        c->res[i] = len < 0 ? -errno : (int)len;
+    }
+    sysfs_store(c, out);
+}
+
+// 一轮读取的平均耗时（TSC周期），取3组中最快的一组，减少被抢占的影响
+static double sysfs_probe(sysfs_ctx *c, void (*read)(void *, rtbw_sample *)) {
+    rtbw_sample buf[RTBW_MAX_TARGETS];
+    double best = 0;
+    for (int k = 0; k < 3; k++) {
+        uint64_t t = rtbw_rdtscp();
+        for (int i = 0; i < SYSFS_PROBE_ROUNDS; i++)
+            read(c, buf);
+        double cycles = (double)(rtbw_rdtscp() - t) / SYSFS_PROBE_ROUNDS;
+        if (k == 0 || cycles < best)
+            best = cycles;
+    }
+    return best;
+}
+
+// 创建io_uring并注册文件和缓冲区，预先填好每个计数器的READ_FIXED请求
+static int sysfs_uring_setup(sysfs_ctx *c) {
+    sysfs_uring *r = &c->ring;
+    unsigned n = 2 * c->nr;
+    struct io_uring_params p = { .flags = IORING_SETUP_COOP_TASKRUN };
+    r->fd = syscall(__NR_io_uring_setup, n, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));      // 5.19之前的内核不支持COOP_TASKRUN
+        r->fd = syscall(__NR_io_uring_setup, n, &p);
+    }
+    if (r->fd < 0)
+        return -1;
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_size > r->sq_map_size)
+            r->sq_map_size = r->cq_map_size;
+        r->cq_map_size = 0;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED)
+        return -1;
+    r->cq_map = r->sq_map;
+    if (r->cq_map_size) {
+        r->cq_map = mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED)
+            return -1;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        return -1;
+    r->sq_tail = (unsigned *)((char *)r->sq_map + p.sq_off.tail);
+    r->sq_mask = (unsigned *)((char *)r->sq_map + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_map + p.sq_off.array);
+    r->cq_head = (unsigned *)((char *)r->cq_map + p.cq_off.head);
+    r->cq_tail = (unsigned *)((char *)r->cq_map + p.cq_off.tail);
+    r->cq_mask = (unsigned *)((char *)r->cq_map + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_map + p.cq_off.cqes);
+
+    // 固定文件省去每次请求的fd查找和引用计数，固定缓冲区省去每次请求的页面固定
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES, c->fd, n) < 0)
+        return -1;
+    struct iovec iov = { .iov_base = c->buf, .iov_len = sizeof(c->buf) };
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+        return -1;
+
+    // 内核提交时只读取SQE，预先填好后每轮复用
+    for (unsigned i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = &r->sqes[i];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = i;
+        sqe->addr = (uintptr_t)c->buf[i];
+        sqe->len = SYSFS_BUF_SIZE - 1;
+        sqe->off = 0;
+        sqe->buf_index = 0;
+        sqe->user_data = i;
+    }
+    return 0;
+}
+
+static int sysfs_open_counter(sysfs_ctx *c, int i, const char *root, const char *dev, int port,
+                              const char *file) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/ports/%d/counters/%s", root, dev, port, file);
+    // 预打开RDMA计数器文件（仅打开一次，复用fd）
+    c->fd[i] = open(path, O_RDONLY);
+    if (c->fd[i] < 0) {
+        fprintf(stderr, "open %s failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int sysfs_open(rtbw_engine *e, const char *targets) {
+    sysfs_ctx *c = aligned_alloc(64, sizeof(*c));
+    if (!c) {
+        perror("alloc sysfs backend failed");
+        return -1;
+    }
+    memset(c, 0, sizeof(*c));
+    memset(c->fd, -1, sizeof(c->fd));
+    c->ring.fd = -1;
+    e->ctx = c;
+
+    const char *root = e->path ? e->path : SYSFS_ROOT;
+    char *list = strdup(targets);
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (c->nr == RTBW_MAX_TARGETS) {
+            fprintf(stderr, "too many targets (max %d)\n", RTBW_MAX_TARGETS);
+            free(list);
+            return -1;
+        }
+        // 设备名[@端口]
+        int port = RDMA_PORT;
+        char *at = strchr(tok, '@');
+        if (at) {
+            *at = '\0';
+            port = atoi(at + 1);
+            if (port <= 0) {
+                fprintf(stderr, "端口号错误：%s\n", at + 1);
+                free(list);
+                return -1;
+            }
+        }
+        if (sysfs_open_counter(c, 2 * c->nr, root, tok, port, "port_rcv_data") < 0 ||
+            sysfs_open_counter(c, 2 * c->nr + 1, root, tok, port, "port_xmit_data") < 0) {
+            free(list);
+            return -1;
+        }
+        snprintf(e->target_name[c->nr], RTBW_NAME_LEN, "%s/%d", tok, port);
+        if (c->nr == 0)   // device指向IB设备所在的PCI设备目录
+            snprintf(e->dev_sysfs, sizeof(e->dev_sysfs), "%s/%s/device", root, tok);
+        c->nr++;
+    }
+    free(list);
+    e->nr_targets = c->nr;
+    if (c->nr == 0)
+        return 0;
+
+    if (sysfs_uring_setup(c) < 0) {
+        fprintf(stderr, "io_uring不可用（%s），退回每个计数器一次pread\n", strerror(errno));
+        sysfs_uring_free(&c->ring);
+        return 0;
+    }
+    // 进入内核很便宜（未开启缓解措施）或文件不支持非阻塞读（如fuse，请求被转交io-wq线程）时
+    // 批量提交反而更慢，因此实测两种方式，选择较快的一种
+    double ghz = rtbw_clock_hz() / 1e9;
+    double uring_cycles = sysfs_probe(c, sysfs_uring_read);
+    double pread_cycles = sysfs_probe(c, sysfs_pread_read);
+    c->use_uring = uring_cycles <= pread_cycles;
+    printf("sysfs每轮读取延迟（%d个计数器）：io_uring %.0f 纳秒，pread %.0f 纳秒，使用%s\n",
+           2 * c->nr, uring_cycles / ghz, pread_cycles / ghz, c->use_uring ? "io_uring" : "pread");
+    if (!c->use_uring)
+        sysfs_uring_free(&c->ring);
+    return 0;
+}
+
+RTBW_DEFINE_SAMPLER(sysfs_uring_sampler, sysfs_uring_read)
+RTBW_DEFINE_SAMPLER(sysfs_pread_sampler, sysfs_pread_read)
+
+static void *sysfs_thread(void *arg) {
+    rtbw_engine *e = arg;
+    sysfs_ctx *c = e->ctx;
+    if (c->use_uring)
+        return sysfs_uring_sampler(arg);
+    return sysfs_pread_sampler(arg);
+}
+
+static void sysfs_close(rtbw_engine *e) {
+    sysfs_ctx *c = e->ctx;
+    sysfs_uring_free(&c->ring);
+    for (int i = 0; i < SYSFS_MAX_FILES; i++)
+        if (c->fd[i] >= 0)
+            close(c->fd[i]);
+    free(c);
+    e->ctx = NULL;
+}
+
+const rtbw_backend rtbw_backend_sysfs = {
+    .name = "sysfs",
+    .target_help = "设备名[@端口]（如mlx5_0@1）",
+    .default_targets = DEFAULT_RDMA_DEV,
+    .open = sysfs_open,
+    .sampler = sysfs_thread,
+    .close = sysfs_close,
+};
@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include "chrdev_ioctl_common.h"  // 包含共用头文件
+#include "rtbw_engine.h"
+#include "rtbw_stats.h"
+#include "rtbw_burst.h"
+#include "rtbw_trace.h"
+
+// 采样路径基准测试：输出JSON（标准输出），便于不同版本、不同机器之间对比
+// 1. 读计数器的每条路径：引擎各后端的端到端采样率和读延迟分布（来自记录的read_cycles），
+//    以及单独的ioctl/pread/解析调用
+// 2. 报告线程的每个阶段：出队、统计、微突发窗口、记录文件编码、周期报告
+// 没有网卡时用rtbw_standin提供的fuse/cuse替身（-S/-D指向替身），找不到的路径记入skipped
+// 延迟单位为纳秒，分位数由全部测量值排序得到（不是直方图近似）
+// 很便宜的操作按batch次一组计时，结果为组内平均，避免rdtscp本身的开销淹没被测操作
+
+#define DEFAULT_ITERS 200000
+#define DEFAULT_DURATION_S 1.0
+#define DEFAULT_PERIOD_NS 100          // 引擎采样周期：小于各后端读延迟，测饱和吞吐
+#define DEFAULT_SYSFS_ROOT "/sys/class/infiniband"
+#define DEFAULT_SYSFS_TARGETS "mlx5_0"
+#define DEFAULT_CHRDEV "/dev/chrdev_ioctl_dev"
+#define DEFAULT_IOCTL_TARGETS "00:00.0"
+#define BENCH_QUEUE_SLOTS (1 << 20)
+#define MAX_SKIPPED 16
+
+static double tsc_hz;
+static int nr_results;
+static char skipped[MAX_SKIPPED][160];
+static int nr_skipped;
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 输出一项结果：lat为n个测量值（TSC周期，每个对应batch次操作），ops为elapsed_s内完成的操作数
+static void emit(const char *name, uint64_t *lat, uint64_t n, int batch, double ops, double elapsed_s,
+                 const char *extra) {
+    if (n == 0)
+        return;
+    qsort(lat, n, sizeof(lat[0]), cmp_u64);
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++)
+        sum += lat[i];
+    double k = 1e9 / tsc_hz / batch;
+    printf("%s    {\"name\": \"%s\", \"unit\": \"ns\", \"n\": %lu, \"batch\": %d, "
+           "\"p50\": %.1f, \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f, \"ops_per_sec\": %.0f%s%s}",
+           nr_results ? ",\n" : "", name, n, batch,
+           lat[n / 2] * k, lat[(uint64_t)(n * 0.99)] * k, lat[n - 1] * k, sum / n * k,
+           elapsed_s > 0 ? ops / elapsed_s : 0.0, extra ? ", " : "", extra ? extra : "");
+    nr_results++;
+}
+
+static void skip(const char *name, const char *fmt, const char *arg) {
+    if (nr_skipped == MAX_SKIPPED)
+        return;
+    int len = snprintf(skipped[nr_skipped], sizeof(skipped[0]), "{\"name\": \"%s\", \"reason\": \"", name);
+    snprintf(skipped[nr_skipped] + len, sizeof(skipped[0]) - len, fmt, arg);
+    strncat(skipped[nr_skipped], "\"}", sizeof(skipped[0]) - strlen(skipped[nr_skipped]) - 1);
+    nr_skipped++;
+}
+
+static uint64_t *alloc_lat(uint64_t n) {
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    if (!lat) {
+        perror("alloc latency buffer failed");
+        exit(EXIT_FAILURE);
+    }
+    return lat;
+}
+
+// 计时循环：最后的参数（被测语句）执行iters/batch组，每组batch次
+#define BENCH(name, iters, batch, extra, setup, ...) do {                      \
+        uint64_t _n = (iters) / (batch), *_lat = alloc_lat(_n);                 \
+        setup;                                                                  \
+        uint64_t _t0 = rtbw_rdtscp();                                           \
+        for (uint64_t _i = 0; _i < _n; _i++) {                                  \
+            uint64_t _a = rtbw_rdtscp();                                        \
+            for (int _j = 0; _j < (batch); _j++) {                              \
+                __VA_ARGS__;                                                    \
+            }                                                                   \
+            _lat[_i] = rtbw_rdtscp() - _a;                                      \
+        }                                                                       \
+        double _s = (rtbw_rdtscp() - _t0) / tsc_hz;                             \
+        emit(name, _lat, _n, (batch), (double)_n * (batch), _s, extra);         \
+        free(_lat);                                                             \
+    } while (0)
+
+// ==================== 读计数器 ====================
+
+static void bench_clock(uint64_t iters) {
+    volatile uint64_t sink;
+    struct timespec ts;
+    BENCH("rdtscp", iters, 64, NULL, , sink = rtbw_rdtscp());
+    BENCH("clock_gettime_monotonic", iters, 16, NULL, , clock_gettime(CLOCK_MONOTONIC, &ts));
+    (void)sink;
+}
+
+static void bench_sysfs(uint64_t iters, const char *root, const char *target) {
+    char path[256], buf[32];
+    const char *at = strchr(target, '@');
+    int len_dev = (int)strcspn(target, "@,");
+    snprintf(path, sizeof(path), "%s/%.*s/ports/%d/counters/port_rcv_data",
+             root, len_dev, target, at ? atoi(at + 1) : 1);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        skip("sysfs_pread", "%s不存在（可用 rtbw_standin fuse 提供替身）", path);
+        return;
+    }
+    ssize_t len = 0;
+    volatile uint64_t sink;
+    BENCH("sysfs_pread", iters / 10, 1, NULL, , len = pread(fd, buf, sizeof(buf) - 1, 0));
+    if (len < 0)
+        len = 0;
+    buf[len] = '\0';
+    BENCH("sysfs_parse_strtoull", iters, 64, NULL, , sink = strtoull(buf, NULL, 10));
+    (void)sink;
+    close(fd);
+}
+
+static void bench_ioctl(uint64_t iters, const char *path, const char *target) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        skip("ioctl_get_two_int64", "%s无法打开（可用 rtbw_standin cuse 提供替身）", path);
+        return;
+    }
+    struct chrdev_ioctl_out_args one;
+    struct chrdev_batch batch;
+    struct chrdev_target t = { 0 };
+    uint64_t failed = 0;
+    char extra[32];
+    if (sscanf(target, "%x:%x:%x.%x", &t.domain, &t.bus, &t.slot, &t.func) != 4 &&
+        sscanf(target, "%x:%x.%x", &t.bus, &t.slot, &t.func) != 3) {
+        skip("ioctl_get_two_int64", "目标格式错误：%s", target);
+        close(fd);
+        return;
+    }
+    // 未绑定时GET_TWO_INT64每次按bus/slot/func查找设备（旧路径）
+    one = (struct chrdev_ioctl_out_args) { .bus = t.bus, .slot = t.slot, .func = t.func };
+    BENCH("ioctl_get_two_int64_lookup", iters / 10, 1, NULL, failed = 0,
+          failed += ioctl(fd, CHRDEV_IOCTL_GET_TWO_INT64, &one) < 0);
+    if (failed)
+        skip("ioctl_get_two_int64_lookup", "%s", "ioctl失败，上面的结果只是错误路径的开销");
+    if (ioctl(fd, CHRDEV_IOCTL_BIND_TARGET, &t) < 0) {
+        skip("ioctl_get_batch_1", "BIND_TARGET失败：%s", strerror(errno));
+    } else {
+        BENCH("ioctl_get_two_int64_bound", iters / 10, 1, NULL, failed = 0,
+              failed += ioctl(fd, CHRDEV_IOCTL_GET_TWO_INT64, &one) < 0);
+        BENCH("ioctl_get_batch_1", iters / 10, 1, NULL, failed = 0,
+              failed += ioctl(fd, CHRDEV_IOCTL_GET_BATCH, &batch) < 0);
+        snprintf(extra, sizeof(extra), "%lu", failed);
+        if (failed)
+            skip("ioctl_get_batch_1", "%s次GET_BATCH失败", extra);
+    }
+    close(fd);
+}
+
+// 引擎端到端：采样线程以饱和速率运行duration秒，本线程作为报告线程出队
+// ops_per_sec为每秒采样轮数，延迟分布为每轮读计数器的耗时（read_cycles）
+static void bench_engine(const rtbw_backend *b, const char *path, const char *targets,
+                         double duration, uint64_t period_ns) {
+    char name[64];
+    snprintf(name, sizeof(name), "engine_%s", b->name);
+    rtbw_engine e = { .core = -1, .idle = RTBW_IDLE_PAUSE, .period_ns = period_ns, .path = path };
+    // 后端打开时的提示和错误原因转到标准错误，不混入JSON输出
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    int ret = rtbw_engine_open(&e, b, targets);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (ret < 0) {
+        if (e.ctx)
+            b->close(&e);
+        skip(name, "后端打开失败（目标：%s）", targets ? targets : b->default_targets);
+        return;
+    }
+    if (rtbw_engine_start(&e, BENCH_QUEUE_SLOTS) < 0)
+        exit(EXIT_FAILURE);
+
+    uint64_t cap = (uint64_t)(duration * 2e7) + 1, n = 0, rounds = 0;
+    uint64_t *lat = alloc_lat(cap);
+    uint64_t t0 = rtbw_rdtscp(), end = t0 + (uint64_t)(duration * tsc_hz);
+    while (rtbw_rdtscp() < end) {
+        uint64_t avail = rtbw_spsc_available(&e.q);
+        for (uint64_t i = 0; i < avail; i++) {
+            const rtbw_sample *r = rtbw_spsc_peek(&e.q, i);
+            if (r->target != 0)
+                continue;
+            rounds++;
+            if (n < cap)
+                lat[n++] = r->read_cycles;
+        }
+        rtbw_spsc_release(&e.q, avail);
+        if (!avail)
+            sched_yield();
+    }
+    double s = (rtbw_rdtscp() - t0) / tsc_hz;
+    char extra[128];
+    snprintf(extra, sizeof(extra), "\"targets\": %d, \"dropped\": %lu, \"lost\": %lu",
+             e.nr_targets, rtbw_engine_dropped(&e), rtbw_engine_lost(&e));
+    rtbw_engine_stop(&e);
+    emit(name, lat, n, 1, rounds, s, extra);
+    free(lat);
+}
+
+// ==================== 报告线程 ====================
+
+// 生成一串带宽不断变化的采样
+static void fill_samples(rtbw_sample *s, uint64_t n) {
+    uint64_t tsc = 1000000, rx = 0, tx = 0, x = 88172645463325252ULL;
+    uint64_t period = (uint64_t)(tsc_hz / 1e6);   // 1us
+    for (uint64_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        tsc += period;
+        rx += x % 4000;
+        tx += x % 2000;
+        s[i] = (rtbw_sample) { .tsc = tsc, .tx = tx, .rx = rx, .read_cycles = 1000 + x % 64 };
+    }
+}
+
+static void bench_report(uint64_t iters) {
+    rtbw_sample *s = malloc(iters * sizeof(*s));
+    if (!s) {
+        perror("alloc samples failed");
+        exit(EXIT_FAILURE);
+    }
+    fill_samples(s, iters);
+    uint64_t k = 0;
+
+    // 出队：一次生产一次消费（同一线程，只测环本身的开销）
+    rtbw_spsc q;
+    if (rtbw_spsc_init(&q, 4096) < 0) {
+        perror("alloc queue failed");
+        exit(EXIT_FAILURE);
+    }
+    volatile uint64_t sink = 0;
+    BENCH("spsc_push_pop", iters, 64, NULL, , {
+        uint64_t pos;
+        if (rtbw_spsc_reserve(&q, 1, &pos) == 0) {
+            *rtbw_spsc_slot(&q, pos) = s[_j];
+            rtbw_spsc_publish(&q, 1);
+        }
+        if (rtbw_spsc_available(&q)) {
+            sink += rtbw_spsc_peek(&q, 0)->rx;
+            rtbw_spsc_release(&q, 1);
+        }
+    });
+    free(q.buf);
+
+    rtbw_stats st;
+    BENCH("stats_add", iters, 64, NULL, rtbw_stats_reset(&st); k = 0, {
+        k++;
+        rtbw_stats_add(&st, (double)(s[k % iters].rx & 0xffff) / 100, (double)(s[k % iters].tx & 0xffff) / 100, 1);
+    });
+
+    // 延迟换算：每个采样只追加整数差值，块满时成批换算（与上面逐个除法后记入对比）
+    BENCH("stats_push_deferred", iters, 64, NULL, rtbw_stats_reset(&st); k = 0, {
+        k++;
+        rtbw_stats_push(&st, 10000 + (s[k % iters].tsc & 0xff), s[k % iters].rx & 0xffff,
+                        s[k % iters].tx & 0xffff, tsc_hz / 1e9);
+    });
+    rtbw_stats_flush(&st, tsc_hz / 1e9);
+
+    rtbw_burst_config cfg;
+    rtbw_burst b;
+    if (rtbw_burst_parse(&cfg, "10us,100us,1ms,10ms", 10, tsc_hz) == 0)
+        BENCH("burst_add_4_scales", iters, 64, NULL, rtbw_burst_init(&b, &cfg); k = 1, {
+            rtbw_burst_add(&b, s[k - 1].tsc, s[k].tsc, (s[k].rx - s[k - 1].rx) * 4);
+            k = k + 1 == iters ? 1 : k + 1;
+        });
+
+    // 周期报告：排序TOP并计算三个分位数（开销与采样数无关）
+    rtbw_top_entry top[RTBW_TOPK];
+    BENCH("report_topk_percentiles", iters / 10, 1, NULL, , {
+        sink += rtbw_topk_sorted(&st.rx.top, top);
+        sink += rtbw_hist_percentile(&st.rx.hist, st.samples, 0.5, st.rx.max);
+        sink += rtbw_hist_percentile(&st.rx.hist, st.samples, 0.99, st.rx.max);
+        sink += rtbw_hist_percentile(&st.rx.hist, st.samples, 0.999, st.rx.max);
+    });
+
+    // 记录文件：编码 + 后台写盘（写到临时文件，结束后删除）
+    char path[] = "/tmp/rtbw_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        skip("trace_add", "%s", "无法创建临时文件");
+    } else {
+        close(fd);
+        rtbw_engine e = { .backend = &rtbw_backend_synth, .nr_targets = 1 };
+        snprintf(e.target_name[0], RTBW_NAME_LEN, "bench");
+        rtbw_trace_writer *w = rtbw_trace_create(path, &e);
+        if (w) {
+            char extra[64];
+            uint64_t t0 = rtbw_rdtscp();
+            BENCH("trace_add", iters, 64, NULL, k = 0, {
+                rtbw_trace_add(w, &s[k]);
+                k = k + 1 == iters ? 0 : k + 1;
+            });
+            snprintf(extra, sizeof(extra), "\"dropped\": %lu", rtbw_trace_dropped(w));
+            // 关闭包含等待后台线程写完全部数据，单独计一项
+            uint64_t t1 = rtbw_rdtscp();
+            rtbw_trace_close(w, tsc_hz);
+            uint64_t lat = rtbw_rdtscp() - t1;
+            emit("trace_close_flush", &lat, 1, 1, iters, (rtbw_rdtscp() - t0) / tsc_hz, extra);
+        }
+        unlink(path);
+    }
+    (void)sink;
+    free(s);
+}
+
+static void usage(const char *prog) {
+    printf("用法: %s [-n 次数] [-d 秒] [-p 周期ns] [-S sysfs根目录] [-s 设备[@端口]] [-D 设备文件] [-I 目标]\n", prog);
+    printf("  -n：单项测量次数（默认%d）\n", DEFAULT_ITERS);
+    printf("  -d：每个引擎后端的运行时间（默认%.1f秒）\n", DEFAULT_DURATION_S);
+    printf("  -p：引擎采样周期（默认%d纳秒，小于读延迟时测饱和吞吐）\n", DEFAULT_PERIOD_NS);
+    printf("  -S/-s：sysfs后端的根目录和目标（默认%s、%s）\n", DEFAULT_SYSFS_ROOT, DEFAULT_SYSFS_TARGETS);
+    printf("  -D/-I：ioctl后端的设备文件和目标（默认%s、%s）\n", DEFAULT_CHRDEV, DEFAULT_IOCTL_TARGETS);
+    printf("结果以JSON输出到标准输出\n");
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t iters = DEFAULT_ITERS, period_ns = DEFAULT_PERIOD_NS;
+    double duration = DEFAULT_DURATION_S;
+    const char *sysfs_root = DEFAULT_SYSFS_ROOT, *sysfs_targets = DEFAULT_SYSFS_TARGETS;
+    const char *chrdev = DEFAULT_CHRDEV, *ioctl_targets = DEFAULT_IOCTL_TARGETS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:p:S:s:D:I:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iters = strtoull(optarg, NULL, 0);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'p':
+            period_ns = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            sysfs_root = optarg;
+            break;
+        case 's':
+            sysfs_targets = optarg;
+            break;
+        case 'D':
+            chrdev = optarg;
+            break;
+        case 'I':
+            ioctl_targets = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if (iters < 1000 || duration <= 0) {
+        usage(argv[0]);
+        exit(1);
+    }
+    if (rtbw_clock_init(1) < 0)
+        exit(EXIT_FAILURE);
+    tsc_hz = rtbw_clock_hz();
+
+    struct utsname u;
+    uname(&u);
+    printf("{\n  \"host\": \"%s\",\n  \"kernel\": \"%s\",\n  \"tsc_ghz\": %.6f,\n"
+           "  \"clock_source\": \"%s\",\n  \"iters\": %lu,\n  \"engine_period_ns\": %lu,\n"
+           "  \"results\": [\n",
+           u.nodename, u.release, tsc_hz / 1e9, rtbw_clock_source_name(), iters, period_ns);
+
+    bench_clock(iters);
+    bench_sysfs(iters, sysfs_root, sysfs_targets);
+    bench_ioctl(iters, chrdev, ioctl_targets);
+    bench_engine(&rtbw_backend_synth, NULL, NULL, duration, period_ns);
+    bench_engine(&rtbw_backend_sysfs, sysfs_root, sysfs_targets, duration, period_ns);
+    if (access(chrdev, F_OK) == 0)
+        bench_engine(&rtbw_backend_ioctl, chrdev, ioctl_targets, duration, period_ns);
+    else
+        skip("engine_ioctl", "%s不存在", chrdev);
+    bench_report(iters);
+
+    printf("\n  ],\n  \"skipped\": [");
+    for (int i = 0; i < nr_skipped; i++)
+        printf("%s\n    %s", i ? "," : "", skipped[i]);
+    printf("%s]\n}\n", nr_skipped ? "\n  " : "");
+    return 0;
+}
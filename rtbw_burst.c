@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtbw_burst.h"
+
+int rtbw_burst_parse(rtbw_burst_config *cfg, const char *list, double threshold_gbps, double tsc_hz) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->threshold_gbps = threshold_gbps;
+    const char *p = list;
+    while (*p) {
+        char *end;
+        double v = strtod(p, &end);
+        double scale = 1e3;
+        if (!strncmp(end, "ns", 2)) {
+            scale = 1;
+            end += 2;
+        } else if (!strncmp(end, "us", 2)) {
+            end += 2;
+        } else if (!strncmp(end, "ms", 2)) {
+            scale = 1e6;
+            end += 2;
+        } else if (*end == 's') {
+            scale = 1e9;
+            end++;
+        }
+        if (end == p || (*end && *end != ',') || v <= 0) {
+            fprintf(stderr, "时间尺度格式错误：%s\n", p);
+            return -1;
+        }
+        if (cfg->nr == RTBW_BURST_MAX_RES) {
+            fprintf(stderr, "时间尺度最多%d个\n", RTBW_BURST_MAX_RES);
+            return -1;
+        }
+        int k = cfg->nr++;
+        cfg->window_ns[k] = (uint64_t)(v * scale + 0.5);
+        if (k == 0) {
+            cfg->ratio[0] = 1;
+            cfg->bucket[0] = (uint64_t)(cfg->window_ns[0] * tsc_hz / 1e9 / RTBW_BURST_STEPS + 0.5);
+            if (cfg->bucket[0] == 0) {
+                fprintf(stderr, "时间尺度太小：%lu ns\n", cfg->window_ns[0]);
+                return -1;
+            }
+        } else {
+            if (cfg->window_ns[k] <= cfg->window_ns[k - 1] ||
+                cfg->window_ns[k] % cfg->window_ns[k - 1]) {
+                fprintf(stderr, "时间尺度必须递增且是上一个尺度的整数倍：%lu ns\n", cfg->window_ns[k]);
+                return -1;
+            }
+            // 高一级的桶宽严格等于整数个低一级的桶，级联时不会错位
+            cfg->ratio[k] = cfg->window_ns[k] / cfg->window_ns[k - 1];
+            cfg->bucket[k] = cfg->bucket[k - 1] * cfg->ratio[k];
+        }
+        if (threshold_gbps > 0)
+            cfg->threshold[k] = (uint64_t)(threshold_gbps * cfg->window_ns[k] / 8);
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+void rtbw_burst_init(rtbw_burst *b, const rtbw_burst_config *cfg) {
+    memset(b, 0, sizeof(*b));
+    b->cfg = cfg;
+}
+
+void rtbw_burst_reset_window(rtbw_burst *b) {
+    for (int k = 0; k < b->cfg->nr; k++) {
+        rtbw_burst_level *l = &b->lv[k];
+        l->peak = 0;
+        l->bursts = 0;
+        l->burst_time = l->burst_max = l->burst_bytes = 0;
+    }
+}
+
+static void burst_end(const rtbw_burst_config *cfg, int k, rtbw_burst_level *l) {
+    uint64_t t = (l->cur_steps - 1) * cfg->bucket[k] + cfg->bucket[k] * RTBW_BURST_STEPS;
+    l->bursts++;
+    l->burst_time += t;
+    if (t > l->burst_max)
+        l->burst_max = t;
+    l->burst_bytes += l->cur_bytes;
+    l->cur_steps = l->cur_bytes = 0;
+}
+
+// 关闭k级的当前桶：滑动窗口前进一个桶，必要时级联关闭上一级
+static void burst_close(rtbw_burst *b, int k) {
+    const rtbw_burst_config *cfg = b->cfg;
+    for (; k < cfg->nr; k++) {
+        rtbw_burst_level *l = &b->lv[k];
+        uint64_t v = l->acc;
+        l->acc = 0;
+        l->count = 0;
+        l->sum += v - l->ring[l->head];
+        l->ring[l->head] = v;
+        l->head = l->head + 1 == RTBW_BURST_STEPS ? 0 : l->head + 1;
+        if (l->filled < RTBW_BURST_STEPS)
+            l->filled++;
+        if (l->filled == RTBW_BURST_STEPS) {
+            if (l->sum > l->peak)
+                l->peak = l->sum;
+            if (cfg->threshold[k]) {
+                if (l->sum >= cfg->threshold[k]) {
+                    l->cur_bytes += l->cur_steps ? v : l->sum;
+                    l->cur_steps++;
+                } else if (l->cur_steps) {
+                    burst_end(cfg, k, l);
+                }
+            }
+        }
+        if (k + 1 == cfg->nr)
+            return;
+        rtbw_burst_level *up = &b->lv[k + 1];
+        up->acc += v;
+        if (++up->count < cfg->ratio[k + 1])
+            return;
+    }
+}
+
+// 长时间没有数据（超过最大窗口）时所有窗口都已清空，直接重置而不是逐桶推进
+static void burst_restart(rtbw_burst *b, uint64_t t) {
+    const rtbw_burst_config *cfg = b->cfg;
+    for (int k = 0; k < cfg->nr; k++) {
+        rtbw_burst_level *l = &b->lv[k];
+        if (l->cur_steps)
+            burst_end(cfg, k, l);
+        l->acc = l->sum = 0;
+        l->count = l->head = l->filled = 0;
+        memset(l->ring, 0, sizeof(l->ring));
+    }
+    b->last = t;
+    b->bucket_end = t + cfg->bucket[0];
+}
+
+void rtbw_burst_add(rtbw_burst *b, uint64_t t_begin, uint64_t t_end, uint64_t bytes) {
+    const rtbw_burst_config *cfg = b->cfg;
+    if (!cfg->nr || t_end <= t_begin)
+        return;
+    uint64_t max_window = cfg->bucket[cfg->nr - 1] * RTBW_BURST_STEPS;
+    if (b->bucket_end == 0 || t_begin > b->last + max_window)
+        burst_restart(b, t_begin);
+    // 空闲的间隔：逐桶推进（写入0字节）
+    while (t_begin >= b->bucket_end) {
+        burst_close(b, 0);
+        b->last = b->bucket_end;
+        b->bucket_end += cfg->bucket[0];
+    }
+    if (t_begin < b->last) {
+        if (t_end <= b->last) {
+            b->lv[0].acc += bytes;
+            return;
+        }
+        t_begin = b->last;
+    }
+    // 跨越桶边界的增量按时间比例拆分（假设采样间隔内速率恒定）
+    uint64_t span = t_end - t_begin;
+    while (t_end >= b->bucket_end) {
+        uint64_t part = (unsigned __int128)bytes * (b->bucket_end - t_begin) / span;
+        b->lv[0].acc += part;
+        bytes -= part;
+        span -= b->bucket_end - t_begin;
+        t_begin = b->bucket_end;
+        burst_close(b, 0);
+        b->bucket_end += cfg->bucket[0];
+    }
+    b->lv[0].acc += bytes;
+    b->last = t_end;
+}
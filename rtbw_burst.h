@@ -0,0 +1,65 @@
+#ifndef RTBW_BURST_H
+#define RTBW_BURST_H
+
+#include <stdint.h>
+
+// 多尺度微突发检测：同时维护多个时间尺度（如10us/100us/1ms/10ms）的滑动窗口字节数
+// 1. 每个尺度的窗口由RTBW_BURST_STEPS个桶组成，窗口每次滑动一个桶（窗口的1/10）
+// 2. 桶按TSC时间划分并级联：0级桶由采样增量填充（跨桶的增量按时间比例拆分），
+//    k级桶由ratio个k-1级桶合并，因此要求每个尺度是上一个尺度的整数倍
+// 3. 每个桶关闭时用环形缓冲区O(1)更新窗口和（加新桶减旧桶），记录峰值并判断突发
+// 4. 每个采样只写0级桶；高一级的桶关闭频率按倍数递减，总开销与尺度个数无关（摊还O(1)）
+// 突发：某尺度的窗口速率连续不低于阈值的一段时间，时长为这些窗口的并集，字节数为其中的总字节
+
+#define RTBW_BURST_MAX_RES 8
+#define RTBW_BURST_STEPS 10
+
+typedef struct {
+    int nr;                                     // 尺度个数，0表示关闭
+    uint64_t window_ns[RTBW_BURST_MAX_RES];
+    uint64_t bucket[RTBW_BURST_MAX_RES];        // 桶宽（TSC周期）
+    uint32_t ratio[RTBW_BURST_MAX_RES];         // k级桶包含的k-1级桶数
+    uint64_t threshold[RTBW_BURST_MAX_RES];     // 窗口字节数阈值，0表示不检测突发
+    double threshold_gbps;
+} rtbw_burst_config;
+
+typedef struct {
+    uint64_t acc;           // 当前桶的字节数
+    uint32_t count;         // 当前桶已合并的下级桶数
+    uint32_t head, filled;
+    uint64_t ring[RTBW_BURST_STEPS];
+    uint64_t sum;           // 最近RTBW_BURST_STEPS个桶之和（当前窗口字节数）
+    // 本打印周期的统计
+    uint64_t peak;          // 最大窗口字节数
+    uint32_t bursts;        // 已结束的突发次数
+    uint64_t burst_time;    // 已结束突发的总时长（TSC周期）
+    uint64_t burst_max;     // 最长突发（TSC周期）
+    uint64_t burst_bytes;   // 已结束突发的总字节
+    // 进行中的突发
+    uint64_t cur_steps;
+    uint64_t cur_bytes;
+} rtbw_burst_level;
+
+typedef struct {
+    const rtbw_burst_config *cfg;
+    uint64_t bucket_end;    // 当前0级桶的结束时刻（TSC），0表示尚未开始
+    uint64_t last;          // 已计入的时刻
+    rtbw_burst_level lv[RTBW_BURST_MAX_RES];
+} rtbw_burst;
+
+// 解析逗号分隔的尺度列表（如"10us,100us,1ms,10ms"，单位ns/us/ms/s，缺省为us）
+// threshold_gbps为0时不检测突发；出错打印原因并返回-1
+int rtbw_burst_parse(rtbw_burst_config *cfg, const char *list, double threshold_gbps, double tsc_hz);
+
+void rtbw_burst_init(rtbw_burst *b, const rtbw_burst_config *cfg);
+// 计入[t_begin, t_end)内的bytes字节（t_begin早于已计入的时刻时从已计入的时刻算起）
+void rtbw_burst_add(rtbw_burst *b, uint64_t t_begin, uint64_t t_end, uint64_t bytes);
+// 打印后清零周期统计，保留滑动窗口和进行中的突发
+void rtbw_burst_reset_window(rtbw_burst *b);
+
+// 窗口字节数 → Gbps
+static inline double rtbw_burst_gbps(const rtbw_burst_config *cfg, int k, uint64_t bytes) {
+    return bytes * 8.0 / cfg->window_ns[k];
+}
+
+#endif // RTBW_BURST_H
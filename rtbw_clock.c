@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <cpuid.h>
+#include "rtbw_clock.h"
+
+#define CALIBRATE_NS 200000000     // 启动校准时长
+#define REFINE_MIN_BASELINE_NS 1000000000  // 基准时长不足1秒时不修正
+
+static uint64_t clock_hz_bits;     // double的位模式，原子读写
+static rtbw_clock_src clock_src;
+static uint64_t anchor_tsc;        // 漂移修正基准
+static uint64_t anchor_ns;
+
+static void store_hz(double hz) {
+    uint64_t bits;
+    memcpy(&bits, &hz, sizeof(bits));
+    __atomic_store_n(&clock_hz_bits, bits, __ATOMIC_RELAXED);
+}
+
+double rtbw_clock_hz(void) {
+    uint64_t bits = __atomic_load_n(&clock_hz_bits, __ATOMIC_RELAXED);
+    double hz;
+    memcpy(&hz, &bits, sizeof(hz));
+    return hz;
+}
+
+rtbw_clock_src rtbw_clock_source(void) {
+    return clock_src;
+}
+
+const char *rtbw_clock_source_name(void) {
+    switch (clock_src) {
+    case RTBW_CLOCK_SRC_CPUID15: return "CPUID 0x15";
+    case RTBW_CLOCK_SRC_CPUID16: return "CPUID 0x16";
+    case RTBW_CLOCK_SRC_SYSFS: return "tsc_freq_khz";
+    default: return "启动校准";
+    }
+}
+
+static uint64_t raw_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 取一对(TSC, MONOTONIC_RAW)：多次尝试取两次rdtscp间隔最短的一次，TSC取中点
+static void sample_pair(uint64_t *tsc, uint64_t *ns) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 5; i++) {
+        uint64_t t1 = rtbw_rdtscp();
+        uint64_t n = raw_ns();
+        uint64_t t2 = rtbw_rdtscp();
+        if (t2 - t1 < best) {
+            best = t2 - t1;
+            *tsc = t1 + ((t2 - t1) >> 1);
+            *ns = n;
+        }
+    }
+}
+
+// 检查TSC是否恒定且在深度C-state下不停止
+static int tsc_is_invariant(int *constant, int *nonstop) {
+    char line[4096];
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    *constant = *nonstop = 0;
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "flags", 5) != 0)
+                continue;
+            *constant = strstr(line, " constant_tsc") != NULL;
+            *nonstop = strstr(line, " nonstop_tsc") != NULL;
+            fclose(f);
+            return *constant && *nonstop;
+        }
+        fclose(f);
+    }
+    // 读不到cpuinfo时看CPUID的Invariant TSC位（同时意味着两者）
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8)))
+        *constant = *nonstop = 1;
+    return *constant && *nonstop;
+}
+
+static double hz_from_cpuid(void) {
+    unsigned int max = __get_cpuid_max(0, NULL);
+    unsigned int eax, ebx, ecx, edx;
+    if (max < 0x15)
+        return 0;
+    __cpuid(0x15, eax, ebx, ecx, edx);
+    if (eax == 0 || ebx == 0)
+        return 0;
+    if (ecx) {
+        clock_src = RTBW_CLOCK_SRC_CPUID15;
+        return (double)ecx * ebx / eax;
+    }
+    // 晶振频率未给出：TSC频率等于处理器基频
+    if (max < 0x16)
+        return 0;
+    __cpuid(0x16, eax, ebx, ecx, edx);
+    if ((eax & 0xffff) == 0)
+        return 0;
+    clock_src = RTBW_CLOCK_SRC_CPUID16;
+    return (eax & 0xffff) * 1e6;
+}
+
+static double hz_from_sysfs(void) {
+    unsigned long khz = 0;
+    FILE *f = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r");
+    if (!f)
+        return 0;
+    if (fscanf(f, "%lu", &khz) != 1)
+        khz = 0;
+    fclose(f);
+    if (khz)
+        clock_src = RTBW_CLOCK_SRC_SYSFS;
+    return khz * 1e3;
+}
+
+static double hz_calibrate(void) {
+    uint64_t c1, n1, c2, n2;
+    sample_pair(&c1, &n1);
+    struct timespec req = { .tv_nsec = CALIBRATE_NS };
+    nanosleep(&req, NULL);
+    sample_pair(&c2, &n2);
+    clock_src = RTBW_CLOCK_SRC_CALIBRATED;
+    return (double)(c2 - c1) * 1e9 / (n2 - n1);
+}
+
+int rtbw_clock_init(int force) {
+    int constant, nonstop;
+    if (!tsc_is_invariant(&constant, &nonstop)) {
+        fprintf(stderr, "警告：TSC不可靠（constant_tsc=%d nonstop_tsc=%d），基于周期数的带宽计算将不准确\n",
+                constant, nonstop);
+        if (!force)
+            return -1;
+    }
+
+    sample_pair(&anchor_tsc, &anchor_ns);
+    double hz = hz_from_cpuid();
+    if (hz <= 0)
+        hz = hz_from_sysfs();
+    if (hz <= 0)
+        hz = hz_calibrate();
+    store_hz(hz);
+    return 0;
+}
+
+double rtbw_clock_refine(void) {
+    uint64_t tsc, ns;
+    sample_pair(&tsc, &ns);
+    if (ns - anchor_ns < REFINE_MIN_BASELINE_NS)
+        return rtbw_clock_hz();
+    // 基准越长，两端各几十纳秒的读取误差占比越小
+    double hz = (double)(tsc - anchor_tsc) * 1e9 / (ns - anchor_ns);
+    store_hz(hz);
+    return hz;
+}
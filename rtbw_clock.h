@@ -0,0 +1,45 @@
+#ifndef RTBW_CLOCK_H
+#define RTBW_CLOCK_H
+
+#include <stdint.h>
+
+// TSC时钟：启动时确定频率，之后只在报告线程里对照CLOCK_MONOTONIC_RAW修正漂移
+// 频率来源按优先级：
+// 1. CPUID 0x15（TSC/晶振比 × 晶振频率；晶振频率为0时用0x16基频反推）
+// 2. /sys/devices/system/cpu/cpu0/tsc_freq_khz（内核导出的tsc_khz，部分内核提供）
+// 3. 启动时一次性校准（睡眠200ms，只在采样开始之前执行）
+// 采样中的所有周期换算都依赖恒定且不停止的TSC，缺少constant_tsc/nonstop_tsc时拒绝启动（除非强制）。
+
+typedef enum {
+    RTBW_CLOCK_SRC_CPUID15,
+    RTBW_CLOCK_SRC_CPUID16,
+    RTBW_CLOCK_SRC_SYSFS,
+    RTBW_CLOCK_SRC_CALIBRATED,
+} rtbw_clock_src;
+
+static inline uint64_t rtbw_rdtscp(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtscp" : "=a"(lo), "=d"(hi) : : "rcx");
+    return (uint64_t)hi << 32 | lo;
+}
+
+// 不等待前面指令完成的rdtsc，用于等待循环
+static inline uint64_t rtbw_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+    return (uint64_t)hi << 32 | lo;
+}
+
+// 初始化：force非0时TSC不可靠只打印警告，否则返回-1
+int rtbw_clock_init(int force);
+
+// 当前频率估计（Hz），任意线程可读
+double rtbw_clock_hz(void);
+rtbw_clock_src rtbw_clock_source(void);
+const char *rtbw_clock_source_name(void);
+
+// 漂移修正：以启动时的(TSC, MONOTONIC_RAW)为基准重新估计频率，报告线程每个周期调用一次
+// 不睡眠、不阻塞，返回新的估计值（Hz）
+double rtbw_clock_refine(void);
+
+#endif // RTBW_CLOCK_H
@@ -0,0 +1,361 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "rtbw_telemetry.h"
+
+// 遥测汇聚端：接收多台主机rt_bw -U发来的周期记录，按CLOCK_REALTIME对齐到固定宽度的时间桶，
+// 每个桶结束（再等待lateness）后打印全网汇总：
+//   主机数、各主机节点峰值之和/最大值、均值之和（全网吞吐）、突发次数、目标级峰值TOP-N
+// 1. 记录按周期结束时刻归入桶：桶序号 = end_ns / 桶宽；同一主机在一个桶内有多个周期时峰值取最大、均值取平均
+// 2. 桶存放在环中，到期或被更新的桶挤出时输出；输出之后才到达的记录计为迟到
+// 3. 每个发送者（主机名 + 进程号）单独跟踪数据报序号，统计丢包
+// 4. 批量接收（recvmmsg），单线程每秒可处理数万个数据报
+
+#define COLLECTOR_MAX_HOSTS 1024
+#define COLLECTOR_HASH_SIZE (COLLECTOR_MAX_HOSTS * 2)
+#define COLLECTOR_BUCKETS 64           // 环中的时间桶数
+#define COLLECTOR_BATCH 64             // 一次recvmmsg接收的数据报数
+#define COLLECTOR_TOPN_MAX 32
+#define COLLECTOR_RCVBUF (8 << 20)
+#define COLLECTOR_POLL_MS 100
+#define DEFAULT_BUCKET_MS 2000         // 与rt_bw的打印周期一致
+#define DEFAULT_LATENESS_MS 1000
+#define DEFAULT_TOPN 5
+
+// 一个发送者
+typedef struct {
+    char host[RTBW_TM_HOST_LEN + 1];
+    uint32_t pid;
+    uint32_t next_seq;
+    uint64_t datagrams;
+    uint64_t lost;
+} sender;
+
+typedef struct {
+    int host;
+    char name[RTBW_NAME_LEN + 1];
+    float rx, tx;
+} top_entry;
+
+// 一个时间桶
+typedef struct {
+    int64_t idx;                               // 桶序号，-1表示空
+    uint32_t nr_hosts;                         // 桶内报告了节点汇总的主机数
+    uint16_t windows[COLLECTOR_MAX_HOSTS];     // 各主机落在桶内的周期数
+    float rx_peak[COLLECTOR_MAX_HOSTS], tx_peak[COLLECTOR_MAX_HOSTS];
+    double rx_mean[COLLECTOR_MAX_HOSTS], tx_mean[COLLECTOR_MAX_HOSTS];
+    uint64_t rx_bursts, tx_bursts;
+    uint32_t burst_window_ns;
+    top_entry top[COLLECTOR_TOPN_MAX];         // 按RX/TX较大值从高到低
+    int nr_top;
+    uint64_t records;
+} bucket;
+
+static sender senders[COLLECTOR_MAX_HOSTS];
+static int nr_senders;
+static int sender_hash[COLLECTOR_HASH_SIZE];   // 发送者下标 + 1，0表示空
+static bucket buckets[COLLECTOR_BUCKETS];
+static int64_t emitted_upto = -1;              // 已输出的最大桶序号
+static uint64_t bucket_ns = DEFAULT_BUCKET_MS * 1000000ULL;
+static uint64_t lateness_ns = DEFAULT_LATENESS_MS * 1000000ULL;
+static int topn = DEFAULT_TOPN;
+static uint64_t nr_datagrams, nr_records, nr_late, nr_bad;
+static volatile sig_atomic_t stop_requested;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 按 主机名 + 进程号 查找发送者，没有则新建；满了返回-1
+static int find_sender(const struct rtbw_tm_header *h) {
+    uint32_t hash = 2166136261u ^ h->pid;
+    for (int i = 0; i < RTBW_TM_HOST_LEN && h->host[i]; i++)
+        hash = (hash ^ (uint8_t)h->host[i]) * 16777619u;
+    for (uint32_t k = hash % COLLECTOR_HASH_SIZE;; k = (k + 1) % COLLECTOR_HASH_SIZE) {
+        int s = sender_hash[k] - 1;
+        if (s < 0)
+            break;
+        if (senders[s].pid == h->pid && !strncmp(senders[s].host, h->host, RTBW_TM_HOST_LEN))
+            return s;
+    }
+    if (nr_senders == COLLECTOR_MAX_HOSTS)
+        return -1;
+    int s = nr_senders++;
+    memcpy(senders[s].host, h->host, RTBW_TM_HOST_LEN);
+    senders[s].pid = h->pid;
+    senders[s].next_seq = h->seq;
+    for (uint32_t k = hash % COLLECTOR_HASH_SIZE;; k = (k + 1) % COLLECTOR_HASH_SIZE) {
+        if (!sender_hash[k]) {
+            sender_hash[k] = s + 1;
+            break;
+        }
+    }
+    return s;
+}
+
+static void bucket_reset(bucket *b, int64_t idx) {
+    memset(b->windows, 0, nr_senders * sizeof(b->windows[0]));
+    b->idx = idx;
+    b->nr_hosts = 0;
+    b->rx_bursts = b->tx_bursts = 0;
+    b->burst_window_ns = 0;
+    b->nr_top = 0;
+    b->records = 0;
+}
+
+// 目标级峰值插入TOP-N（N很小，插入排序）
+static void top_add(bucket *b, int host, const struct rtbw_tm_record *r) {
+    float v = r->rx.max > r->tx.max ? r->rx.max : r->tx.max;
+    int pos = b->nr_top < topn ? b->nr_top : topn;
+    while (pos > 0 && v > (b->top[pos - 1].rx > b->top[pos - 1].tx ? b->top[pos - 1].rx : b->top[pos - 1].tx))
+        pos--;
+    if (pos >= topn)
+        return;
+    int last = b->nr_top < topn ? b->nr_top++ : topn - 1;
+    memmove(&b->top[pos + 1], &b->top[pos], (last - pos) * sizeof(b->top[0]));
+    b->top[pos] = (top_entry) { .host = host, .rx = r->rx.max, .tx = r->tx.max };
+    memcpy(b->top[pos].name, r->name, RTBW_NAME_LEN);
+}
+
+static void emit_bucket(bucket *b) {
+    if (b->idx < 0)
+        return;
+    double rx_sum = 0, tx_sum = 0, rx_mean = 0, tx_mean = 0;
+    float rx_max = 0, tx_max = 0;
+    int rx_arg = -1, tx_arg = -1;
+    for (int h = 0; h < nr_senders; h++) {
+        if (!b->windows[h])
+            continue;
+        rx_sum += b->rx_peak[h];
+        tx_sum += b->tx_peak[h];
+        rx_mean += b->rx_mean[h] / b->windows[h];
+        tx_mean += b->tx_mean[h] / b->windows[h];
+        if (rx_arg < 0 || b->rx_peak[h] > rx_max) {
+            rx_max = b->rx_peak[h];
+            rx_arg = h;
+        }
+        if (tx_arg < 0 || b->tx_peak[h] > tx_max) {
+            tx_max = b->tx_peak[h];
+            tx_arg = h;
+        }
+    }
+    char time_buf[32];
+    time_t start = b->idx * bucket_ns / 1000000000ULL;
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("[%s +%.1fs] 主机 %u/%d - 峰值之和 RX %.2f TX %.2f Gbps，单机最大 RX %.2f（%s）TX %.2f（%s），"
+           "均值之和 RX %.2f TX %.2f Gbps", time_buf, bucket_ns / 1e9, b->nr_hosts, nr_senders,
+           rx_sum, tx_sum, rx_max, rx_arg >= 0 ? senders[rx_arg].host : "-",
+           tx_max, tx_arg >= 0 ? senders[tx_arg].host : "-", rx_mean, tx_mean);
+    if (b->burst_window_ns)
+        printf("，%uus突发 RX %lu TX %lu 次", b->burst_window_ns / 1000, b->rx_bursts, b->tx_bursts);
+    printf("\n");
+    if (b->nr_top) {
+        printf("[%s +%.1fs] 目标峰值TOP%d：", time_buf, bucket_ns / 1e9, topn);
+        for (int k = 0; k < b->nr_top; k++)
+            printf("  %s/%s RX %.2f TX %.2f", senders[b->top[k].host].host, b->top[k].name,
+                   b->top[k].rx, b->top[k].tx);
+        printf("\n");
+    }
+    fflush(stdout);
+    if (b->idx > emitted_upto)
+        emitted_upto = b->idx;
+    b->idx = -1;
+}
+
+// 输出所有结束时间加lateness已过去的桶（按时间顺序）；force为1时输出全部
+static void emit_due(int force) {
+    uint64_t now = realtime_ns();
+    for (;;) {
+        bucket *oldest = NULL;
+        for (int i = 0; i < COLLECTOR_BUCKETS; i++)
+            if (buckets[i].idx >= 0 && (!oldest || buckets[i].idx < oldest->idx))
+                oldest = &buckets[i];
+        if (!oldest || (!force && (uint64_t)(oldest->idx + 1) * bucket_ns + lateness_ns > now))
+            break;
+        emit_bucket(oldest);
+    }
+}
+
+static void add_record(int host, const struct rtbw_tm_record *r) {
+    int64_t idx = r->end_ns / bucket_ns;
+    if (idx <= emitted_upto) {
+        nr_late++;
+        return;
+    }
+    bucket *b = &buckets[idx % COLLECTOR_BUCKETS];
+    if (b->idx != idx) {
+        if (b->idx > idx) {           // 比环中最早的桶还早
+            nr_late++;
+            return;
+        }
+        emit_due(0);
+        if (b->idx >= 0)              // 时间跨度超过环的大小，提前输出旧桶
+            emit_bucket(b);
+        bucket_reset(b, idx);
+    }
+    b->records++;
+    if (r->flags & RTBW_TM_NODE) {
+        if (!b->windows[host]++) {
+            b->nr_hosts++;
+            b->rx_peak[host] = b->tx_peak[host] = 0;
+            b->rx_mean[host] = b->tx_mean[host] = 0;
+        }
+        if (r->rx.max > b->rx_peak[host])
+            b->rx_peak[host] = r->rx.max;
+        if (r->tx.max > b->tx_peak[host])
+            b->tx_peak[host] = r->tx.max;
+        b->rx_mean[host] += r->rx.mean;
+        b->tx_mean[host] += r->tx.mean;
+        b->rx_bursts += r->rx.bursts;
+        b->tx_bursts += r->tx.bursts;
+        if (r->burst_window_ns)
+            b->burst_window_ns = r->burst_window_ns;
+    } else if (r->samples) {
+        top_add(b, host, r);
+    }
+}
+
+static void handle_datagram(const uint8_t *buf, size_t len) {
+    const struct rtbw_tm_header *h = (const void *)buf;
+    if (len < sizeof(*h) || h->magic != RTBW_TM_MAGIC || h->version != RTBW_TM_VERSION ||
+        len != sizeof(*h) + h->nr_records * sizeof(struct rtbw_tm_record)) {
+        nr_bad++;
+        return;
+    }
+    int s = find_sender(h);
+    if (s < 0) {
+        nr_bad++;
+        return;
+    }
+    sender *sd = &senders[s];
+    // 序号跳跃计为丢包；回退视为发送者重启
+    if ((int32_t)(h->seq - sd->next_seq) > 0)
+        sd->lost += h->seq - sd->next_seq;
+    sd->next_seq = h->seq + 1;
+    sd->datagrams++;
+    nr_datagrams++;
+    const struct rtbw_tm_record *r = (const void *)(h + 1);
+    for (uint32_t i = 0; i < h->nr_records; i++)
+        add_record(s, &r[i]);
+    nr_records += h->nr_records;
+}
+
+static void usage(const char *prog) {
+    printf("用法: %s [-p 端口] [-b 桶宽ms] [-l 等待ms] [-t N] [-d 秒]\n", prog);
+    printf("  -p：UDP端口（默认%d）\n", RTBW_TM_PORT);
+    printf("  -b：时间桶宽度（默认%d毫秒，与rt_bw打印周期一致）\n", DEFAULT_BUCKET_MS);
+    printf("  -l：桶结束后等待迟到记录的时间（默认%d毫秒）\n", DEFAULT_LATENESS_MS);
+    printf("  -t：每个桶列出的目标峰值TOP数（默认%d，最多%d）\n", DEFAULT_TOPN, COLLECTOR_TOPN_MAX);
+    printf("  -d：运行指定秒数后退出（默认一直运行，Ctrl-C退出）\n");
+}
+
+int main(int argc, char *argv[]) {
+    int port = RTBW_TM_PORT, duration = 0, opt;
+    while ((opt = getopt(argc, argv, "p:b:l:t:d:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'b':
+            bucket_ns = strtoull(optarg, NULL, 0) * 1000000ULL;
+            break;
+        case 'l':
+            lateness_ns = strtoull(optarg, NULL, 0) * 1000000ULL;
+            break;
+        case 't':
+            topn = atoi(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            exit(opt == 'h' ? 0 : 1);
+        }
+    }
+    if (port <= 0 || port > 65535 || bucket_ns == 0 || topn < 0 || topn > COLLECTOR_TOPN_MAX) {
+        usage(argv[0]);
+        exit(1);
+    }
+    for (int i = 0; i < COLLECTOR_BUCKETS; i++)
+        buckets[i].idx = -1;
+
+    // 1. 双栈UDP套接字，加大接收缓冲区吸收各主机同时到达的周期数据
+    int fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    int zero = 0, rcvbuf = COLLECTOR_RCVBUF;
+    if (fd < 0) {
+        perror("socket failed");
+        exit(EXIT_FAILURE);
+    }
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_port = htons(port), .sin6_addr = in6addr_any };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("遥测汇聚：UDP端口 %d，时间桶 %.1f 秒，等待迟到记录 %.1f 秒\n", port, bucket_ns / 1e9, lateness_ns / 1e9);
+    fflush(stdout);
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // 2. 批量接收，每次醒来后输出到期的桶
+    static uint8_t bufs[COLLECTOR_BATCH][RTBW_TM_MAX_DGRAM];
+    struct mmsghdr msg[COLLECTOR_BATCH];
+    struct iovec iov[COLLECTOR_BATCH];
+    uint64_t deadline = duration ? realtime_ns() + duration * 1000000000ULL : 0;
+    while (!stop_requested && (!deadline || realtime_ns() < deadline)) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, COLLECTOR_POLL_MS) < 0 && errno != EINTR) {
+            perror("poll failed");
+            break;
+        }
+        for (;;) {
+            for (int i = 0; i < COLLECTOR_BATCH; i++) {
+                iov[i] = (struct iovec) { .iov_base = bufs[i], .iov_len = sizeof(bufs[i]) };
+                msg[i] = (struct mmsghdr) { .msg_hdr = { .msg_iov = &iov[i], .msg_iovlen = 1 } };
+            }
+            int n = recvmmsg(fd, msg, COLLECTOR_BATCH, MSG_DONTWAIT, NULL);
+            if (n <= 0)
+                break;
+            for (int i = 0; i < n; i++) {
+                if (msg[i].msg_hdr.msg_flags & MSG_TRUNC)
+                    nr_bad++;
+                else
+                    handle_datagram(bufs[i], msg[i].msg_len);
+            }
+            if (n < COLLECTOR_BATCH)
+                break;
+        }
+        emit_due(0);
+    }
+
+    // 3. 输出剩余的桶和接收统计
+    emit_due(1);
+    uint64_t lost = 0;
+    for (int s = 0; s < nr_senders; s++)
+        lost += senders[s].lost;
+    printf("共收到 %lu 个数据报、%lu 条记录（%d 个发送者），丢失 %lu 个，迟到记录 %lu 条，无效数据报 %lu 个\n",
+           nr_datagrams, nr_records, nr_senders, lost, nr_late, nr_bad);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "rtbw_trace.h"
+#include "rtbw_flight.h"
+
+// 把rt_bw -w录制的二进制trace转成文本
+// 输出：文件头信息（#开头），然后每条记录一行CSV：
+//   相对起始的纳秒,目标,TX字节,RX字节,读延迟纳秒,错误码
+// 自适应采样改变周期的事件、飞行记录的触发事件输出为#开头的注释行（位置与记录顺序一致）
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("用法: %s <trace文件> [起始秒] [结束秒]\n", argv[0]);
+        exit(1);
+    }
+    rtbw_trace_reader *r = rtbw_trace_open(argv[1]);
+    if (!r)
+        exit(EXIT_FAILURE);
+    const struct rtbw_trace_header *h = rtbw_trace_header(r);
+    double hz = h->tsc_hz;
+    uint64_t from = h->start_tsc, to = UINT64_MAX;
+    if (argc >= 3)
+        from += atof(argv[2]) * hz;
+    if (argc >= 4)
+        to = h->start_tsc + atof(argv[3]) * hz;
+
+    char time_buf[32];
+    time_t start = h->start_realtime_ns / 1000000000ULL;
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", localtime(&start));
+    printf("# 主机：%s，内核：%s，后端：%s\n", h->host, h->kernel, h->backend);
+    printf("# 开始时间：%s，TSC：%.6f GHz\n", time_buf, hz / 1e9);
+    if (h->index_offset)
+        printf("# 记录：%lu 条，块：%lu 个\n", h->nr_records, h->nr_chunks);
+    else
+        printf("# 没有索引（录制未正常结束）\n");
+    for (uint32_t i = 0; i < h->nr_targets; i++)
+        printf("# 目标%u：%s\n", i, h->target_name[i]);
+    printf("ns,target,tx_bytes,rx_bytes,read_ns,err\n");
+
+    rtbw_trace_seek(r, from);
+    rtbw_sample s;
+    int ret;
+    while ((ret = rtbw_trace_next(r, &s)) > 0) {
+        if (s.tsc < from)
+            continue;
+        if (s.tsc > to)
+            break;
+        if (s.target == RTBW_TARGET_PERIOD) {
+            printf("# %.0f 采样周期 %lu -> %lu 纳秒\n", (double)(s.tsc - h->start_tsc) * 1e9 / hz,
+                   s.rx, s.tx);
+            continue;
+        }
+        if (s.target == RTBW_TARGET_MARK) {
+            printf("# %.0f 标记：阶段 %lu\n", (double)(s.tsc - h->start_tsc) * 1e9 / hz, s.tx);
+            continue;
+        }
+        if (s.target == RTBW_TARGET_TRIGGER) {
+            uint32_t t = s.tx >> 8;
+            printf("# %.0f 触发：%s", (double)(s.tsc - h->start_tsc) * 1e9 / hz, rtbw_flight_kind_name(s.tx & 0xff));
+            if (t < h->nr_targets && (s.tx & 0xff) != RTBW_TRIG_EXTERNAL)
+                printf("，目标%u（%s）", t, h->target_name[t]);
+            if (s.rx)
+                printf("，%.2f Gbps", s.rx / 1000.0);
+            printf("\n");
+            continue;
+        }
+        printf("%.0f,%u,%lu,%lu,%.0f,%d\n", (double)(s.tsc - h->start_tsc) * 1e9 / hz,
+               s.target, s.tx * 4, s.rx * 4, s.read_cycles * 1e9 / hz, s.err);
+    }
+    if (ret < 0)
+        fprintf(stderr, "%s: 文件损坏\n", argv[1]);
+    rtbw_trace_free(r);
+    return ret < 0 ? EXIT_FAILURE : 0;
+}
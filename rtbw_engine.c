@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include "rtbw_engine.h"
+
+const rtbw_backend *const rtbw_backends[] = {
+    &rtbw_backend_ioctl,
+    &rtbw_backend_sysfs,
+    &rtbw_backend_synth,
+    NULL,
+};
+
+const rtbw_backend *rtbw_backend_find(const char *name) {
+    for (int i = 0; rtbw_backends[i]; i++)
+        if (!strcmp(rtbw_backends[i]->name, name))
+            return rtbw_backends[i];
+    return NULL;
+}
+
+int rtbw_engine_open(rtbw_engine *e, const rtbw_backend *backend, const char *targets) {
+    e->backend = backend;
+    e->nr_targets = 0;
+    e->dev_sysfs[0] = '\0';
+    e->node = -1;
+    if (!targets)
+        targets = backend->default_targets;
+    if (!targets) {
+        fprintf(stderr, "后端 %s 需要指定目标\n", backend->name);
+        return -1;
+    }
+    if (backend->open(e, targets) < 0)
+        return -1;
+    if (e->nr_targets == 0) {
+        fprintf(stderr, "没有可用的目标\n");
+        return -1;
+    }
+    return 0;
+}
+
+void rtbw_engine_place(rtbw_engine *e) {
+    const char *dev = e->dev_sysfs[0] ? e->dev_sysfs : NULL;
+    e->node = rtbw_numa_device_node(dev);
+    if (e->core == RTBW_CORE_AUTO)
+        e->core = rtbw_numa_pick_core(dev);
+
+    // 报告线程留在设备本地的其他CPU上（只有一个本地CPU时与采样线程共用）
+    cpu_set_t *local = &e->reporter_cpus;
+    rtbw_numa_local_cpus(dev, local);
+    e->exclusive = e->core >= 0 && CPU_COUNT(local) > 1;
+    if (e->exclusive)
+        CPU_CLR(e->core, local);
+}
+
+int rtbw_engine_bind_reporter(rtbw_engine *e, pthread_t thread) {
+    int ret = pthread_setaffinity_np(thread, sizeof(e->reporter_cpus), &e->reporter_cpus);
+    if (ret) {
+        fprintf(stderr, "绑定报告线程失败：%s\n", strerror(ret));
+        return -1;
+    }
+    return 0;
+}
+
+int rtbw_engine_start(rtbw_engine *e, uint64_t queue_slots) {
+    // 队列按需提交页面，启动时不清零；采样线程和报告线程都在设备节点上
+    void *buf = rtbw_numa_alloc(queue_slots * sizeof(rtbw_sample), e->node);
+    if (!buf) {
+        perror("alloc sample queue failed");
+        return -1;
+    }
+    rtbw_spsc_attach(&e->q, queue_slots, buf);
+    __atomic_store_n(&e->ready, 0, __ATOMIC_RELAXED);
+    if (pthread_create(&e->thread, NULL, e->backend->sampler, e) != 0) {
+        perror("pthread_create sampler failed");
+        goto fail;
+    }
+    // 等待采样线程绑核、后端完成准备（如内核采样环的映射），失败时线程已经退出
+    struct timespec req = { .tv_nsec = 1000000 };
+    int ready;
+    while ((ready = __atomic_load_n(&e->ready, __ATOMIC_ACQUIRE)) == 0)
+        nanosleep(&req, NULL);
+    if (ready > 0)
+        return 0;
+    pthread_join(e->thread, NULL);
+fail:
+    rtbw_numa_free(e->q.buf, queue_slots * sizeof(rtbw_sample));
+    e->q.buf = NULL;
+    return -1;
+}
+
+void rtbw_engine_ready(rtbw_engine *e, int ok) {
+    __atomic_store_n(&e->ready, ok < 0 ? -1 : 1, __ATOMIC_RELEASE);
+}
+
+void rtbw_engine_stop(rtbw_engine *e) {
+    __atomic_store_n(&e->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(e->thread, NULL);
+    e->backend->close(e);
+    rtbw_numa_free(e->q.buf, (e->q.mask + 1) * sizeof(rtbw_sample));
+    e->q.buf = NULL;
+}
+
+// 自适应采样的睡眠要准时醒来：
+// 1. 定时器余量设为最小值1纳秒（0表示恢复默认的50微秒），到期时间不被合并推迟
+// 2. 采样核心独占时切换到SCHED_FIFO，醒来后立即抢占普通任务；与报告线程共用核心时不切换，
+//    否则最细周期下的自旋会饿死报告线程。没有权限时只警告，按普通调度继续运行
+static void engine_realtime(rtbw_engine *e) {
+    if (prctl(PR_SET_TIMERSLACK, 1UL) < 0)
+        perror("prctl timerslack failed");
+    if (!e->exclusive)
+        return;
+    struct sched_param sp = { .sched_priority = RTBW_SAMPLER_FIFO_PRIO };
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (ret)
+        fprintf(stderr, "采样线程切换到SCHED_FIFO失败（%s），使用普通调度\n", strerror(ret));
+}
+
+// 绑定采样线程到固定CPU核心
+int rtbw_engine_pin(rtbw_engine *e) {
+    __atomic_store_n(&e->sampler_tid, (int)syscall(SYS_gettid), __ATOMIC_RELEASE);
+    if (e->core >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(e->core, &cpuset);
+        if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) < 0) {
+            perror("sched_setaffinity failed");
+            return -1;
+        }
+    }
+    if (e->idle_period_ns > e->period_ns)
+        engine_realtime(e);
+    return 0;
+}
+
+uint64_t rtbw_engine_dropped(rtbw_engine *e) {
+    return rtbw_spsc_dropped(&e->q);
+}
+
+uint64_t rtbw_engine_lost(rtbw_engine *e) {
+    return e->backend->lost ? e->backend->lost(e) : 0;
+}
+
+void rtbw_engine_report(rtbw_engine *e, const char *time_buf) {
+    if (e->backend->report)
+        e->backend->report(e, time_buf);
+}
+
+// getrusage只能统计调用者自己（RUSAGE_THREAD），采样线程的计数从procfs读取，不打扰采样线程
+int rtbw_engine_ctxsw(rtbw_engine *e, uint64_t *voluntary, uint64_t *involuntary) {
+    int tid = __atomic_load_n(&e->sampler_tid, __ATOMIC_ACQUIRE);
+    char path[64], line[128];
+    int found = 0;
+    if (!tid)
+        return -1;
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "voluntary_ctxt_switches: %" SCNu64, voluntary) == 1 ||
+            sscanf(line, "nonvoluntary_ctxt_switches: %" SCNu64, involuntary) == 1)
+            found++;
+    }
+    fclose(f);
+    return found == 2 ? 0 : -1;
+}
@@ -0,0 +1,213 @@
+#ifndef RTBW_ENGINE_H
+#define RTBW_ENGINE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "rtbw_clock.h"
+#include "rtbw_sched.h"
+#include "rtbw_spsc.h"
+#include "rtbw_numa.h"
+
+// 采样引擎：一个绑核采样线程 + 可替换的计数器来源（后端）
+// 1. 后端负责解析目标、打开设备，并提供一个“读一轮计数器”的内联函数
+// 2. 每个后端用RTBW_DEFINE_SAMPLER把自己的读函数展开进同一个采样循环，
+//    热循环在编译期按后端特化，每次采样没有间接调用
+// 3. 后端之间只在启动时通过rtbw_backend的函数指针区分
+
+#define RTBW_MAX_TARGETS 256
+#define RTBW_NAME_LEN 32
+#define RTBW_ADAPT_QUIET_ROUNDS 64      // 自适应采样：当前周期下连续空闲这么多轮后周期加倍
+#define RTBW_SAMPLER_FIFO_PRIO 10       // 自适应采样：采样线程的SCHED_FIFO优先级
+
+typedef struct rtbw_engine rtbw_engine;
+
+typedef struct {
+    const char *name;
+    const char *target_help;            // 目标格式说明（用法中打印）
+    const char *default_targets;        // 未指定目标时使用，NULL表示必须指定
+    // 解析逗号分隔的目标列表并打开设备，填写nr_targets/target_name/ctx；失败返回-1
+    int (*open)(rtbw_engine *e, const char *targets);
+    // 采样线程入口（由RTBW_DEFINE_SAMPLER生成）
+    void *(*sampler)(void *engine);
+    // 后端自身统计的丢失采样数（如内核环满），没有则为NULL
+    uint64_t (*lost)(rtbw_engine *e);
+    // 每个打印周期打印一次后端自身的统计（如内核固件命令延迟），没有则为NULL
+    void (*report)(rtbw_engine *e, const char *time_buf);
+    void (*close)(rtbw_engine *e);
+} rtbw_backend;
+
+struct rtbw_engine {
+    const rtbw_backend *backend;
+    void *ctx;                          // 后端私有状态
+    int nr_targets;
+    char target_name[RTBW_MAX_TARGETS][RTBW_NAME_LEN];
+    uint16_t target_vport[RTBW_MAX_TARGETS];  // 0：PF或非SR-IOV目标；n：VF n-1（由后端填写）
+    char dev_sysfs[256];                // 第一个目标的PCI设备sysfs目录（由后端填写，空表示未知）
+    int node;                           // 设备所在NUMA节点，-1未知（rtbw_engine_place确定）
+
+    // 采样配置（rtbw_engine_start之前设置）
+    uint64_t period_ns;
+    int core;                           // 采样线程绑定的核心，RTBW_CORE_AUTO按设备位置选择，RTBW_CORE_NONE不绑核
+    rtbw_idle_mode idle;
+    uint32_t ring_period_ns;            // ioctl后端：非0时改用内核采样环
+    uint32_t ring_depth;                // ioctl后端：内核采样环同时在途的固件命令数，>1为异步流水线
+    const char *path;                   // 设备文件或sysfs根目录，NULL使用后端默认值
+    uint32_t coalesce_ns;               // ioctl后端：允许使用其他请求不超过该时长的查询结果，0不合并
+    int hw_clock;                       // ioctl后端：用网卡内部时钟给采样计时（换算到TSC时间轴）
+    uint64_t idle_period_ns;            // 自适应采样：链路空闲时周期最长放宽到该值，0（或不大于period_ns）关闭
+    double active_mbps;                 // 自适应采样：任一目标任一方向速率超过该值即视为有流量
+    int exclusive;                      // 采样核心不与报告线程共用（rtbw_engine_place确定）
+    cpu_set_t reporter_cpus;            // 报告线程可用的CPU：设备本地、独占时去掉采样核心（rtbw_engine_place确定）
+
+    // 运行状态
+    rtbw_spsc q;                        // 采样线程 → 报告线程
+    rtbw_sched sched;                   // 采样线程的截止时间调度
+    pthread_t thread;
+    int sampler_tid;                    // 采样线程的线程号（rtbw_engine_pin记录），0表示尚未启动
+    int stop;                           // 置位后采样线程退出
+    int ready;                          // 采样线程的启动结果：0尚未确定，1成功，-1失败（线程已退出）
+};
+
+extern const rtbw_backend rtbw_backend_ioctl;
+extern const rtbw_backend rtbw_backend_sysfs;
+extern const rtbw_backend rtbw_backend_synth;
+extern const rtbw_backend *const rtbw_backends[];
+
+const rtbw_backend *rtbw_backend_find(const char *name);
+
+// 选择后端并打开目标；targets为NULL时使用后端默认目标
+int rtbw_engine_open(rtbw_engine *e, const rtbw_backend *backend, const char *targets);
+// 按设备位置确定节点并解析RTBW_CORE_AUTO，计算报告线程可用的CPU（不改变调用线程的绑定）
+void rtbw_engine_place(rtbw_engine *e);
+// 把线程绑定到reporter_cpus（报告线程由库创建时在线程内调用；在调用者线程上聚合时由调用者恢复原绑定）
+int rtbw_engine_bind_reporter(rtbw_engine *e, pthread_t thread);
+// 在设备节点上分配队列并启动采样线程，等到采样线程报告启动结果（绑核、后端准备）；失败返回-1
+int rtbw_engine_start(rtbw_engine *e, uint64_t queue_slots);
+// 停止并等待采样线程退出，然后关闭后端
+void rtbw_engine_stop(rtbw_engine *e);
+// 采样线程内调用：绑定到e->core；自适应采样时再设置最小定时器余量和SCHED_FIFO；绑核失败返回-1
+int rtbw_engine_pin(rtbw_engine *e);
+// 采样线程内调用：报告启动结果（ok < 0时随后退出线程），rtbw_engine_start据此返回
+void rtbw_engine_ready(rtbw_engine *e, int ok);
+// 引擎和后端累计丢弃的采样轮数
+uint64_t rtbw_engine_dropped(rtbw_engine *e);
+uint64_t rtbw_engine_lost(rtbw_engine *e);
+void rtbw_engine_report(rtbw_engine *e, const char *time_buf);
+// 采样线程累计的自愿/非自愿上下文切换次数（/proc/self/task/<tid>/status），读取失败返回-1
+int rtbw_engine_ctxsw(rtbw_engine *e, uint64_t *voluntary, uint64_t *involuntary);
+
+// 采样循环：read必须是编译期常量（后端的static inline函数），
+// always_inline保证它被展开进每个后端各自的循环
+// read填写out[0..nr_targets)的tx/rx/err，target由循环填写；
+// read可以填写tsc（计数器实际的采样时刻，如内核合并的查询），否则使用本轮读取的时刻；
+// 同样可以填写read_cycles（内核紧贴固件命令测得的时间区间），否则使用本轮读取前后rdtscp之差
+// 自适应采样（idle_period_ns > period_ns）：
+// 1. 每轮比较各目标的计数增量，全部低于active_mbps时计为空闲一轮；
+//    增量只在同一目标的上一次读取成功时计算（按各自的采样时刻），读取失败的目标不参与判断，
+//    当前周期下连续空闲RTBW_ADAPT_QUIET_ROUNDS轮后周期加倍，最长idle_period_ns
+// 2. 任一目标有流量时立即回到period_ns，下一个截止时间从上一个截止时间起算，即下一次采样就是最细周期
+// 3. 每次改变周期推送一条RTBW_TARGET_PERIOD事件记录；队列满推送不了时下一轮重试，事件不会丢失
+static inline __attribute__((always_inline))
+void rtbw_sampler_loop(rtbw_engine *e, void (*read)(void *ctx, rtbw_sample *out)) {
+    rtbw_sample buf[RTBW_MAX_TARGETS];
+    // 自适应：每个目标上一次成功读取的计数和采样时刻，valid为0时还没有可比较的读取
+    uint64_t last_tx[RTBW_MAX_TARGETS], last_rx[RTBW_MAX_TARGETS], last_t[RTBW_MAX_TARGETS];
+    uint8_t valid[RTBW_MAX_TARGETS] = { 0 };
+    rtbw_sched *sched = &e->sched;
+    void *ctx = e->ctx;
+    uint32_t n = e->nr_targets;
+    uint64_t t, tmp, pos;
+    uint32_t read_cycles;
+    rtbw_sched_init(sched, e->period_ns, rtbw_clock_hz(), e->idle);
+
+    int adapt = e->idle_period_ns > e->period_ns;
+    uint64_t cur_ns = e->period_ns;         // 当前周期
+    uint64_t announced_ns = e->period_ns;   // 已经通过事件记录告知报告线程的周期
+    uint32_t quiet = 0;
+    // 阈值换算成每TSC周期的4字节字数，增量直接与 阈值 × 采样间隔 比较
+    double thr = e->active_mbps * 1e6 / 32 / rtbw_clock_hz();
+    if (adapt)
+        rtbw_sched_enable_sleep(sched);
+
+    while (!__atomic_load_n(&e->stop, __ATOMIC_RELAXED)) {
+        // 步骤1：等待到绝对截止时间（已扣除半个读延迟）
+        rtbw_sched_wait(sched);
+
+        // 步骤2：读取当前cycle和所有目标的计数器
+        t = rtbw_rdtscp();
+        for (uint32_t i = 0; i < n; i++) {
+            buf[i].tsc = 0;
+            buf[i].read_cycles = 0;
+        }
+        read(ctx, buf);
+        tmp = rtbw_rdtscp();
+        rtbw_sched_done(sched, t, tmp);
+        read_cycles = tmp - t;
+        t = t + (read_cycles >> 1);
+
+        // 步骤3：推送原始记录（队列满则整轮丢弃并计数）
+        if (rtbw_spsc_reserve(&e->q, n, &pos) < 0) {
+            rtbw_spsc_drop(&e->q);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                rtbw_sample *r = rtbw_spsc_slot(&e->q, pos + i);
+                r->tsc = buf[i].tsc ? buf[i].tsc : t;
+                r->tx = buf[i].tx;
+                r->rx = buf[i].rx;
+                r->read_cycles = buf[i].read_cycles ? buf[i].read_cycles : read_cycles;
+                r->target = i;
+                r->err = buf[i].err;
+            }
+            rtbw_spsc_publish(&e->q, n);
+        }
+        if (!adapt)
+            continue;
+
+        // 步骤4（自适应）：判断本轮是否有流量并调整周期，事件紧跟在本轮记录之后
+        int active = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            if (buf[i].err)
+                continue;
+            uint64_t ti = buf[i].tsc ? buf[i].tsc : t;
+            if (valid[i] && ti > last_t[i] &&
+                ((double)(buf[i].tx - last_tx[i]) > thr * (ti - last_t[i]) ||
+                 (double)(buf[i].rx - last_rx[i]) > thr * (ti - last_t[i])))
+                active = 1;
+            last_tx[i] = buf[i].tx;
+            last_rx[i] = buf[i].rx;
+            last_t[i] = ti;
+            valid[i] = 1;
+        }
+        if (active) {
+            quiet = 0;
+            if (cur_ns != e->period_ns) {
+                cur_ns = e->period_ns;
+                rtbw_sched_set_period(sched, cur_ns);
+            }
+        } else if (cur_ns < e->idle_period_ns && ++quiet >= RTBW_ADAPT_QUIET_ROUNDS) {
+            quiet = 0;
+            cur_ns = cur_ns * 2 < e->idle_period_ns ? cur_ns * 2 : e->idle_period_ns;
+            rtbw_sched_set_period(sched, cur_ns);
+        }
+        if (cur_ns != announced_ns && rtbw_spsc_reserve(&e->q, 1, &pos) == 0) {
+            rtbw_sample *r = rtbw_spsc_slot(&e->q, pos);
+            *r = (rtbw_sample) { .tsc = t, .tx = cur_ns, .rx = announced_ns, .target = RTBW_TARGET_PERIOD };
+            rtbw_spsc_publish(&e->q, 1);
+            announced_ns = cur_ns;
+        }
+    }
+}
+
+// 生成后端的采样线程入口：绑核后进入以read_fn特化的采样循环
+#define RTBW_DEFINE_SAMPLER(fn, read_fn)            \
+    static void *fn(void *arg) {                    \
+        rtbw_engine *e = arg;                       \
+        int ok = rtbw_engine_pin(e);                \
+        rtbw_engine_ready(e, ok);                   \
+        if (ok < 0)                                 \
+            return NULL;                            \
+        rtbw_sampler_loop(e, read_fn);              \
+        return NULL;                                \
+    }
+
+#endif // RTBW_ENGINE_H
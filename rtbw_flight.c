@@ -0,0 +1,460 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include "rtbw_flight.h"
+#include "rtbw_trace.h"
+#include "rtbw_clock.h"
+#include "rtbw_numa.h"
+
+#define FLIGHT_CAP_MARGIN 1.25      // 缓冲区按标称采样数多留的余量（采样抖动、事件记录）
+
+// 每个目标的触发状态
+typedef struct {
+    uint64_t tsc, tx, rx;           // 上一次成功读取
+    int valid;
+    uint64_t win_start;             // 当前速率窗口的起点（TSC），0表示尚未开始
+    uint64_t win_tx, win_rx;        // 窗口内的增量（4字节）
+    int above, below;               // 上一个窗口是否满足条件
+} flight_target;
+
+// 交给转储线程的一次记录
+typedef struct {
+    int buf;
+    uint64_t head;
+    uint64_t trig_tsc;
+    int kind;
+    uint32_t target;
+    double mbps;
+} flight_job;
+
+struct rtbw_flight {
+    rtbw_flight_config cfg;
+    const rtbw_engine *e;
+    double tsc_hz;
+    uint64_t pre, post, window;     // TSC周期
+    double above_mbps, below_mbps;
+
+    // 两个环形缓冲区：一个由报告线程写入，另一个可能正在转储
+    rtbw_sample *buf[2];
+    size_t buf_bytes;
+    uint64_t mask;
+    int live;
+    uint64_t head;                  // live缓冲区已写入的记录数
+
+    // 触发（报告线程独占）
+    uint64_t trig_tsc;              // 0表示没有进行中的触发
+    int trig_kind;
+    uint32_t trig_target;
+    double trig_mbps;
+    uint64_t suppressed;
+    flight_target t[RTBW_MAX_TARGETS];
+
+    // 转储线程
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    flight_job job;
+    int pending;
+    int busy;                       // 转储线程持有一个缓冲区（报告线程原子读取）
+    int done;
+    uint64_t dumps;
+    pthread_t thread;
+    // FIFO线程：关闭fifo_stop[1]时退出
+    int fifo_fd;
+    int fifo_stop[2];
+    pthread_t fifo_thread;
+};
+
+// SIGUSR1和FIFO线程置位，报告线程在下一条记录时处理
+static volatile sig_atomic_t external_requested;
+
+static void on_trigger_signal(int sig) {
+    (void)sig;
+    external_requested = 1;
+}
+
+// ==================== 配置 ====================
+
+// 时长（ns/us/ms/s，缺省us）→ 纳秒，出错返回0
+static uint64_t parse_duration(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    double scale = 1e3;
+    if (!strcmp(end, "ns"))
+        scale = 1;
+    else if (!strcmp(end, "ms"))
+        scale = 1e6;
+    else if (!strcmp(end, "s"))
+        scale = 1e9;
+    else if (*end && strcmp(end, "us"))
+        return 0;
+    return end == s || v <= 0 ? 0 : (uint64_t)(v * scale + 0.5);
+}
+
+int rtbw_flight_parse(rtbw_flight_config *cfg, const char *spec) {
+    *cfg = (rtbw_flight_config) {
+        .pre_s = RTBW_FLIGHT_PRE_DFT, .post_s = RTBW_FLIGHT_POST_DFT,
+        .window_ns = RTBW_FLIGHT_WINDOW_DFT, .dir = ".",
+    };
+    // fifo/dir指向这份拷贝，与配置同生命周期
+    char *list = strdup(spec);
+    if (!list) {
+        perror("alloc flight spec failed");
+        return -1;
+    }
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+        if (val)
+            *val++ = '\0';
+        if (!strcmp(tok, "back") && !val) {
+            cfg->backwards = 1;
+            continue;
+        }
+        int ok = val && *val;
+        if (!ok)
+            ;
+        else if (!strcmp(tok, "pre"))
+            ok = (cfg->pre_s = atof(val)) >= 0;
+        else if (!strcmp(tok, "post"))
+            ok = (cfg->post_s = atof(val)) >= 0;
+        else if (!strcmp(tok, "win"))
+            ok = (cfg->window_ns = parse_duration(val)) != 0;
+        else if (!strcmp(tok, "above"))
+            ok = (cfg->above_gbps = atof(val)) > 0;
+        else if (!strcmp(tok, "below"))
+            ok = (cfg->below_gbps = atof(val)) > 0;
+        else if (!strcmp(tok, "fifo"))
+            cfg->fifo = val;
+        else if (!strcmp(tok, "dir"))
+            cfg->dir = val;
+        else
+            ok = 0;
+        if (!ok) {
+            fprintf(stderr, "飞行记录参数错误：%s%s%s\n", tok, val ? "=" : "", val ? val : "");
+            return -1;
+        }
+    }
+    if (cfg->pre_s + cfg->post_s <= 0) {
+        fprintf(stderr, "飞行记录的pre和post不能都为0\n");
+        return -1;
+    }
+    return 0;
+}
+
+// ==================== 转储线程 ====================
+
+// 冻结的缓冲区中触发前pre到触发后post的记录写成trace，触发事件插在触发时刻
+static void flight_write(rtbw_flight *f, const flight_job *j) {
+    const rtbw_sample *b = f->buf[j->buf];
+    uint64_t cap = f->mask + 1;
+    uint64_t first = j->head > cap ? j->head - cap : 0;
+    uint64_t from = j->trig_tsc > f->pre ? j->trig_tsc - f->pre : 0;
+    while (first < j->head && b[first & f->mask].tsc < from)
+        first++;
+    if (first == j->head)
+        return;
+
+    // 触发时刻的实时时间（由当前的TSC/实时时钟对应关系推算）
+    struct timespec ts;
+    uint64_t now_tsc = rtbw_rdtscp();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    time_t trig_s = ts.tv_sec - (time_t)((double)(int64_t)(now_tsc - j->trig_tsc) / f->tsc_hz + 0.5);
+    struct tm tm;
+    char time_buf[32], path[512];
+    localtime_r(&trig_s, &tm);
+    strftime(time_buf, sizeof(time_buf), "%Y%m%d-%H%M%S", &tm);
+    snprintf(path, sizeof(path), "%s/rtbw-flight-%s-%lu.trc", f->cfg.dir, time_buf, f->dumps);
+
+    rtbw_trace_writer *w = rtbw_trace_create(path, f->e);
+    if (!w)
+        return;
+    rtbw_trace_backfill(w, b[first & f->mask].tsc);
+    rtbw_sample ev = {
+        .tsc = j->trig_tsc, .tx = j->kind | (uint64_t)j->target << 8, .rx = (uint64_t)(j->mbps + 0.5),
+        .target = RTBW_TARGET_TRIGGER,
+    };
+    int ev_done = 0;
+    for (uint64_t k = first; k < j->head; k++) {
+        const rtbw_sample *r = &b[k & f->mask];
+        if (!ev_done && r->tsc > j->trig_tsc) {
+            rtbw_trace_add(w, &ev);
+            ev_done = 1;
+        }
+        rtbw_trace_add(w, r);
+    }
+    if (!ev_done)
+        rtbw_trace_add(w, &ev);
+    if (rtbw_trace_close(w, f->tsc_hz) < 0) {
+        fprintf(stderr, "飞行记录写入失败：%s\n", path);
+        return;
+    }
+    strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("[%s] 飞行记录：%s（%s", time_buf, rtbw_flight_kind_name(j->kind),
+           j->kind == RTBW_TRIG_EXTERNAL ? "SIGUSR1/FIFO" : f->e->target_name[j->target]);
+    if (j->kind == RTBW_TRIG_ABOVE || j->kind == RTBW_TRIG_BELOW)
+        printf("，%.2f Gbps", j->mbps / 1000.0);
+    printf("），触发前 %.3f 秒、后 %.3f 秒共 %lu 条记录写入 %s\n",
+           (double)(j->trig_tsc - b[first & f->mask].tsc) / f->tsc_hz,
+           (double)(b[(j->head - 1) & f->mask].tsc - j->trig_tsc) / f->tsc_hz, j->head - first, path);
+    fflush(stdout);
+}
+
+static void *flight_dump_main(void *arg) {
+    rtbw_flight *f = arg;
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        while (!f->pending && !f->done)
+            pthread_cond_wait(&f->cond, &f->lock);
+        if (!f->pending)
+            break;
+        flight_job job = f->job;
+        f->pending = 0;
+        pthread_mutex_unlock(&f->lock);
+
+        flight_write(f, &job);
+
+        pthread_mutex_lock(&f->lock);
+        f->dumps++;
+        __atomic_store_n(&f->busy, 0, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+
+// FIFO每次可读即触发一次（O_RDWR打开，写端全部关闭后不会读到EOF）；停止管道的写端关闭时退出
+static void *flight_fifo_main(void *arg) {
+    rtbw_flight *f = arg;
+    struct pollfd pfd[2] = {
+        { .fd = f->fifo_fd, .events = POLLIN },
+        { .fd = f->fifo_stop[0], .events = POLLIN },
+    };
+    char buf[64];
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll trigger fifo failed");
+            break;
+        }
+        if (pfd[1].revents)
+            break;
+        if (!(pfd[0].revents & POLLIN))
+            continue;
+        ssize_t n = read(f->fifo_fd, buf, sizeof(buf));
+        if (n > 0) {
+            external_requested = 1;
+        } else if (n < 0 && errno != EINTR && errno != EAGAIN) {
+            perror("read trigger fifo failed");
+            break;
+        }
+    }
+    return NULL;
+}
+
+// ==================== 报告线程 ====================
+
+static void flight_fire(rtbw_flight *f, uint64_t tsc, int kind, uint32_t target, double mbps) {
+    if (f->trig_tsc)                // 正在记录触发后的数据，并入同一次
+        return;
+    if (__atomic_load_n(&f->busy, __ATOMIC_ACQUIRE)) {
+        f->suppressed++;
+        return;
+    }
+    f->trig_tsc = tsc;
+    f->trig_kind = kind;
+    f->trig_target = target;
+    f->trig_mbps = mbps;
+}
+
+// 冻结live缓冲区交给转储线程，换用另一个缓冲区（此时转储线程一定没有持有它）
+static void flight_freeze(rtbw_flight *f) {
+    pthread_mutex_lock(&f->lock);
+    f->job = (flight_job) {
+        .buf = f->live, .head = f->head, .trig_tsc = f->trig_tsc,
+        .kind = f->trig_kind, .target = f->trig_target, .mbps = f->trig_mbps,
+    };
+    f->pending = 1;
+    __atomic_store_n(&f->busy, 1, __ATOMIC_RELAXED);
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    f->live ^= 1;
+    f->head = 0;
+    f->trig_tsc = 0;
+}
+
+// 一个目标的成功读取：计数器倒退和窗口速率条件
+static void flight_check(rtbw_flight *f, const rtbw_sample *r) {
+    flight_target *t = &f->t[r->target];
+    if (t->valid && r->tsc > t->tsc) {
+        if (r->tx < t->tx || r->rx < t->rx) {
+            if (f->cfg.backwards)
+                flight_fire(f, r->tsc, RTBW_TRIG_BACKWARDS, r->target, 0);
+        } else {
+            t->win_tx += r->tx - t->tx;
+            t->win_rx += r->rx - t->rx;
+        }
+        if (!t->win_start)
+            t->win_start = t->tsc;
+        uint64_t elapsed = r->tsc - t->win_start;
+        if (elapsed >= f->window) {
+            uint64_t words = t->win_tx > t->win_rx ? t->win_tx : t->win_rx;
+            double mbps = words * 32.0 * f->tsc_hz / elapsed / 1e6;
+            int above = f->above_mbps > 0 && mbps >= f->above_mbps;
+            int below = f->below_mbps > 0 && mbps <= f->below_mbps;
+            if (above && !t->above)
+                flight_fire(f, r->tsc, RTBW_TRIG_ABOVE, r->target, mbps);
+            if (below && !t->below)
+                flight_fire(f, r->tsc, RTBW_TRIG_BELOW, r->target, mbps);
+            t->above = above;
+            t->below = below;
+            t->win_start = r->tsc;
+            t->win_tx = t->win_rx = 0;
+        }
+    }
+    t->tsc = r->tsc;
+    t->tx = r->tx;
+    t->rx = r->rx;
+    t->valid = 1;
+}
+
+void rtbw_flight_add(rtbw_flight *f, const rtbw_sample *r) {
+    f->buf[f->live][f->head++ & f->mask] = *r;
+    if (external_requested) {
+        external_requested = 0;
+        flight_fire(f, r->tsc, RTBW_TRIG_EXTERNAL, 0, 0);
+    }
+    if (r->target < f->e->nr_targets) {
+        if (r->err == 0)
+            flight_check(f, r);
+        else
+            f->t[r->target].valid = 0;
+    }
+    if (f->trig_tsc && r->tsc >= f->trig_tsc + f->post)
+        flight_freeze(f);
+}
+
+uint64_t rtbw_flight_suppressed(rtbw_flight *f) {
+    return f->suppressed;
+}
+
+// ==================== 创建/关闭 ====================
+
+// 让转储线程写完进行中的转储后退出，并销毁锁
+static void flight_stop_dump(rtbw_flight *f) {
+    pthread_mutex_lock(&f->lock);
+    f->done = 1;
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    pthread_join(f->thread, NULL);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->cond);
+}
+
+rtbw_flight *rtbw_flight_create(const rtbw_flight_config *cfg, const rtbw_engine *e, uint64_t period_ns) {
+    rtbw_flight *f = calloc(1, sizeof(*f));
+    if (!f) {
+        perror("alloc flight recorder failed");
+        return NULL;
+    }
+    f->cfg = *cfg;
+    f->e = e;
+    f->tsc_hz = rtbw_clock_hz();
+    f->pre = cfg->pre_s * f->tsc_hz;
+    f->post = cfg->post_s * f->tsc_hz;
+    f->window = cfg->window_ns * f->tsc_hz / 1e9;
+    f->above_mbps = cfg->above_gbps * 1000;
+    f->below_mbps = cfg->below_gbps * 1000;
+    // 触发状态从“满足”开始，below只在速率先高于阈值后才会触发
+    for (int i = 0; i < e->nr_targets; i++)
+        f->t[i].below = 1;
+    f->fifo_fd = -1;
+
+    // 1. 缓冲区：按标称采样数留余量，向上取2的幂；页面首次写入时才分配
+    double records = (cfg->pre_s + cfg->post_s) * 1e9 / period_ns * e->nr_targets * FLIGHT_CAP_MARGIN + 1024;
+    uint64_t cap = 1;
+    while (cap < records)
+        cap <<= 1;
+    f->mask = cap - 1;
+    f->buf_bytes = cap * sizeof(rtbw_sample);
+    if (f->buf_bytes > RTBW_FLIGHT_MAX_BYTES) {
+        fprintf(stderr, "飞行记录缓冲区过大（%.0f MB，上限 %llu MB），请减小pre/post或加大采样周期\n",
+                f->buf_bytes / 1e6, RTBW_FLIGHT_MAX_BYTES >> 20);
+        free(f);
+        return NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        f->buf[i] = rtbw_numa_alloc(f->buf_bytes, e->node);
+        if (!f->buf[i]) {
+            perror("alloc flight buffer failed");
+            rtbw_numa_free(f->buf[0], f->buf_bytes);
+            free(f);
+            return NULL;
+        }
+    }
+
+    // 2. 转储线程
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->cond, NULL);
+    if (pthread_create(&f->thread, NULL, flight_dump_main, f) != 0) {
+        perror("pthread_create flight dump failed");
+        pthread_mutex_destroy(&f->lock);
+        pthread_cond_destroy(&f->cond);
+        goto fail_buf;
+    }
+
+    // 3. 外部触发：SIGUSR1，可选FIFO
+    if (cfg->fifo) {
+        if (mkfifo(cfg->fifo, 0600) < 0 && errno != EEXIST) {
+            perror("mkfifo trigger failed");
+            goto fail;
+        }
+        f->fifo_fd = open(cfg->fifo, O_RDWR | O_CLOEXEC);
+        if (f->fifo_fd < 0) {
+            perror("open trigger fifo failed");
+            goto fail;
+        }
+        if (pipe2(f->fifo_stop, O_CLOEXEC) < 0) {
+            perror("pipe trigger fifo failed");
+            goto fail;
+        }
+        if (pthread_create(&f->fifo_thread, NULL, flight_fifo_main, f) != 0) {
+            perror("pthread_create trigger fifo failed");
+            close(f->fifo_stop[0]);
+            close(f->fifo_stop[1]);
+            goto fail;
+        }
+    }
+    struct sigaction sa = { .sa_handler = on_trigger_signal, .sa_flags = SA_RESTART };
+    sigaction(SIGUSR1, &sa, NULL);
+    return f;
+fail:
+    if (f->fifo_fd >= 0)
+        close(f->fifo_fd);
+    flight_stop_dump(f);
+fail_buf:
+    for (int i = 0; i < 2; i++)
+        rtbw_numa_free(f->buf[i], f->buf_bytes);
+    free(f);
+    return NULL;
+}
+
+void rtbw_flight_close(rtbw_flight *f) {
+    if (f->fifo_fd >= 0) {
+        close(f->fifo_stop[1]);
+        pthread_join(f->fifo_thread, NULL);
+        close(f->fifo_stop[0]);
+        close(f->fifo_fd);
+    }
+    flight_stop_dump(f);
+    for (int i = 0; i < 2; i++)
+        rtbw_numa_free(f->buf[i], f->buf_bytes);
+    free(f);
+}
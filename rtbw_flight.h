@@ -0,0 +1,76 @@
+#ifndef RTBW_FLIGHT_H
+#define RTBW_FLIGHT_H
+
+#include <stdint.h>
+#include "rtbw_spsc.h"
+#include "rtbw_engine.h"
+
+// 飞行记录：内存中固定大小的环形缓冲区保存最近pre+post秒的原始采样，触发时把触发前pre秒
+// 和触发后post秒的采样转储为trace文件（格式同-w，可用rtbw_dump查看或synth回放）
+// 1. 报告线程逐条写入环形缓冲区并判断触发条件，采样线程不参与
+// 2. 触发条件：
+//      above/below：某目标在一个窗口（win，默认100us，连续不重叠）内RX或TX的较大值不低于/不高于
+//        阈值；只在条件从不满足变为满足时触发一次（below要求之前高于阈值，空闲链路不会反复触发）
+//      back：计数器倒退（相邻两次成功读取的TX或RX变小）
+//      外部：SIGUSR1，或向fifo写入任意内容（FIFO不存在时自动创建）
+// 3. 触发后继续记录post秒，然后冻结：该缓冲区整体交给转储线程写盘，报告线程换用另一个缓冲区
+//    继续记录，冻结和写盘都不阻塞采样，事件前后没有缺口
+// 4. 同一时间只有一个转储；触发后的post秒内再次满足的条件并入同一次记录，
+//    上一次转储尚未写完时的触发被忽略并计数。刚换用的缓冲区是空的，
+//    紧接着的下一次触发可用的触发前数据不足pre秒
+
+#define RTBW_FLIGHT_PRE_DFT 2.0                 // 默认触发前保留秒数
+#define RTBW_FLIGHT_POST_DFT 1.0                // 默认触发后记录秒数
+#define RTBW_FLIGHT_WINDOW_DFT 100000           // 速率条件的默认窗口（纳秒）
+#define RTBW_FLIGHT_MAX_BYTES (1ULL << 30)      // 单个环形缓冲区的上限（共两个）
+
+// 触发类型（触发事件记录tx的低8位）
+enum {
+    RTBW_TRIG_ABOVE = 1,
+    RTBW_TRIG_BELOW,
+    RTBW_TRIG_BACKWARDS,
+    RTBW_TRIG_EXTERNAL,
+};
+
+typedef struct {
+    double pre_s;
+    double post_s;
+    uint64_t window_ns;
+    double above_gbps;      // 0表示不检测
+    double below_gbps;      // 0表示不检测
+    int backwards;
+    const char *fifo;       // NULL表示不监听FIFO（SIGUSR1总是可用）
+    const char *dir;        // 转储文件目录
+} rtbw_flight_config;
+
+typedef struct rtbw_flight rtbw_flight;
+
+// 解析逗号分隔的 键=值 列表：pre=秒,post=秒,win=时长（ns/us/ms/s，缺省us）,above=Gbps,below=Gbps,
+// back,fifo=路径,dir=目录；出错打印原因并返回-1
+int rtbw_flight_parse(rtbw_flight_config *cfg, const char *spec);
+// 按采样周期（ns）和目标数分配缓冲区，启动转储线程并安装SIGUSR1；失败返回NULL
+rtbw_flight *rtbw_flight_create(const rtbw_flight_config *cfg, const rtbw_engine *e, uint64_t period_ns);
+// 记入一条记录（报告线程调用）
+void rtbw_flight_add(rtbw_flight *f, const rtbw_sample *r);
+// 上一次转储未写完而被忽略的触发次数（累计）
+uint64_t rtbw_flight_suppressed(rtbw_flight *f);
+// 等待进行中的转储写完（未到post秒的触发不再转储）
+void rtbw_flight_close(rtbw_flight *f);
+
+// 触发类型名称（rtbw_dump也使用）
+static inline const char *rtbw_flight_kind_name(int kind) {
+    switch (kind) {
+    case RTBW_TRIG_ABOVE:
+        return "速率高于阈值";
+    case RTBW_TRIG_BELOW:
+        return "速率低于阈值";
+    case RTBW_TRIG_BACKWARDS:
+        return "计数器倒退";
+    case RTBW_TRIG_EXTERNAL:
+        return "外部触发";
+    default:
+        return "未知";
+    }
+}
+
+#endif // RTBW_FLIGHT_H
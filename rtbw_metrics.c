@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rtbw_metrics.h"
+
+#define METRICS_REQ_TIMEOUT_MS 1000    // 等待HTTP请求的最长时间，避免一个慢连接卡住线程
+
+rtbw_metrics *rtbw_metrics_create(const char *shm_name, const rtbw_engine *e) {
+    uint32_t nr = e->nr_targets + 1;
+    size_t size = sizeof(rtbw_metrics) + nr * sizeof(rtbw_metrics_series);
+    rtbw_metrics *m;
+
+    if (shm_name) {
+        int fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror("shm_open metrics failed");
+            return NULL;
+        }
+        if (ftruncate(fd, size) < 0) {
+            perror("ftruncate metrics failed");
+            close(fd);
+            return NULL;
+        }
+        m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m == MAP_FAILED) {
+            perror("mmap metrics failed");
+            return NULL;
+        }
+    } else {
+        m = calloc(1, size);
+        if (!m) {
+            perror("alloc metrics failed");
+            return NULL;
+        }
+    }
+
+    // 段头和名称只在这里写一次，magic最后写，读者看到magic时其余字段已就绪
+    m->version = RTBW_METRICS_VERSION;
+    m->size = size;
+    m->nr_series = nr;
+    m->pid = getpid();
+    snprintf(m->backend, sizeof(m->backend), "%s", e->backend->name);
+    for (uint32_t i = 0; i < nr; i++) {
+        rtbw_metrics_series *s = &m->series[i];
+        if (i < (uint32_t)e->nr_targets) {
+            memcpy(s->name, e->target_name[i], RTBW_NAME_LEN);
+            s->vport = e->target_vport[i];
+        } else {
+            snprintf(s->name, sizeof(s->name), "node");
+        }
+    }
+    __atomic_store_n(&m->magic, RTBW_METRICS_MAGIC, __ATOMIC_RELEASE);
+    return m;
+}
+
+void rtbw_metrics_close(rtbw_metrics *m, const char *shm_name) {
+    if (shm_name) {
+        shm_unlink(shm_name);
+        munmap(m, m->size);
+    } else {
+        free(m);
+    }
+}
+
+// ==================== Prometheus文本格式 ====================
+
+// 标签值中的反斜杠、引号和换行需要转义
+static void put_label(FILE *f, const char *v) {
+    for (; *v; v++) {
+        if (*v == '\\' || *v == '"')
+            fputc('\\', f);
+        if (*v == '\n') {
+            fputs("\\n", f);
+            continue;
+        }
+        fputc(*v, f);
+    }
+}
+
+static void put_dir(FILE *f, const rtbw_metrics_series *s, const char *dir, const rtbw_metrics_dir *d) {
+    static const char *const stat[] = { "max", "mean", "p50", "p99", "p999" };
+    const double v[] = { d->max, d->mean, d->p50, d->p99, d->p999 };
+    for (int k = 0; k < 5; k++) {
+        fputs("rtbw_bandwidth_gbps{target=\"", f);
+        put_label(f, s->name);
+        fprintf(f, "\",dir=\"%s\",stat=\"%s\"} %.6g\n", dir, stat[k], v[k]);
+    }
+}
+
+static void format_metrics(FILE *f, const rtbw_metrics *m) {
+    fputs("# HELP rtbw_bandwidth_gbps Bandwidth of the last report window.\n"
+          "# TYPE rtbw_bandwidth_gbps gauge\n", f);
+    for (uint32_t i = 0; i < m->nr_series; i++) {
+        put_dir(f, &m->series[i], "rx", &m->series[i].rx);
+        put_dir(f, &m->series[i], "tx", &m->series[i].tx);
+    }
+    fputs("# HELP rtbw_window_samples Rate samples in the last report window.\n"
+          "# TYPE rtbw_window_samples gauge\n", f);
+    for (uint32_t i = 0; i < m->nr_series; i++) {
+        fputs("rtbw_window_samples{target=\"", f);
+        put_label(f, m->series[i].name);
+        fprintf(f, "\"} %u\n", m->series[i].samples);
+    }
+    fprintf(f, "# TYPE rtbw_window_seconds gauge\nrtbw_window_seconds %.6f\n", m->window_s);
+    fprintf(f, "# TYPE rtbw_window_end_seconds gauge\nrtbw_window_end_seconds %.3f\n", m->window_end_ns / 1e9);
+    fprintf(f, "# TYPE rtbw_windows_total counter\nrtbw_windows_total %" PRIu64 "\n", m->windows);
+    fprintf(f, "# TYPE rtbw_sampler_dropped_rounds_total counter\nrtbw_sampler_dropped_rounds_total %" PRIu64 "\n", m->dropped);
+    fprintf(f, "# TYPE rtbw_sampler_missed_deadlines_total counter\nrtbw_sampler_missed_deadlines_total %" PRIu64 "\n", m->missed);
+    fprintf(f, "# TYPE rtbw_backend_lost_samples_total counter\nrtbw_backend_lost_samples_total %" PRIu64 "\n", m->lost);
+    fprintf(f, "# TYPE rtbw_trace_dropped_records_total counter\nrtbw_trace_dropped_records_total %" PRIu64 "\n", m->trace_dropped);
+    fprintf(f, "# TYPE rtbw_sampler_period_ns gauge\nrtbw_sampler_period_ns %" PRIu64 "\n", m->period_ns);
+    fprintf(f, "# TYPE rtbw_sampler_period_changes_total counter\nrtbw_sampler_period_changes_total %" PRIu64 "\n",
+            m->period_changes);
+    fprintf(f, "# TYPE rtbw_sampler_interval_us gauge\n"
+            "rtbw_sampler_interval_us{stat=\"p99\"} %.3f\nrtbw_sampler_interval_us{stat=\"max\"} %.3f\n",
+            m->interval_p99_us, m->interval_max_us);
+    fprintf(f, "# TYPE rtbw_sampler_read_us gauge\nrtbw_sampler_read_us{stat=\"p99\"} %.3f\n", m->read_p99_us);
+    fprintf(f, "# TYPE rtbw_sampler_stalls_total counter\nrtbw_sampler_stalls_total %" PRIu64 "\n", m->stalls);
+    fprintf(f, "# TYPE rtbw_sampler_involuntary_switches_total counter\n"
+            "rtbw_sampler_involuntary_switches_total %" PRIu64 "\n", m->nivcsw);
+}
+
+// ==================== HTTP线程 ====================
+
+struct rtbw_metrics_server {
+    const rtbw_metrics *m;
+    int fd;
+    int stop;                           // 置位后accept失败时线程退出
+    pthread_t thread;
+};
+
+static void write_all(int fd, const char *buf, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= n;
+    }
+}
+
+// 只支持 GET /metrics（其他路径返回404），每个连接一个请求
+static void serve_one(rtbw_metrics_server *srv, int c, void *snap) {
+    char req[1024];
+    ssize_t n = read(c, req, sizeof(req) - 1);
+    if (n <= 0)
+        return;
+    req[n] = '\0';
+    if (strncmp(req, "GET /metrics", 12) != 0 || (req[12] != ' ' && req[12] != '?')) {
+        static const char nf[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        write_all(c, nf, sizeof(nf) - 1);
+        return;
+    }
+    char *body = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&body, &len);
+    if (!f)
+        return;
+    if (rtbw_metrics_snapshot(srv->m, snap, srv->m->size) == 0)
+        format_metrics(f, snap);
+    fclose(f);
+    char head[160];
+    int hl = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n"
+                      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                      "Content-Length: %zu\r\n\r\n", len);
+    write_all(c, head, hl);
+    write_all(c, body, len);
+    free(body);
+}
+
+static void *metrics_server_main(void *arg) {
+    rtbw_metrics_server *srv = arg;
+    void *snap = malloc(srv->m->size);
+    if (!snap) {
+        perror("alloc metrics snapshot failed");
+        return NULL;
+    }
+    struct timeval tv = { .tv_sec = METRICS_REQ_TIMEOUT_MS / 1000,
+                          .tv_usec = METRICS_REQ_TIMEOUT_MS % 1000 * 1000 };
+    for (;;) {
+        int c = accept(srv->fd, NULL, NULL);
+        if (c < 0) {
+            if (__atomic_load_n(&srv->stop, __ATOMIC_ACQUIRE))
+                break;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("accept metrics failed");
+            break;
+        }
+        setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        serve_one(srv, c, snap);
+        close(c);
+    }
+    free(snap);
+    return NULL;
+}
+
+rtbw_metrics_server *rtbw_metrics_serve(const rtbw_metrics *m, int port) {
+    rtbw_metrics_server *srv = calloc(1, sizeof(*srv));
+    if (!srv) {
+        perror("alloc metrics server failed");
+        return NULL;
+    }
+    srv->m = m;
+    srv->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (srv->fd < 0) {
+        perror("socket metrics failed");
+        free(srv);
+        return NULL;
+    }
+    int one = 1;
+    setsockopt(srv->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    // 只监听本机回环地址
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(srv->fd, 16) < 0) {
+        perror("bind metrics port failed");
+        close(srv->fd);
+        free(srv);
+        return NULL;
+    }
+    if (pthread_create(&srv->thread, NULL, metrics_server_main, srv) != 0) {
+        perror("pthread_create metrics server failed");
+        close(srv->fd);
+        free(srv);
+        return NULL;
+    }
+    return srv;
+}
+
+void rtbw_metrics_server_close(rtbw_metrics_server *srv) {
+    // shutdown让阻塞在accept上的线程立即返回，之后再关闭描述符，端口可以马上重新绑定
+    __atomic_store_n(&srv->stop, 1, __ATOMIC_RELEASE);
+    shutdown(srv->fd, SHUT_RDWR);
+    pthread_join(srv->thread, NULL);
+    close(srv->fd);
+    free(srv);
+}
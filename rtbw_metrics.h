@@ -0,0 +1,113 @@
+#ifndef RTBW_METRICS_H
+#define RTBW_METRICS_H
+
+#include <stdint.h>
+#include <string.h>
+#include "rtbw_engine.h"
+
+// 共享内存指标段：报告线程每个打印周期结束时发布一次各序列的峰值/分位数/采样数和丢弃计数
+// 1. 段为POSIX共享内存（shm_open，如/rtbw），布局 = rtbw_metrics + nr_series个rtbw_metrics_series，
+//    最后一个序列为节点汇总；magic/version/size/nr_series/名称在创建后不再变化
+// 2. 顺序锁：写者先把seq加一（奇数表示正在写），写完再加一；读者复制整个段，
+//    前后两次读到相同的偶数seq才算一致的快照。读者不需要系统调用，也不会阻塞写者
+// 3. 采样线程不参与发布，报告线程每个周期只多做一次拷贝量级的写入
+// 其他进程读取：shm_open(名称, O_RDONLY) + mmap(PROT_READ)，校验magic/version后用rtbw_metrics_snapshot
+
+#define RTBW_METRICS_MAGIC 0x4d574252u        // "RBWM"
+#define RTBW_METRICS_VERSION 3                // 2：增加采样周期；3：增加采样自检
+#define RTBW_METRICS_RETRIES 1000             // 写者异常退出（seq停在奇数）时读者放弃的次数
+
+typedef struct {
+    double max;             // Gbps
+    double mean;
+    double p50;
+    double p99;
+    double p999;
+} rtbw_metrics_dir;
+
+typedef struct {
+    char name[RTBW_NAME_LEN];
+    uint32_t vport;         // 0：PF或非SR-IOV目标；n：VF n-1
+    uint32_t samples;       // 本周期的速率采样数
+    rtbw_metrics_dir rx;
+    rtbw_metrics_dir tx;
+} rtbw_metrics_series;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                  // 整个段的字节数
+    uint32_t nr_series;             // 目标数 + 1（节点汇总）
+    uint32_t seq;                   // 顺序锁
+    uint32_t pid;                   // 发布者进程
+    char backend[16];
+    uint64_t windows;               // 已发布的周期数
+    uint64_t window_end_ns;         // 周期结束时刻（CLOCK_REALTIME）
+    double window_s;                // 周期长度（秒）
+    uint64_t dropped;               // 采样队列满丢弃的轮数（累计）
+    uint64_t missed;                // 采样错过截止时间次数（累计）
+    uint64_t lost;                  // 后端丢失的采样数（累计）
+    uint64_t trace_dropped;         // trace写盘跟不上丢弃的记录数（累计）
+    uint64_t period_ns;             // 周期结束时的采样周期（纳秒，自适应采样时随流量变化）
+    uint64_t period_changes;        // 采样周期改变次数（累计）
+    double interval_p99_us;         // 本周期相邻两轮采样间隔的p99（微秒）
+    double interval_max_us;         // 本周期最长的采样间隔（微秒）
+    double read_p99_us;             // 本周期读计数器耗时的p99（微秒）
+    uint64_t stalls;                // 采样间隔超过周期2倍的次数（累计）
+    uint64_t nivcsw;                // 采样线程的非自愿上下文切换（累计，读取失败时为0）
+    rtbw_metrics_series series[];
+} rtbw_metrics;
+
+// 写者：begin/end之间更新段内的数据
+static inline void rtbw_metrics_begin(rtbw_metrics *m) {
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void rtbw_metrics_end(rtbw_metrics *m) {
+    __atomic_store_n(&m->seq, m->seq + 1, __ATOMIC_RELEASE);
+}
+
+// 读者：把一致的快照复制到dst（至少m->size字节），返回0；写者一直未完成时返回-1
+static inline int rtbw_metrics_snapshot(const rtbw_metrics *m, void *dst, uint32_t size) {
+    for (int i = 0; i < RTBW_METRICS_RETRIES; i++) {
+        uint32_t s1 = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+        if (s1 & 1) {
+            __builtin_ia32_pause();
+            continue;
+        }
+        memcpy(dst, (const void *)m, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&m->seq, __ATOMIC_RELAXED) == s1)
+            return 0;
+    }
+    return -1;
+}
+
+// 读者（不复制）：在begin和retry之间直接读段内的字段，retry返回非0时读到的可能不一致，重读。
+// 写者异常退出时begin一直等待，读其他进程的段时用有重试上限的rtbw_metrics_snapshot
+static inline uint32_t rtbw_metrics_read_begin(const rtbw_metrics *m) {
+    uint32_t s;
+    while ((s = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE)) & 1)
+        __builtin_ia32_pause();
+    return s;
+}
+
+static inline int rtbw_metrics_read_retry(const rtbw_metrics *m, uint32_t s) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&m->seq, __ATOMIC_RELAXED) != s;
+}
+
+typedef struct rtbw_metrics_server rtbw_metrics_server;
+
+// 创建指标段：shm_name为NULL时只在进程内分配（供-H的HTTP线程和rtbw_latest使用）
+rtbw_metrics *rtbw_metrics_create(const char *shm_name, const rtbw_engine *e);
+// 启动HTTP线程，在127.0.0.1:port以Prometheus文本格式提供同样的数据；失败返回NULL
+rtbw_metrics_server *rtbw_metrics_serve(const rtbw_metrics *m, int port);
+// 关闭监听套接字并等待HTTP线程退出（正在处理的请求最多等待一个请求超时）
+void rtbw_metrics_server_close(rtbw_metrics_server *srv);
+// 删除共享内存名称并解除映射或释放段（其他进程已映射的读者仍可读到最后一次发布的数据）；
+// 调用前须先关闭使用该段的HTTP线程
+void rtbw_metrics_close(rtbw_metrics *m, const char *shm_name);
+
+#endif // RTBW_METRICS_H
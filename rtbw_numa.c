@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "rtbw_numa.h"
+
+#define NUMA_HUGE_SIZE (2UL << 20)      // 分配长度按2MB大页对齐
+#define NUMA_MAX_NODES 1024
+
+// 读取一行sysfs文本，失败返回-1
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    int ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    if (!ok)
+        return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// 解析CPU列表（如 0-15,32-47），加入set
+static int parse_cpulist(const char *s, cpu_set_t *set) {
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10), b = a;
+        if (end == s)
+            return -1;
+        if (*end == '-') {
+            s = end + 1;
+            b = strtol(s, &end, 10);
+            if (end == s)
+                return -1;
+        }
+        for (long c = a; c <= b && c < CPU_SETSIZE; c++)
+            CPU_SET(c, set);
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',')
+            return -1;
+    }
+    return 0;
+}
+
+static int read_cpulist(const char *path, cpu_set_t *set) {
+    char buf[4096];
+    CPU_ZERO(set);
+    if (read_line(path, buf, sizeof(buf)) < 0)
+        return -1;
+    return parse_cpulist(buf, set);
+}
+
+int rtbw_numa_device_node(const char *dev_sysfs) {
+    char path[512], buf[32];
+    if (!dev_sysfs)
+        return -1;
+    snprintf(path, sizeof(path), "%s/numa_node", dev_sysfs);
+    if (read_line(path, buf, sizeof(buf)) < 0)
+        return -1;
+    return atoi(buf);
+}
+
+void rtbw_numa_local_cpus(const char *dev_sysfs, cpu_set_t *set) {
+    cpu_set_t allowed, local;
+    char path[512];
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        CPU_ZERO(&allowed);
+        for (long c = 0; c < sysconf(_SC_NPROCESSORS_ONLN) && c < CPU_SETSIZE; c++)
+            CPU_SET(c, &allowed);
+    }
+    *set = allowed;
+    if (!dev_sysfs)
+        return;
+    snprintf(path, sizeof(path), "%s/local_cpulist", dev_sysfs);
+    if (read_cpulist(path, &local) < 0)
+        return;
+    CPU_AND(&local, &local, &allowed);
+    if (CPU_COUNT(&local))   // 本地CPU都不允许使用时退回全部允许的CPU
+        *set = local;
+}
+
+// 同一物理核的其他SMT线程是否都是隔离的（或没有SMT），这样采样线程不与其他任务共享执行单元
+static int siblings_quiet(int cpu, const cpu_set_t *isolated) {
+    char path[128];
+    cpu_set_t sib;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (read_cpulist(path, &sib) < 0)
+        return 1;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (c != cpu && CPU_ISSET(c, &sib) && !CPU_ISSET(c, isolated))
+            return 0;
+    return 1;
+}
+
+int rtbw_numa_pick_core(const char *dev_sysfs) {
+    cpu_set_t cand, isolated;
+    int best = -1, best_score = -1;
+    rtbw_numa_local_cpus(dev_sysfs, &cand);
+    if (read_cpulist("/sys/devices/system/cpu/isolated", &isolated) < 0)
+        CPU_ZERO(&isolated);
+
+    // 1. 隔离的CPU没有其他任务和周期性干扰，权重最高
+    // 2. 其次要求SMT兄弟空闲；CPU 0通常承担中断和内核线程，只在没有其他选择时使用
+    // 3. 同分时取编号最大的（与原先默认的最后一个核一致）
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, &cand))
+            continue;
+        int score = (CPU_ISSET(c, &isolated) ? 4 : 0) + (siblings_quiet(c, &isolated) ? 2 : 0) + (c != 0);
+        if (score >= best_score) {
+            best = c;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void *rtbw_numa_alloc(size_t size, int node) {
+    size = (size + NUMA_HUGE_SIZE - 1) & ~(NUMA_HUGE_SIZE - 1);
+    // 1. 预留的大页（hugetlbfs池），没有预留时mmap失败
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        // 2. 普通匿名内存，请求透明大页
+        p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        madvise(p, size, MADV_HUGEPAGE);
+    }
+    // 3. 绑定到设备节点（首次写入时才分配页面，因此必须在写入之前设置）
+    if (node >= 0 && node < NUMA_MAX_NODES) {
+        unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+        mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+        if (syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, NUMA_MAX_NODES, 0) < 0)
+            perror("mbind failed");
+    }
+    return p;
+}
+
+void rtbw_numa_free(void *p, size_t size) {
+    if (!p)
+        return;
+    size = (size + NUMA_HUGE_SIZE - 1) & ~(NUMA_HUGE_SIZE - 1);
+    munmap(p, size);
+}
@@ -0,0 +1,27 @@
+#ifndef RTBW_NUMA_H
+#define RTBW_NUMA_H
+
+#include <stddef.h>
+#include <sched.h>
+
+// NUMA放置：采样线程和缓冲区跟随被监控网卡所在的节点
+// 1. 设备节点和本地CPU来自PCI设备的sysfs目录（numa_node、local_cpulist）
+// 2. 选核：只在进程允许的CPU中选，优先本地 > 隔离（isolcpus）> 同一物理核的SMT兄弟都空闲 > 编号大
+// 3. 缓冲区用匿名mmap分配：优先大页（MAP_HUGETLB，其次透明大页），mbind到设备节点，
+//    页面在第一次写入时才分配，启动时不清零、不逐页触发缺页
+// 不依赖libnuma，直接使用mbind系统调用
+
+#define RTBW_CORE_AUTO (-2)        // 按设备位置自动选核
+#define RTBW_CORE_NONE (-1)        // 不绑核
+
+// 设备所在节点，未知（非NUMA机器或没有设备目录）返回-1
+int rtbw_numa_device_node(const char *dev_sysfs);
+// 设备本地的CPU（与进程允许的CPU取交集）；dev_sysfs为NULL或没有本地信息时为全部允许的CPU
+void rtbw_numa_local_cpus(const char *dev_sysfs, cpu_set_t *set);
+// 为采样线程选一个核心，没有可用核心返回-1
+int rtbw_numa_pick_core(const char *dev_sysfs);
+// 在node上分配size字节（node<0时不指定节点），失败返回NULL；内容为零
+void *rtbw_numa_alloc(size_t size, int node);
+void rtbw_numa_free(void *p, size_t size);
+
+#endif // RTBW_NUMA_H
@@ -0,0 +1,35 @@
+#include <cpuid.h>
+#include <string.h>
+#include <time.h>
+#include "rtbw_sched.h"
+
+// CPUID.(EAX=7,ECX=0):ECX[5] = WAITPKG（tpause/umonitor/umwait）
+int rtbw_sched_has_tpause(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ecx >> 5) & 1;
+}
+
+void rtbw_sched_init(rtbw_sched *s, uint64_t period_ns, double tsc_hz, rtbw_idle_mode idle) {
+    memset(s, 0, sizeof(*s));
+    s->cycles_per_ns = tsc_hz / 1e9;
+    s->period = (uint64_t)(period_ns * tsc_hz / 1e9);
+    if (s->period == 0)
+        s->period = 1;
+    if (idle == RTBW_IDLE_TPAUSE && !rtbw_sched_has_tpause())
+        idle = RTBW_IDLE_PAUSE;
+    s->idle = idle;
+    s->next = rtbw_rdtsc() + s->period;
+}
+
+void rtbw_sched_enable_sleep(rtbw_sched *s) {
+    s->sleep_min = (uint64_t)(2 * RTBW_SLEEP_MARGIN_NS * s->cycles_per_ns);
+}
+
+void rtbw_sched_sleep(rtbw_sched *s, uint64_t cycles) {
+    uint64_t ns = (uint64_t)(cycles / s->cycles_per_ns);
+    struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+    clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
+}
@@ -0,0 +1,89 @@
+#ifndef RTBW_SCHED_H
+#define RTBW_SCHED_H
+
+#include <stdint.h>
+#include "rtbw_clock.h"
+
+// 固定周期采样调度：按绝对TSC截止时间采样，采样间距不受CPU频率、SMT负载和ioctl耗时影响
+// 1. 截止时间在固定网格上推进（next += period），误差不累积
+// 2. 读计数器的时间戳取读前后的中点，因此提前“半个读延迟”开始读，使中点落在截止时间上
+//    （读延迟用EWMA估计）
+// 3. 读完时已经越过下一个截止时间则跳过整数个周期并计入missed，不补采
+// 4. 等待方式：纯自旋 / pause / tpause（CPU支持WAITPKG时进入C0.1轻度休眠，降低功耗）
+// 5. 自适应采样放宽周期后，剩余时间足够长时先用clock_nanosleep睡到截止时间前RTBW_SLEEP_MARGIN_NS，
+//    再按上面的方式等完剩余部分；最细周期下剩余时间不够，仍然只自旋
+
+typedef enum {
+    RTBW_IDLE_SPIN,
+    RTBW_IDLE_PAUSE,
+    RTBW_IDLE_TPAUSE,
+} rtbw_idle_mode;
+
+typedef struct {
+    uint64_t period;        // 周期（TSC周期）
+    uint64_t next;          // 下一个截止时间（TSC）
+    uint64_t half_read;     // 读延迟一半的EWMA（TSC周期，定点 <<4）
+    uint64_t missed;        // 错过的截止时间数（采样线程写，报告线程读）
+    rtbw_idle_mode idle;
+    double cycles_per_ns;   // TSC频率（GHz），换算周期和睡眠时长
+    uint64_t sleep_min;     // 剩余时间超过此值（TSC周期）才睡眠，0不睡眠
+} rtbw_sched;
+
+#define RTBW_TPAUSE_MIN_CYCLES 2000   // 剩余时间少于此值时改用pause，避免唤醒延迟越过截止时间
+#define RTBW_TPAUSE_MARGIN 1000       // tpause提前醒来的余量
+#define RTBW_SLEEP_MARGIN_NS 50000    // 睡眠提前醒来的余量（定时器到期 + 唤醒调度的延迟）
+
+// tpause：睡到TSC达到deadline或被中断，ecx=1选择唤醒更快的C0.1
+static inline void rtbw_tpause(uint64_t deadline) {
+    __asm__ __volatile__ (".byte 0x66, 0x0f, 0xae, 0xf1"   // tpause %ecx
+                          : : "c"(1), "a"((uint32_t)deadline), "d"((uint32_t)(deadline >> 32))
+                          : "cc");
+}
+
+int rtbw_sched_has_tpause(void);
+void rtbw_sched_init(rtbw_sched *s, uint64_t period_ns, double tsc_hz, rtbw_idle_mode idle);
+// 允许长等待时睡眠（自适应采样启用时调用）
+void rtbw_sched_enable_sleep(rtbw_sched *s);
+// 睡眠cycles个TSC周期（相对CLOCK_MONOTONIC，被信号打断时提前返回）
+void rtbw_sched_sleep(rtbw_sched *s, uint64_t cycles);
+
+// 等待到本次采样应开始读计数器的时刻
+static inline void rtbw_sched_wait(rtbw_sched *s) {
+    uint64_t start = s->next - (s->half_read >> 4);
+    uint64_t now;
+    while ((now = rtbw_rdtsc()) < start) {
+        if (s->sleep_min && start - now > s->sleep_min)
+            rtbw_sched_sleep(s, start - now - s->sleep_min / 2);
+        else if (s->idle == RTBW_IDLE_TPAUSE && start - now > RTBW_TPAUSE_MIN_CYCLES)
+            rtbw_tpause(start - RTBW_TPAUSE_MARGIN);
+        else if (s->idle != RTBW_IDLE_SPIN)
+            __asm__ __volatile__ ("pause");
+    }
+}
+
+// 一次读取完成：更新读延迟估计，推进截止时间
+static inline void rtbw_sched_done(rtbw_sched *s, uint64_t t_begin, uint64_t t_end) {
+    uint64_t half = (t_end - t_begin) >> 1;
+    s->half_read += half - (s->half_read >> 4);   // EWMA，alpha = 1/16
+    s->next += s->period;
+    if (t_end > s->next) {
+        uint64_t skip = (t_end - s->next) / s->period + 1;
+        s->next += skip * s->period;
+        __atomic_store_n(&s->missed, s->missed + skip, __ATOMIC_RELAXED);
+    }
+}
+
+// 改变周期：下一个截止时间改为上一个截止时间 + 新周期（缩短时可能已经到期，立即采样）
+static inline void rtbw_sched_set_period(rtbw_sched *s, uint64_t period_ns) {
+    uint64_t period = (uint64_t)(period_ns * s->cycles_per_ns);
+    if (period == 0)
+        period = 1;
+    s->next = s->next - s->period + period;
+    s->period = period;
+}
+
+static inline uint64_t rtbw_sched_missed(rtbw_sched *s) {
+    return __atomic_load_n(&s->missed, __ATOMIC_RELAXED);
+}
+
+#endif // RTBW_SCHED_H
@@ -0,0 +1,115 @@
+#ifndef RTBW_SPSC_H
+#define RTBW_SPSC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 采样线程 → 报告线程的单生产者/单消费者无锁环（wait-free）
+// 生产者只写head，消费者只写tail，各自缓存对方的位置，只有缓存显示满/空时才读取对方的cache line。
+// 采样线程只做：读计数器 → 写记录 → 发布head，所有统计、格式化和I/O都在报告线程完成。
+
+// 原始采样记录（一次读计数器对每个目标各一条，同一轮的记录tsc相同）
+typedef struct {
+    uint64_t tsc;       // 采样时刻（读计数器前后rdtscp的中点）
+    uint64_t tx;        // 发送计数（单位：4字节）
+    uint64_t rx;        // 接收计数（单位：4字节）
+    uint32_t read_cycles;  // 读计数器耗时（TSC周期）
+    uint16_t target;    // 目标下标
+    int16_t err;        // 0或负的errno（该目标本轮读取失败）
+} rtbw_sample;
+
+// 事件记录：target为该值时不是计数器采样，而是采样周期从本轮之后改变，
+// tx为新周期、rx为旧周期（纳秒），tsc为改变前最后一轮的采样时刻
+#define RTBW_TARGET_PERIOD 0xffff
+// 触发事件：只出现在飞行记录的转储文件中（不经过采样队列），tsc为触发时刻，
+// tx = 触发类型 | 目标下标 << 8（见rtbw_flight.h），rx为触发时的窗口速率（Mbps，速率条件之外为0）
+#define RTBW_TARGET_TRIGGER 0xfffe
+// 应用标记（rtbw_mark，见rtbw.h）：不经过采样队列，报告线程按时刻并入，tsc为标记时刻，tx为阶段号
+#define RTBW_TARGET_MARK 0xfffd
+#define RTBW_TARGET_EVENT RTBW_TARGET_MARK      // target不小于该值的记录都是事件
+
+#define RTBW_CACHELINE 64
+
+typedef struct {
+    // 生产者独占
+    _Alignas(RTBW_CACHELINE) uint64_t head;
+    uint64_t tail_cache;
+    uint64_t dropped;       // 因环满被丢弃的采样轮数（生产者写，消费者读）
+    // 消费者独占
+    _Alignas(RTBW_CACHELINE) uint64_t tail;
+    uint64_t head_cache;
+    // 只读
+    _Alignas(RTBW_CACHELINE) uint64_t mask;
+    rtbw_sample *buf;
+} rtbw_spsc;
+
+// 使用调用方分配的缓冲区（至少slots个槽位），slots必须是2的幂
+static inline void rtbw_spsc_attach(rtbw_spsc *q, uint64_t slots, rtbw_sample *buf) {
+    memset(q, 0, sizeof(*q));
+    q->buf = buf;
+    q->mask = slots - 1;
+}
+
+// slots必须是2的幂
+static inline int rtbw_spsc_init(rtbw_spsc *q, uint64_t slots) {
+    rtbw_sample *buf = aligned_alloc(RTBW_CACHELINE, slots * sizeof(rtbw_sample));
+    if (!buf)
+        return -1;
+    rtbw_spsc_attach(q, slots, buf);
+    return 0;
+}
+
+// 生产者：预留n个槽位（起始位置写入*pos），空间不足返回-1（调用方计入dropped）
+static inline int rtbw_spsc_reserve(rtbw_spsc *q, uint32_t n, uint64_t *pos) {
+    uint64_t head = q->head;
+    if (head + n - q->tail_cache > q->mask + 1) {
+        q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+        if (head + n - q->tail_cache > q->mask + 1)
+            return -1;
+    }
+    *pos = head;
+    return 0;
+}
+
+// 生产者：当前可预留的槽位数（重新读取消费者的tail）
+static inline uint64_t rtbw_spsc_space(rtbw_spsc *q) {
+    q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    return q->mask + 1 - (q->head - q->tail_cache);
+}
+
+static inline rtbw_sample *rtbw_spsc_slot(rtbw_spsc *q, uint64_t pos) {
+    return &q->buf[pos & q->mask];
+}
+
+// 生产者：发布n条记录
+static inline void rtbw_spsc_publish(rtbw_spsc *q, uint32_t n) {
+    __atomic_store_n(&q->head, q->head + n, __ATOMIC_RELEASE);
+}
+
+static inline void rtbw_spsc_drop(rtbw_spsc *q) {
+    __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
+}
+
+// 消费者：可读记录数
+static inline uint64_t rtbw_spsc_available(rtbw_spsc *q) {
+    if (q->head_cache == q->tail)
+        q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    return q->head_cache - q->tail;
+}
+
+// 消费者：第i条未读记录
+static inline const rtbw_sample *rtbw_spsc_peek(rtbw_spsc *q, uint64_t i) {
+    return &q->buf[(q->tail + i) & q->mask];
+}
+
+// 消费者：归还n个槽位
+static inline void rtbw_spsc_release(rtbw_spsc *q, uint64_t n) {
+    __atomic_store_n(&q->tail, q->tail + n, __ATOMIC_RELEASE);
+}
+
+static inline uint64_t rtbw_spsc_dropped(rtbw_spsc *q) {
+    return __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+}
+
+#endif // RTBW_SPSC_H
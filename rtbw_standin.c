@@ -0,0 +1,516 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <x86intrin.h>
+#include <linux/fuse.h>
+#include "chrdev_ioctl_common.h"  // 包含共用头文件
+
+// 没有ConnectX网卡和OFED模块时的替身设备，计数器按恒定速率增长
+// 1. fuse模式：直接使用/dev/fuse协议挂载一个与/sys/class/infiniband结构相同的只读目录，
+//    提供<设备>/ports/<端口>/counters/port_rcv_data和port_xmit_data（4字节单位，十进制文本）
+//    配合 rt_bw -B sysfs -P <挂载点>
+// 2. cuse模式：通过/dev/cuse创建字符设备（默认/dev/chrdev_ioctl_dev），
+//    实现GET_TWO_INT64/BIND_TARGET(S)/UNBIND_TARGET/GET_BATCH/SET_MAX_AGE/SET_OPTIONS，语义与chrdev_with_ioctl.c一致
+//    （不支持采样环和mmap；设备时钟用CLOCK_MONOTONIC模拟，频率1GHz）；配合 rt_bw -B ioctl -P /dev/<设备名>
+// 不依赖libfuse，单线程处理请求。
+
+#define STANDIN_BUF_SIZE (1 << 20)
+#define STANDIN_MAX_WRITE (64 << 10)
+#define STANDIN_MAX_ENTRIES 64
+#define STANDIN_MAX_OPEN 64
+#define STANDIN_MAX_VFS 128            // cuse模式下每个PF模拟的VF数
+#define DEFAULT_GBPS 100.0
+
+static volatile sig_atomic_t stop_requested;
+static double words_per_ns;            // 计数器增长速率（4字节/纳秒）
+static uint64_t start_ns;
+static uint8_t req_buf[STANDIN_BUF_SIZE + 4096];
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 第i个目标的计数器（各目标速率相同，加一个偏移便于区分）
+static uint64_t counter_now(int i) {
+    return (uint64_t)((mono_ns() - start_ns) * words_per_ns) + (uint64_t)i * 1000000;
+}
+
+// cuse模式下目标的计数器：VF n-1（vport n）按1/(n+1)的速率增长，便于区分
+static uint64_t counter_vport(int i, int vport) {
+    return counter_now(i) / (vport + 1);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+// 回复一个请求：error为0或负的errno
+static void reply(int fd, uint64_t unique, int error, const void *a, size_t alen,
+                  const void *b, size_t blen) {
+    struct fuse_out_header oh = {
+        .len = sizeof(oh) + (error ? 0 : alen + blen), .error = error, .unique = unique,
+    };
+    struct iovec iov[3] = {
+        { &oh, sizeof(oh) }, { (void *)a, error ? 0 : alen }, { (void *)b, error ? 0 : blen },
+    };
+    if (writev(fd, iov, 3) < 0 && errno != ENOENT)   // ENOENT：请求已被中断
+        perror("fuse reply failed");
+}
+
+// ==================== fuse模式：sysfs计数器目录 ====================
+
+// 节点编号：根为FUSE_ROOT_ID，其余为 层级<<32 | 目标下标<<8 | 文件
+enum { LV_DEV = 1, LV_PORTS, LV_PORT, LV_COUNTERS, LV_FILE };
+#define NODE(lv, ent, file) ((uint64_t)(lv) << 32 | (uint64_t)(ent) << 8 | (file))
+#define NODE_LV(n) ((int)((n) >> 32))
+#define NODE_ENT(n) ((int)(((n) >> 8) & 0xff))
+#define NODE_FILE(n) ((int)((n) & 0xff))
+
+static const char *const counter_files[] = { "port_rcv_data", "port_xmit_data" };
+
+static struct {
+    char dev[32];
+    int port;
+} entries[STANDIN_MAX_ENTRIES];
+static int nr_entries;
+
+static void fill_attr(struct fuse_attr *a, uint64_t node) {
+    memset(a, 0, sizeof(*a));
+    a->ino = node;
+    a->nlink = 1;
+    a->blksize = 4096;
+    if (node != FUSE_ROOT_ID && NODE_LV(node) == LV_FILE) {
+        a->mode = S_IFREG | 0444;
+        a->size = 4096;     // 与sysfs一致
+    } else {
+        a->mode = S_IFDIR | 0555;
+        a->nlink = 2;
+    }
+}
+
+// 在目录parent下查找name，找不到返回0
+static uint64_t fuse_lookup_node(uint64_t parent, const char *name) {
+    int lv = parent == FUSE_ROOT_ID ? 0 : NODE_LV(parent);
+    int ent = parent == FUSE_ROOT_ID ? 0 : NODE_ENT(parent);
+    switch (lv) {
+    case 0:
+        for (int i = 0; i < nr_entries; i++)
+            if (!strcmp(entries[i].dev, name))
+                return NODE(LV_DEV, i, 0);
+        return 0;
+    case LV_DEV:
+        return strcmp(name, "ports") ? 0 : NODE(LV_PORTS, ent, 0);
+    case LV_PORTS:
+        for (int i = 0; i < nr_entries; i++)
+            if (!strcmp(entries[i].dev, entries[ent].dev) && entries[i].port == atoi(name))
+                return NODE(LV_PORT, i, 0);
+        return 0;
+    case LV_PORT:
+        return strcmp(name, "counters") ? 0 : NODE(LV_COUNTERS, ent, 0);
+    case LV_COUNTERS:
+        for (int f = 0; f < 2; f++)
+            if (!strcmp(name, counter_files[f]))
+                return NODE(LV_FILE, ent, f);
+        return 0;
+    }
+    return 0;
+}
+
+static void fuse_handle(int fd, struct fuse_in_header *ih, void *arg) {
+    switch (ih->opcode) {
+    case FUSE_INIT: {
+        struct fuse_init_in *in = arg;
+        struct fuse_init_out out = {
+            .major = FUSE_KERNEL_VERSION,
+            .minor = in->minor < FUSE_KERNEL_MINOR_VERSION ? in->minor : FUSE_KERNEL_MINOR_VERSION,
+            .max_readahead = in->max_readahead,
+            .max_write = STANDIN_MAX_WRITE,
+            .time_gran = 1,
+        };
+        reply(fd, ih->unique, 0, &out, sizeof(out), NULL, 0);
+        return;
+    }
+    case FUSE_LOOKUP: {
+        uint64_t node = fuse_lookup_node(ih->nodeid, arg);
+        if (!node) {
+            reply(fd, ih->unique, -ENOENT, NULL, 0, NULL, 0);
+            return;
+        }
+        struct fuse_entry_out out = { .nodeid = node, .entry_valid = 3600, .attr_valid = 3600 };
+        fill_attr(&out.attr, node);
+        reply(fd, ih->unique, 0, &out, sizeof(out), NULL, 0);
+        return;
+    }
+    case FUSE_GETATTR: {
+        struct fuse_attr_out out = { .attr_valid = 3600 };
+        fill_attr(&out.attr, ih->nodeid);
+        reply(fd, ih->unique, 0, &out, sizeof(out), NULL, 0);
+        return;
+    }
+    case FUSE_OPEN: {
+        if (ih->nodeid == FUSE_ROOT_ID || NODE_LV(ih->nodeid) != LV_FILE) {
+            reply(fd, ih->unique, -EISDIR, NULL, 0, NULL, 0);
+            return;
+        }
+        // 绕过页缓存，每次pread都到达这里，与sysfs行为一致
+        struct fuse_open_out out = { .open_flags = FOPEN_DIRECT_IO };
+        reply(fd, ih->unique, 0, &out, sizeof(out), NULL, 0);
+        return;
+    }
+    case FUSE_READ: {
+        struct fuse_read_in *in = arg;
+        char text[32];
+        int ent = NODE_ENT(ih->nodeid);
+        // 发送计数取接收计数的一半，便于区分方向
+        uint64_t v = counter_now(ent) >> NODE_FILE(ih->nodeid);
+        int len = snprintf(text, sizeof(text), "%lu\n", v);
+        if (in->offset >= (uint64_t)len)
+            len = 0;
+        else if (in->size < (uint32_t)len)
+            len = in->size;
+        reply(fd, ih->unique, 0, text, len, NULL, 0);
+        return;
+    }
+    case FUSE_RELEASE:
+    case FUSE_FLUSH:
+        reply(fd, ih->unique, 0, NULL, 0, NULL, 0);
+        return;
+    case FUSE_FORGET:
+    case FUSE_BATCH_FORGET:
+    case FUSE_INTERRUPT:
+        return;     // 不需要回复
+    case FUSE_DESTROY:
+        stop_requested = 1;
+        reply(fd, ih->unique, 0, NULL, 0, NULL, 0);
+        return;
+    default:
+        reply(fd, ih->unique, -ENOSYS, NULL, 0, NULL, 0);
+        return;
+    }
+}
+
+static int run_fuse(const char *mnt, const char *list) {
+    char *s = strdup(list);
+    for (char *save = NULL, *tok = strtok_r(s, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (nr_entries == STANDIN_MAX_ENTRIES)
+            break;
+        char *at = strchr(tok, '@');
+        entries[nr_entries].port = at ? atoi(at + 1) : 1;
+        if (at)
+            *at = '\0';
+        snprintf(entries[nr_entries].dev, sizeof(entries[0].dev), "%s", tok);
+        nr_entries++;
+    }
+    free(s);
+
+    int fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror("open /dev/fuse failed");
+        return -1;
+    }
+    char opts[128];
+    snprintf(opts, sizeof(opts), "fd=%d,rootmode=40000,user_id=%u,group_id=%u,allow_other",
+             fd, getuid(), getgid());
+    if (mount("rtbw_standin", mnt, "fuse.rtbw_standin", MS_NOSUID | MS_NODEV, opts) < 0) {
+        perror("mount fuse failed");
+        return -1;
+    }
+    for (int i = 0; i < nr_entries; i++)
+        printf("%s/%s/ports/%d/counters/{port_rcv_data,port_xmit_data}\n",
+               mnt, entries[i].dev, entries[i].port);
+    fflush(stdout);
+
+    while (!stop_requested) {
+        ssize_t n = read(fd, req_buf, sizeof(req_buf));
+        if (n < 0) {
+            if (errno == EINTR || errno == ENOENT)
+                continue;
+            if (errno != ENODEV)    // ENODEV：已被卸载
+                perror("read /dev/fuse failed");
+            break;
+        }
+        if ((size_t)n < sizeof(struct fuse_in_header))
+            continue;
+        fuse_handle(fd, (struct fuse_in_header *)req_buf, req_buf + sizeof(struct fuse_in_header));
+    }
+    umount2(mnt, MNT_DETACH);
+    close(fd);
+    return 0;
+}
+
+// ==================== cuse模式：/dev/chrdev_ioctl_dev ====================
+
+static struct {
+    int used;
+    int nr;
+    uint32_t options;
+    struct chrdev_target targets[CHRDEV_MAX_TARGETS];
+} opens[STANDIN_MAX_OPEN];
+
+// 与内核模块相同的参数检查
+static int check_target(struct chrdev_target *t) {
+    if (t->domain < 0 || t->domain > 0xffff || t->bus < 0 || t->bus > 0xff ||
+        t->slot < 0 || t->slot > 0x1f || t->func < 0 || t->func > 7 || t->port < 0 ||
+        t->vport < 0)
+        return -EINVAL;
+    if (t->vport > STANDIN_MAX_VFS)
+        return -ERANGE;
+    if (t->port == 0)
+        t->port = 1;
+    return 0;
+}
+
+// 每个命令需要的输入/输出大小
+static int ioctl_sizes(uint32_t cmd, size_t *in, size_t *out) {
+    *in = *out = 0;
+    switch (cmd) {
+    case CHRDEV_IOCTL_GET_TWO_INT64:
+        *in = *out = sizeof(struct chrdev_ioctl_out_args);
+        return 0;
+    case CHRDEV_IOCTL_BIND_TARGET:
+        *in = sizeof(struct chrdev_target);
+        return 0;
+    case CHRDEV_IOCTL_BIND_TARGETS:
+        *in = sizeof(struct chrdev_target_set);
+        return 0;
+    case CHRDEV_IOCTL_UNBIND_TARGET:
+        return 0;
+    case CHRDEV_IOCTL_SET_MAX_AGE:
+    case CHRDEV_IOCTL_SET_OPTIONS:
+        *in = sizeof(__u32);
+        return 0;
+    case CHRDEV_IOCTL_GET_BATCH:
+        *out = sizeof(struct chrdev_batch);
+        return 0;
+    }
+    return -ENOTTY;
+}
+
+static void cuse_ioctl(int fd, struct fuse_in_header *ih, struct fuse_ioctl_in *in) {
+    size_t need_in, need_out;
+    if (ioctl_sizes(in->cmd, &need_in, &need_out) < 0 || in->fh >= STANDIN_MAX_OPEN) {
+        reply(fd, ih->unique, -ENOTTY, NULL, 0, NULL, 0);
+        return;
+    }
+    // 非受限ioctl：第一次请求不带数据，回复RETRY告诉内核需要拷贝的用户态地址和长度
+    if (in->in_size < need_in || in->out_size < need_out) {
+        struct fuse_ioctl_iovec iov[2];
+        int n = 0;
+        struct fuse_ioctl_out out = { .flags = FUSE_IOCTL_RETRY };
+        if (need_in) {
+            iov[n++] = (struct fuse_ioctl_iovec) { .base = in->arg, .len = need_in };
+            out.in_iovs = 1;
+        }
+        if (need_out) {
+            iov[n++] = (struct fuse_ioctl_iovec) { .base = in->arg, .len = need_out };
+            out.out_iovs = 1;
+        }
+        reply(fd, ih->unique, 0, &out, sizeof(out), iov, n * sizeof(iov[0]));
+        return;
+    }
+
+    void *data = in + 1;
+    union {
+        struct chrdev_ioctl_out_args one;
+        struct chrdev_batch batch;
+    } res;
+    size_t res_len = 0;
+    int ret = 0;
+    typeof(opens[0]) *o = &opens[in->fh];
+    switch (in->cmd) {
+    case CHRDEV_IOCTL_GET_TWO_INT64: {
+        // 与内核一致：已绑定时忽略传入的bus/slot/func，查询第一个目标
+        memcpy(&res.one, data, sizeof(res.one));
+        res.one.val1 = counter_now(0) >> 1;
+        res.one.val2 = counter_now(0);
+        res_len = sizeof(res.one);
+        break;
+    }
+    case CHRDEV_IOCTL_BIND_TARGET: {
+        struct chrdev_target t;
+        memcpy(&t, data, sizeof(t));
+        if ((ret = check_target(&t)) == 0) {
+            o->targets[0] = t;
+            o->nr = 1;
+        }
+        break;
+    }
+    case CHRDEV_IOCTL_BIND_TARGETS: {
+        struct chrdev_target_set *set = data;
+        if (set->nr == 0 || set->nr > CHRDEV_MAX_TARGETS) {
+            ret = -EINVAL;
+            break;
+        }
+        for (uint32_t i = 0; i < set->nr && !ret; i++)
+            ret = check_target(&set->targets[i]);
+        if (!ret) {
+            memcpy(o->targets, set->targets, set->nr * sizeof(set->targets[0]));
+            o->nr = set->nr;
+        }
+        break;
+    }
+    case CHRDEV_IOCTL_UNBIND_TARGET:
+        o->nr = 0;
+        break;
+    case CHRDEV_IOCTL_SET_MAX_AGE:
+        // 替身的计数器由时间计算，没有可合并的查询
+        break;
+    case CHRDEV_IOCTL_SET_OPTIONS:
+        memcpy(&o->options, data, sizeof(o->options));
+        if (o->options & ~CHRDEV_OPT_HW_CLOCK)
+            ret = -EINVAL;
+        break;
+    case CHRDEV_IOCTL_GET_BATCH:
+        if (!o->nr) {
+            ret = -ENODEV;
+            break;
+        }
+        res.batch.nr = o->nr;
+        res.batch.reserved = 0;
+        for (int i = 0; i < o->nr; i++) {
+            // 与内核一致：tsc和区间紧贴“固件查询”（这里是计数器的计算）
+            uint64_t t1 = __rdtsc();
+            uint64_t rx = counter_vport(i, o->targets[i].vport);
+            uint64_t t2 = __rdtsc();
+            res.batch.counters[i] = (struct chrdev_counter) {
+                .tx = rx >> 1,
+                .rx = rx,
+                .tsc = t1 + ((t2 - t1) >> 1),
+                .bracket_cycles = t2 - t1 ? t2 - t1 : 1,
+            };
+            if (o->options & CHRDEV_OPT_HW_CLOCK) {
+                res.batch.counters[i].hw_clock = mono_ns();
+                res.batch.counters[i].hw_khz = 1000000;
+            }
+        }
+        res_len = offsetof(struct chrdev_batch, counters) + o->nr * sizeof(res.batch.counters[0]);
+        break;
+    }
+    if (ret) {
+        reply(fd, ih->unique, ret, NULL, 0, NULL, 0);
+        return;
+    }
+    struct fuse_ioctl_out out = { 0 };
+    reply(fd, ih->unique, 0, &out, sizeof(out), &res, res_len);
+}
+
+static void cuse_handle(int fd, struct fuse_in_header *ih, void *arg, const char *name) {
+    switch (ih->opcode) {
+    case CUSE_INIT: {
+        struct cuse_init_in *in = arg;
+        struct cuse_init_out out = {
+            .major = FUSE_KERNEL_VERSION,
+            .minor = in->minor < FUSE_KERNEL_MINOR_VERSION ? in->minor : FUSE_KERNEL_MINOR_VERSION,
+            .flags = CUSE_UNRESTRICTED_IOCTL,
+            .max_read = STANDIN_MAX_WRITE,
+            .max_write = STANDIN_MAX_WRITE,
+        };
+        char info[64];
+        int len = snprintf(info, sizeof(info), "DEVNAME=%s", name) + 1;
+        reply(fd, ih->unique, 0, &out, sizeof(out), info, len);
+        printf("/dev/%s\n", name);
+        fflush(stdout);
+        return;
+    }
+    case FUSE_OPEN: {
+        int i;
+        for (i = 0; i < STANDIN_MAX_OPEN && opens[i].used; i++)
+            ;
+        if (i == STANDIN_MAX_OPEN) {
+            reply(fd, ih->unique, -EMFILE, NULL, 0, NULL, 0);
+            return;
+        }
+        opens[i].used = 1;
+        opens[i].nr = 0;
+        opens[i].options = 0;
+        struct fuse_open_out out = { .fh = i };
+        reply(fd, ih->unique, 0, &out, sizeof(out), NULL, 0);
+        return;
+    }
+    case FUSE_RELEASE: {
+        struct fuse_release_in *in = arg;
+        if (in->fh < STANDIN_MAX_OPEN)
+            opens[in->fh].used = 0;
+        reply(fd, ih->unique, 0, NULL, 0, NULL, 0);
+        return;
+    }
+    case FUSE_IOCTL:
+        cuse_ioctl(fd, ih, arg);
+        return;
+    case FUSE_FLUSH:
+        reply(fd, ih->unique, 0, NULL, 0, NULL, 0);
+        return;
+    case FUSE_INTERRUPT:
+        return;
+    default:
+        reply(fd, ih->unique, -ENOSYS, NULL, 0, NULL, 0);
+        return;
+    }
+}
+
+static int run_cuse(const char *name) {
+    int fd = open("/dev/cuse", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror("open /dev/cuse failed");
+        return -1;
+    }
+    while (!stop_requested) {
+        ssize_t n = read(fd, req_buf, sizeof(req_buf));
+        if (n < 0) {
+            if (errno == EINTR || errno == ENOENT)
+                continue;
+            perror("read /dev/cuse failed");
+            break;
+        }
+        if ((size_t)n < sizeof(struct fuse_in_header))
+            continue;
+        cuse_handle(fd, (struct fuse_in_header *)req_buf, req_buf + sizeof(struct fuse_in_header), name);
+    }
+    close(fd);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("用法: %s fuse <挂载点> [设备[@端口][,...]] [Gbps]\n", prog);
+    printf("      %s cuse [设备名] [Gbps]\n", prog);
+    printf("  fuse：在挂载点下提供sysfs计数器文件（默认mlx5_0@1），配合 rt_bw -B sysfs -P <挂载点>\n");
+    printf("  cuse：创建/dev/<设备名>（默认chrdev_ioctl_dev），配合 rt_bw -B ioctl -P /dev/<设备名>\n");
+    printf("  计数器按Gbps（默认%.0f）恒定增长，发送计数为接收计数的一半\n", DEFAULT_GBPS);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || (!strcmp(argv[1], "fuse") && argc < 3)) {
+        usage(argv[0]);
+        exit(1);
+    }
+    int is_fuse = !strcmp(argv[1], "fuse");
+    if (!is_fuse && strcmp(argv[1], "cuse")) {
+        usage(argv[0]);
+        exit(1);
+    }
+    const char *rate = is_fuse ? (argc >= 5 ? argv[4] : NULL) : (argc >= 4 ? argv[3] : NULL);
+    double gbps = rate ? atof(rate) : DEFAULT_GBPS;
+    words_per_ns = gbps / 8 / 4;
+    start_ns = mono_ns();
+
+    struct sigaction sa = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ret = is_fuse ? run_fuse(argv[2], argc >= 4 ? argv[3] : "mlx5_0")
+                      : run_cuse(argc >= 3 ? argv[2] : "chrdev_ioctl_dev");
+    return ret < 0 ? EXIT_FAILURE : 0;
+}
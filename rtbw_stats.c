@@ -0,0 +1,75 @@
+#include "rtbw_stats.h"
+
+// TOP-K降序输出（K很小，直接插入排序）
+int rtbw_topk_sorted(const rtbw_topk *t, rtbw_top_entry *out) {
+    int n = t->n;
+    for (int i = 0; i < n; i++) {
+        rtbw_top_entry e = t->heap[i];
+        int j = i;
+        while (j > 0 && out[j - 1].value < e.value) {
+            out[j] = out[j - 1];
+            j--;
+        }
+        out[j] = e;
+    }
+    return n;
+}
+
+// 桶下标到桶中点（Mbps）
+static double rtbw_hist_value(int idx) {
+    if (idx < RTBW_HIST_SUB)
+        return idx + 0.5;
+    int k = idx - RTBW_HIST_SUB;
+    int shift = k / RTBW_HIST_SUB;
+    uint64_t lower = (uint64_t)(RTBW_HIST_SUB + k % RTBW_HIST_SUB) << shift;
+    return lower + (double)(1ULL << shift) / 2;
+}
+
+// 第q分位数：遍历固定数量的桶，返回桶中点（不超过实际最大值）
+double rtbw_hist_percentile(const rtbw_hist *h, uint32_t total, double q, double max) {
+    if (total == 0)
+        return 0.0;
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+    uint64_t acc = 0;
+    for (int i = 0; i < RTBW_HIST_BUCKETS; i++) {
+        acc += h->count[i];
+        if (acc >= rank) {
+            double v = rtbw_hist_value(i) / 1000.0;
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+// 成批换算：先把整块差值换算成Gbps和微秒（无分支的纯数组运算，按CPU选择AVX-512/AVX2版本），
+// 再逐个更新统计（直方图下标、TOP堆，与逐个rtbw_stats_add的结果相同）
+__attribute__((target_clones("avx512f", "avx2", "default")))
+static void rtbw_deltas_convert(const rtbw_deltas *d, double tsc_ghz, double *restrict rx,
+                                double *restrict tx, uint32_t *restrict us) {
+    // Gbps = 4字节计数 × 32位 / 纳秒，纳秒 = 周期 / GHz
+    double bits_per_cycle = 32.0 * tsc_ghz, us_per_cycle = 1.0 / (tsc_ghz * 1000.0);
+    // 固定按整块换算（循环次数为常量，便于向量化），n之后的槽位结果不使用；
+    // 周期差不超过31位（rtbw_stats_push保证），按有符号数转换可以直接向量化
+    for (int i = 0; i < RTBW_DELTA_BLOCK; i++) {
+        double c = (double)(int32_t)d->cycles[i];
+        rx[i] = (double)d->rx[i] * bits_per_cycle / c;
+        tx[i] = (double)d->tx[i] * bits_per_cycle / c;
+        us[i] = (uint32_t)(c * us_per_cycle);
+    }
+}
+
+void rtbw_stats_flush(rtbw_stats *st, double tsc_ghz) {
+    uint32_t n = st->pending.n;
+    double rx[RTBW_DELTA_BLOCK], tx[RTBW_DELTA_BLOCK];
+    uint32_t us[RTBW_DELTA_BLOCK];
+    if (n == 0)
+        return;
+    rtbw_deltas_convert(&st->pending, tsc_ghz, rx, tx, us);
+    for (uint32_t i = 0; i < n; i++)
+        rtbw_stats_add(st, rx[i], tx[i], us[i]);
+    st->pending.n = 0;
+}
@@ -0,0 +1,156 @@
+#ifndef RTBW_STATS_H
+#define RTBW_STATS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+// 流式带宽统计：每个采样O(log K)更新，内存大小固定（与采样率、打印周期无关）
+// 1. TOP-K最小堆：堆顶为当前第K大的值，新值大于堆顶才替换
+// 2. 对数分桶直方图（HDR风格）：每个2的幂区间再等分32个子桶，相对误差约3%
+// 3. 均值/最大值：累加和与计数
+// 4. 延迟换算：报告线程每个采样只追加整数差值（TSC周期、4字节计数）到按列存放的块中，
+//    块满或打印前由rtbw_stats_flush成批换算成Gbps（向量化的除法）再更新上面的统计
+
+#define RTBW_TOPK 8                        // TOP数量
+#define RTBW_HIST_SUB_BITS 5               // 每个2的幂区间的子桶数 = 2^5
+#define RTBW_HIST_SUB (1 << RTBW_HIST_SUB_BITS)
+#define RTBW_HIST_MAX_EXP 23               // 最大可区分 2^24 Mbps（约16 Tbps），超出计入最后一个桶
+#define RTBW_HIST_BUCKETS (RTBW_HIST_SUB + (RTBW_HIST_MAX_EXP - RTBW_HIST_SUB_BITS + 1) * RTBW_HIST_SUB)
+#define RTBW_DELTA_BLOCK 256                // 待换算块的采样数
+
+typedef struct {
+    double value;        // 带宽（Gbps）
+    uint32_t sample_idx; // 周期内的采样序号
+    uint32_t us;         // 该采样的时间跨度（微秒）
+} rtbw_top_entry;
+
+typedef struct {
+    rtbw_top_entry heap[RTBW_TOPK];
+    int n;
+} rtbw_topk;
+
+typedef struct {
+    uint32_t count[RTBW_HIST_BUCKETS];  // 单位：Mbps
+} rtbw_hist;
+
+// 一个方向（RX或TX）的统计
+typedef struct {
+    rtbw_topk top;
+    rtbw_hist hist;
+    double sum;
+    double max;
+} rtbw_stream;
+
+// 待换算的整数差值（按列存放，每个采样12字节）
+typedef struct {
+    uint32_t cycles[RTBW_DELTA_BLOCK];  // 采样间隔（TSC周期）
+    uint32_t rx[RTBW_DELTA_BLOCK];      // 接收增量（4字节）
+    uint32_t tx[RTBW_DELTA_BLOCK];      // 发送增量（4字节）
+    uint32_t n;
+} rtbw_deltas;
+
+// 一条带宽序列一个周期内的统计
+typedef struct {
+    rtbw_stream rx;
+    rtbw_stream tx;
+    uint32_t samples;       // 已换算的采样数（读取前先rtbw_stats_flush）
+    rtbw_deltas pending;
+} rtbw_stats;
+
+// 值（Mbps，整数）到桶下标
+static inline int rtbw_hist_index(uint64_t v) {
+    if (v < RTBW_HIST_SUB)
+        return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > RTBW_HIST_MAX_EXP)
+        return RTBW_HIST_BUCKETS - 1;
+    int mant = (int)(v >> (e - RTBW_HIST_SUB_BITS)) & (RTBW_HIST_SUB - 1);
+    return RTBW_HIST_SUB + (e - RTBW_HIST_SUB_BITS) * RTBW_HIST_SUB + mant;
+}
+
+static inline void rtbw_topk_add(rtbw_topk *t, double value, uint32_t sample_idx, uint32_t us) {
+    rtbw_top_entry e = { value, sample_idx, us };
+    int i;
+    if (t->n < RTBW_TOPK) {
+        // 上浮
+        i = t->n++;
+        while (i > 0) {
+            int p = (i - 1) >> 1;
+            if (t->heap[p].value <= value)
+                break;
+            t->heap[i] = t->heap[p];
+            i = p;
+        }
+        t->heap[i] = e;
+        return;
+    }
+    if (value <= t->heap[0].value)
+        return;
+    // 替换堆顶并下沉
+    i = 0;
+    for (;;) {
+        int c = 2 * i + 1;
+        if (c >= RTBW_TOPK)
+            break;
+        if (c + 1 < RTBW_TOPK && t->heap[c + 1].value < t->heap[c].value)
+            c++;
+        if (t->heap[c].value >= value)
+            break;
+        t->heap[i] = t->heap[c];
+        i = c;
+    }
+    t->heap[i] = e;
+}
+
+static inline void rtbw_stream_add(rtbw_stream *s, double gbps, uint32_t sample_idx, uint32_t us) {
+    s->sum += gbps;
+    if (gbps > s->max)
+        s->max = gbps;
+    s->hist.count[rtbw_hist_index((uint64_t)(gbps * 1000.0))]++;
+    // 与原实现一致：只有正带宽才进入TOP
+    if (gbps > 0)
+        rtbw_topk_add(&s->top, gbps, sample_idx, us);
+}
+
+// 记录一个采样（热路径）
+static inline void rtbw_stats_add(rtbw_stats *st, double rx_gbps, double tx_gbps, uint32_t us) {
+    rtbw_stream_add(&st->rx, rx_gbps, st->samples, us);
+    rtbw_stream_add(&st->tx, tx_gbps, st->samples, us);
+    st->samples++;
+}
+
+// 把待换算块中的差值换算成Gbps并记入统计；tsc_ghz为TSC频率（GHz）
+void rtbw_stats_flush(rtbw_stats *st, double tsc_ghz);
+
+// 记录一个采样的整数差值（报告线程热路径：三次存储，块满时成批换算）
+// 超出块内表示范围的差值（周期差超过31位即约1秒，计数差超过32位）先清空块再直接换算
+static inline void rtbw_stats_push(rtbw_stats *st, uint64_t cycles, uint64_t rx, uint64_t tx, double tsc_ghz) {
+    rtbw_deltas *d = &st->pending;
+    if (__builtin_expect((cycles >> 31) | ((rx | tx) >> 32), 0)) {
+        rtbw_stats_flush(st, tsc_ghz);
+        double ns = cycles / tsc_ghz;
+        rtbw_stats_add(st, rx * 32.0 / ns, tx * 32.0 / ns, (uint32_t)(ns / 1000));
+        return;
+    }
+    d->cycles[d->n] = cycles;
+    d->rx[d->n] = rx;
+    d->tx[d->n] = tx;
+    if (++d->n == RTBW_DELTA_BLOCK)
+        rtbw_stats_flush(st, tsc_ghz);
+}
+
+// 待换算块的内容无需清零
+static inline void rtbw_stats_reset(rtbw_stats *st) {
+    memset(st, 0, offsetof(rtbw_stats, pending));
+    st->pending.n = 0;
+}
+
+// 报告阶段使用（开销与采样数无关）
+int rtbw_topk_sorted(const rtbw_topk *t, rtbw_top_entry *out);          // 降序输出，返回个数
+double rtbw_hist_percentile(const rtbw_hist *h, uint32_t total, double q, double max);  // q∈[0,1]，返回Gbps
+static inline double rtbw_stream_mean(const rtbw_stream *s, uint32_t total) {
+    return total ? s->sum / total : 0.0;
+}
+
+#endif // RTBW_STATS_H
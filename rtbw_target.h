@@ -0,0 +1,86 @@
+#ifndef RTBW_TARGET_H
+#define RTBW_TARGET_H
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include "chrdev_ioctl_common.h"
+
+// mlx5目标的文本形式：[domain:]bus:slot.func[@port][/vfN 或 /vfN-M]
+// domain/bus/slot/func为十六进制，port和VF下标为十进制；ioctl后端和rtbw_agent共用
+// 每个字段都必须完整解析到分隔符为止，多余的字符（如/vf3x、/vf3-）和越界的值都视为错误
+
+#define RTBW_TARGET_PORT_DFT 1      // 默认RDMA端口号（@port可覆盖）
+#define RTBW_TARGET_MAX_VF 0xfffe   // vport为16位，VF n-1对应vport n
+
+// 从*s解析一个无符号数，到第一个不属于数字的字符为止；没有数字或超过max时返回-1
+static inline long rtbw_target_num(const char **s, int base, unsigned long max) {
+    char *end;
+    if (!isxdigit((unsigned char)**s))     // 拒绝空串、符号和前导空白
+        return -1;
+    unsigned long v = strtoul(*s, &end, base);
+    if (end == *s || v > max)
+        return -1;
+    *s = end;
+    return (long)v;
+}
+
+// 解析一个目标，返回目标数：不带VF时为1（PF自身的vport），带VF范围时为VF个数，
+// t->vport为第一个VF的vport；格式错误返回-1
+static inline int rtbw_parse_target(const char *str, struct chrdev_target *t) {
+    long v[4];
+    int nr = 0;
+    const char *p = str;
+
+    memset(t, 0, sizeof(*t));
+    t->port = RTBW_TARGET_PORT_DFT;
+
+    // 1. [domain:]bus:slot.func：先按冒号分隔读出2或3个字段，最后一个字段后面是.func
+    for (;;) {
+        if (nr == 3 || (v[nr] = rtbw_target_num(&p, 16, 0xffff)) < 0)
+            return -1;
+        nr++;
+        if (*p != ':')
+            break;
+        p++;
+    }
+    if (nr < 2 || *p++ != '.' || (v[nr] = rtbw_target_num(&p, 16, 7)) < 0)
+        return -1;
+    t->domain = nr == 3 ? v[0] : 0;
+    t->bus = v[nr - 2];
+    t->slot = v[nr - 1];
+    t->func = v[nr];
+    if (t->bus > 0xff || t->slot > 0x1f)
+        return -1;
+
+    // 2. @port
+    if (*p == '@') {
+        p++;
+        long port = rtbw_target_num(&p, 10, 0xff);
+        if (port <= 0)
+            return -1;
+        t->port = port;
+    }
+
+    // 3. /vfN 或 /vfN-M
+    int count = 1;
+    if (*p == '/') {
+        if (strncmp(p + 1, "vf", 2) != 0)
+            return -1;
+        p += 3;
+        long first = rtbw_target_num(&p, 10, RTBW_TARGET_MAX_VF - 1), last = first;
+        if (first < 0)
+            return -1;
+        if (*p == '-') {
+            p++;
+            last = rtbw_target_num(&p, 10, RTBW_TARGET_MAX_VF - 1);
+            if (last < first)
+                return -1;
+        }
+        t->vport = first + 1;
+        count = last - first + 1;
+    }
+    return *p == '\0' ? count : -1;
+}
+
+#endif // RTBW_TARGET_H
@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include "rtbw_telemetry.h"
+
+struct rtbw_telemetry {
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    char host[RTBW_TM_HOST_LEN];
+    uint32_t pid;
+    uint32_t seq;
+    // 攒批：nr个数据报，最后一个可能未满
+    _Alignas(8) uint8_t dgram[RTBW_TM_BATCH][RTBW_TM_MAX_DGRAM];
+    int nr;
+    uint64_t dropped;
+};
+
+static struct rtbw_tm_header *tm_header(rtbw_telemetry *t, int i) {
+    return (struct rtbw_tm_header *)t->dgram[i];
+}
+
+static size_t tm_len(rtbw_telemetry *t, int i) {
+    return sizeof(struct rtbw_tm_header) + tm_header(t, i)->nr_records * sizeof(struct rtbw_tm_record);
+}
+
+rtbw_telemetry *rtbw_telemetry_create(const char *dest, const char *host) {
+    // 1. 解析 地址:端口（最后一个冒号之后为端口，[IPv6]去掉方括号）
+    char addr[256];
+    snprintf(addr, sizeof(addr), "%s", dest);
+    char *port = strrchr(addr, ':');
+    if (!port || port == addr) {
+        fprintf(stderr, "遥测地址格式错误（地址:端口）：%s\n", dest);
+        return NULL;
+    }
+    *port++ = '\0';
+    char *node = addr;
+    if (node[0] == '[' && node[strlen(node) - 1] == ']') {
+        node[strlen(node) - 1] = '\0';
+        node++;
+    }
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM }, *res;
+    int ret = getaddrinfo(node, port, &hints, &res);
+    if (ret) {
+        fprintf(stderr, "遥测地址解析失败：%s（%s）\n", dest, gai_strerror(ret));
+        return NULL;
+    }
+
+    rtbw_telemetry *t = calloc(1, sizeof(*t));
+    if (!t) {
+        perror("alloc telemetry failed");
+        freeaddrinfo(res);
+        return NULL;
+    }
+    t->fd = socket(res->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (t->fd < 0) {
+        perror("socket telemetry failed");
+        freeaddrinfo(res);
+        free(t);
+        return NULL;
+    }
+    memcpy(&t->addr, res->ai_addr, res->ai_addrlen);
+    t->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+
+    // 2. 主机标识
+    if (host)
+        snprintf(t->host, sizeof(t->host), "%s", host);
+    else
+        gethostname(t->host, sizeof(t->host) - 1);
+    t->pid = getpid();
+    return t;
+}
+
+void rtbw_telemetry_flush(rtbw_telemetry *t) {
+    struct mmsghdr msg[RTBW_TM_BATCH];
+    struct iovec iov[RTBW_TM_BATCH];
+    int n = t->nr;
+    if (!n)
+        return;
+    memset(msg, 0, n * sizeof(msg[0]));
+    for (int i = 0; i < n; i++) {
+        iov[i] = (struct iovec) { .iov_base = t->dgram[i], .iov_len = tm_len(t, i) };
+        msg[i].msg_hdr.msg_name = &t->addr;
+        msg[i].msg_hdr.msg_namelen = t->addr_len;
+        msg[i].msg_hdr.msg_iov = &iov[i];
+        msg[i].msg_hdr.msg_iovlen = 1;
+    }
+    // 非阻塞：发送缓冲区满（EAGAIN/ENOBUFS）时丢弃剩余的数据报
+    int sent = 0;
+    while (sent < n) {
+        int ret = sendmmsg(t->fd, msg + sent, n - sent, MSG_DONTWAIT);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        sent += ret;
+    }
+    t->dropped += n - sent;
+    t->nr = 0;
+}
+
+void rtbw_telemetry_add(rtbw_telemetry *t, const struct rtbw_tm_record *r) {
+    if (t->nr == 0 || tm_header(t, t->nr - 1)->nr_records == RTBW_TM_PER_DGRAM) {
+        if (t->nr == RTBW_TM_BATCH)
+            rtbw_telemetry_flush(t);
+        struct rtbw_tm_header *h = tm_header(t, t->nr++);
+        *h = (struct rtbw_tm_header) {
+            .magic = RTBW_TM_MAGIC, .version = RTBW_TM_VERSION, .seq = t->seq++, .pid = t->pid,
+        };
+        memcpy(h->host, t->host, sizeof(h->host));
+    }
+    struct rtbw_tm_header *h = tm_header(t, t->nr - 1);
+    struct rtbw_tm_record *rec = (struct rtbw_tm_record *)(h + 1);
+    rec[h->nr_records++] = *r;
+}
+
+uint64_t rtbw_telemetry_dropped(rtbw_telemetry *t) {
+    return t->dropped;
+}
+
+void rtbw_telemetry_close(rtbw_telemetry *t) {
+    rtbw_telemetry_flush(t);
+    close(t->fd);
+    free(t);
+}
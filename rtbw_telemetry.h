@@ -0,0 +1,74 @@
+#ifndef RTBW_TELEMETRY_H
+#define RTBW_TELEMETRY_H
+
+#include <stdint.h>
+#include "rtbw_engine.h"
+
+// 主机 → 汇聚端的遥测流：每个打印周期把各序列的峰值/分位数/突发次数编成定长二进制记录，
+// 多条记录装进一个UDP数据报，一个周期的所有数据报用一次sendmmsg发出
+// 1. 数据报 = rtbw_tm_header + nr_records条rtbw_tm_record，字段为x86小端，不超过RTBW_TM_MAX_DGRAM字节
+// 2. 周期边界换算为CLOCK_REALTIME（纳秒），各主机的时钟由NTP/PTP同步，汇聚端据此对齐
+// 3. 发送只在报告线程、非阻塞；发送缓冲区满时丢弃并计数，不影响采样。
+//    header.seq逐个数据报递增，汇聚端据此统计丢包
+// 汇聚端见rtbw_collector.c
+
+#define RTBW_TM_MAGIC 0x54574252u           // "RBWT"
+#define RTBW_TM_VERSION 1
+#define RTBW_TM_PORT 9555                   // 默认UDP端口
+#define RTBW_TM_MAX_DGRAM 1400              // 不超过常见MTU，避免IP分片
+#define RTBW_TM_HOST_LEN 32
+#define RTBW_TM_BATCH 32                    // 一次sendmmsg最多的数据报数
+
+#define RTBW_TM_NODE 0x1                    // 记录为节点汇总（每台主机每周期一条）
+
+// 一个方向的周期统计（Gbps）
+struct rtbw_tm_dir {
+    float max;
+    float mean;
+    float p50;
+    float p99;
+    float p999;
+    float burst_peak;               // 最细时间尺度（-R的第一个尺度）的窗口峰值，没有-R时为0
+    uint32_t bursts;                // 最细时间尺度的突发次数（-T），没有时为0
+};
+
+struct rtbw_tm_record {
+    uint64_t start_ns;              // 周期起止（CLOCK_REALTIME）
+    uint64_t end_ns;
+    char name[RTBW_NAME_LEN];
+    uint32_t samples;
+    uint16_t vport;                 // 0：PF或非SR-IOV目标；n：VF n-1
+    uint16_t flags;                 // RTBW_TM_NODE
+    uint32_t burst_window_ns;       // burst_peak/bursts对应的时间尺度，0表示没有
+    uint32_t reserved;
+    struct rtbw_tm_dir rx;
+    struct rtbw_tm_dir tx;
+};
+
+struct rtbw_tm_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t nr_records;
+    uint32_t seq;                   // 发送者的数据报序号
+    uint32_t pid;                   // 发送者进程（与host一起区分同一主机上的多个实例）
+    char host[RTBW_TM_HOST_LEN];
+};
+
+#define RTBW_TM_PER_DGRAM ((RTBW_TM_MAX_DGRAM - sizeof(struct rtbw_tm_header)) / sizeof(struct rtbw_tm_record))
+
+_Static_assert(sizeof(struct rtbw_tm_record) == 120, "telemetry record layout changed");
+_Static_assert(sizeof(struct rtbw_tm_header) == 48, "telemetry header layout changed");
+
+typedef struct rtbw_telemetry rtbw_telemetry;
+
+// dest为 地址:端口（IPv6地址用[addr]:port）；host为NULL时使用gethostname；失败返回NULL
+rtbw_telemetry *rtbw_telemetry_create(const char *dest, const char *host);
+// 追加一条记录，攒满一批时立即发送
+void rtbw_telemetry_add(rtbw_telemetry *t, const struct rtbw_tm_record *r);
+// 发出已攒的数据报（每个周期结束时调用一次）
+void rtbw_telemetry_flush(rtbw_telemetry *t);
+// 发送失败丢弃的数据报数（累计）
+uint64_t rtbw_telemetry_dropped(rtbw_telemetry *t);
+void rtbw_telemetry_close(rtbw_telemetry *t);
+
+#endif // RTBW_TELEMETRY_H
@@ -0,0 +1,562 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include "rtbw_trace.h"
+
+#define TRACE_ALIGN 4096
+#define TRACE_BUF_SIZE (4 << 20)        // 写盘缓冲区大小
+#define TRACE_NR_BUFS 4                 // 缓冲区个数（写盘慢时可以积压的量）
+#define TRACE_CHUNK_PAYLOAD (64 << 10)  // 块负载达到此大小即结束当前块
+#define TRACE_RECORD_MAX 64             // 单条记录编码后的最大长度
+
+struct rtbw_trace_writer {
+    int fd;
+    int nr_targets;
+    struct rtbw_trace_header *hdr;      // 对齐分配，关闭时回填后写回偏移0
+
+    // 当前块（报告线程独占）
+    struct rtbw_trace_chunk ch;
+    uint8_t payload[TRACE_CHUNK_PAYLOAD + TRACE_RECORD_MAX];
+    uint32_t len;
+    uint64_t prev_tsc, prev_d;
+    uint32_t prev_rc;
+    uint64_t prev_tx[RTBW_MAX_TARGETS], prev_rx[RTBW_MAX_TARGETS];
+    uint64_t nr_records;
+    uint64_t dropped;
+    int lossless;                       // 补写模式：块写不下时等待后台线程
+
+    // 索引
+    struct rtbw_trace_index_entry *index;
+    uint64_t nr_index, cap_index;
+
+    // 写盘缓冲区：cur由报告线程填充，写满后交给后台线程
+    uint8_t *bufs[TRACE_NR_BUFS];
+    int cur;
+    uint32_t cur_len;
+    uint64_t file_off;                  // 已交给缓冲区的字节数（即文件逻辑长度）
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int free_ids[TRACE_NR_BUFS], nr_free;
+    int full_ids[TRACE_NR_BUFS];
+    uint32_t full_len[TRACE_NR_BUFS];
+    int full_head, nr_full;
+    int done;
+    int error;
+    pthread_t thread;
+};
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+// 后台写盘线程：按顺序写出写满的缓冲区
+static void *trace_writer_main(void *arg) {
+    rtbw_trace_writer *w = arg;
+    uint64_t off = 0;
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while (!w->nr_full && !w->done)
+            pthread_cond_wait(&w->cond, &w->lock);
+        if (!w->nr_full)
+            break;
+        int id = w->full_ids[w->full_head];
+        uint32_t len = w->full_len[w->full_head];
+        pthread_mutex_unlock(&w->lock);
+
+        for (uint32_t done = 0; done < len && !w->error; ) {
+            ssize_t n = pwrite(w->fd, w->bufs[id] + done, len - done, off + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                perror("write trace failed");
+                w->error = 1;
+                break;
+            }
+            done += n;
+        }
+        off += len;
+
+        pthread_mutex_lock(&w->lock);
+        w->full_head = (w->full_head + 1) % TRACE_NR_BUFS;
+        w->nr_full--;
+        w->free_ids[w->nr_free++] = id;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// 把当前缓冲区（len字节，必须是TRACE_ALIGN的倍数）交给后台线程
+static void trace_submit(rtbw_trace_writer *w, uint32_t len) {
+    pthread_mutex_lock(&w->lock);
+    int slot = (w->full_head + w->nr_full) % TRACE_NR_BUFS;
+    w->full_ids[slot] = w->cur;
+    w->full_len[slot] = len;
+    w->nr_full++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    w->cur = -1;
+    w->cur_len = 0;
+}
+
+// 取一个空闲缓冲区作为当前缓冲区；block为0时没有空闲缓冲区返回-1
+static int trace_acquire(rtbw_trace_writer *w, int block) {
+    if (w->cur >= 0)
+        return 0;
+    pthread_mutex_lock(&w->lock);
+    while (!w->nr_free && block)
+        pthread_cond_wait(&w->cond, &w->lock);
+    if (w->nr_free)
+        w->cur = w->free_ids[--w->nr_free];
+    pthread_mutex_unlock(&w->lock);
+    return w->cur >= 0 ? 0 : -1;
+}
+
+static int trace_nr_free(rtbw_trace_writer *w) {
+    pthread_mutex_lock(&w->lock);
+    int n = w->nr_free;
+    pthread_mutex_unlock(&w->lock);
+    return n;
+}
+
+// 追加到写盘缓冲区，写满即交给后台线程；没有空闲缓冲区时阻塞
+// （报告线程在trace_flush_chunk中预先检查，不会阻塞）
+static void trace_append(rtbw_trace_writer *w, const void *data, uint32_t len) {
+    const uint8_t *p = data;
+    while (len) {
+        trace_acquire(w, 1);
+        uint32_t n = TRACE_BUF_SIZE - w->cur_len;
+        if (n > len)
+            n = len;
+        memcpy(w->bufs[w->cur] + w->cur_len, p, n);
+        w->cur_len += n;
+        w->file_off += n;
+        p += n;
+        len -= n;
+        if (w->cur_len == TRACE_BUF_SIZE)
+            trace_submit(w, TRACE_BUF_SIZE);
+    }
+}
+
+static void trace_reset_chunk(rtbw_trace_writer *w) {
+    memset(&w->ch, 0, sizeof(w->ch));
+    w->len = 0;
+    w->prev_tsc = w->prev_d = 0;
+    w->prev_rc = 0;
+    memset(w->prev_tx, 0, sizeof(w->prev_tx));
+    memset(w->prev_rx, 0, sizeof(w->prev_rx));
+}
+
+// 结束当前块：写盘跟不上（放不下且没有空闲缓冲区）时整块丢弃
+static void trace_flush_chunk(rtbw_trace_writer *w) {
+    if (!w->ch.nr_records)
+        return;
+    uint32_t size = sizeof(w->ch) + w->len;
+    if (!w->lossless && (trace_acquire(w, 0) < 0 ||
+        (size > TRACE_BUF_SIZE - w->cur_len && !trace_nr_free(w)))) {
+        w->dropped += w->ch.nr_records;
+        trace_reset_chunk(w);
+        return;
+    }
+    if (w->nr_index == w->cap_index) {
+        uint64_t cap = w->cap_index ? w->cap_index * 2 : 1024;
+        void *p = realloc(w->index, cap * sizeof(w->index[0]));
+        if (!p) {
+            w->dropped += w->ch.nr_records;
+            trace_reset_chunk(w);
+            return;
+        }
+        w->index = p;
+        w->cap_index = cap;
+    }
+    w->index[w->nr_index++] = (struct rtbw_trace_index_entry) {
+        .offset = w->file_off, .first_tsc = w->ch.first_tsc,
+        .last_tsc = w->ch.last_tsc, .nr_records = w->ch.nr_records,
+    };
+    w->ch.magic = RTBW_TRACE_CHUNK_MAGIC;
+    w->ch.payload_size = w->len;
+    w->nr_records += w->ch.nr_records;
+    trace_append(w, &w->ch, sizeof(w->ch));
+    trace_append(w, w->payload, w->len);
+    trace_reset_chunk(w);
+}
+
+void rtbw_trace_add(rtbw_trace_writer *w, const rtbw_sample *r) {
+    int event = r->target >= RTBW_TARGET_EVENT;
+    if (r->target >= w->nr_targets && !event)
+        return;
+    uint32_t t = !event ? r->target : (uint32_t)w->nr_targets + (RTBW_TARGET_PERIOD - r->target);
+    uint8_t *p = w->payload + w->len;
+    int new_round = w->ch.nr_records == 0 || r->tsc != w->prev_tsc;
+    p = put_varint(p, (uint64_t)t << 2 | new_round << 1 | (!event && r->err != 0));
+    if (new_round) {
+        uint64_t d = r->tsc - w->prev_tsc;
+        p = put_varint(p, zigzag((int64_t)(d - w->prev_d)));
+        w->prev_d = d;
+        w->prev_tsc = r->tsc;
+    }
+    if (event) {
+        p = put_varint(p, r->tx);
+        p = put_varint(p, r->rx);
+    } else {
+        p = put_varint(p, zigzag((int64_t)(r->tx - w->prev_tx[t])));
+        p = put_varint(p, zigzag((int64_t)(r->rx - w->prev_rx[t])));
+        p = put_varint(p, zigzag((int64_t)r->read_cycles - w->prev_rc));
+        if (r->err)
+            p = put_varint(p, -(int64_t)r->err);
+        w->prev_tx[t] = r->tx;
+        w->prev_rx[t] = r->rx;
+        w->prev_rc = r->read_cycles;
+    }
+    if (w->ch.nr_records++ == 0)
+        w->ch.first_tsc = r->tsc;
+    w->ch.last_tsc = r->tsc;
+    w->len = p - w->payload;
+    if (w->len >= TRACE_CHUNK_PAYLOAD)
+        trace_flush_chunk(w);
+}
+
+void rtbw_trace_backfill(rtbw_trace_writer *w, uint64_t start_tsc) {
+    // 文件头在关闭时整体回填，这里只改内存中的副本：起始时刻按当前的TSC/实时时钟对应关系前推
+    uint64_t now = w->hdr->start_tsc;
+    w->hdr->start_realtime_ns -= (int64_t)((double)(int64_t)(now - start_tsc) * 1e9 / w->hdr->tsc_hz);
+    w->hdr->start_tsc = start_tsc;
+    w->lossless = 1;
+}
+
+uint64_t rtbw_trace_dropped(rtbw_trace_writer *w) {
+    return w->dropped;
+}
+
+rtbw_trace_writer *rtbw_trace_create(const char *path, const rtbw_engine *e) {
+    rtbw_trace_writer *w = calloc(1, sizeof(*w));
+    if (!w) {
+        perror("alloc trace writer failed");
+        return NULL;
+    }
+    // 优先O_DIRECT绕过页缓存；文件系统不支持（如tmpfs）时退回普通写
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (w->fd < 0 && errno == EINVAL)
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        perror("open trace file failed");
+        free(w);
+        return NULL;
+    }
+    w->hdr = aligned_alloc(TRACE_ALIGN, RTBW_TRACE_HDR_SIZE);
+    for (int i = 0; i < TRACE_NR_BUFS; i++) {
+        w->bufs[i] = aligned_alloc(TRACE_ALIGN, TRACE_BUF_SIZE);
+        if (!w->bufs[i] || !w->hdr) {
+            perror("alloc trace buffer failed");
+            goto fail;
+        }
+    }
+    w->cur = 0;
+    for (int i = TRACE_NR_BUFS - 1; i > 0; i--)
+        w->free_ids[w->nr_free++] = i;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->nr_targets = e->nr_targets;
+    trace_reset_chunk(w);
+
+    // 文件头：TSC频率、起始时刻、主机和设备标识
+    struct rtbw_trace_header *h = w->hdr;
+    _Static_assert(sizeof(*h) <= RTBW_TRACE_HDR_SIZE, "trace header too large");
+    memset(h, 0, RTBW_TRACE_HDR_SIZE);
+    memcpy(h->magic, RTBW_TRACE_MAGIC, sizeof(RTBW_TRACE_MAGIC));
+    h->version = RTBW_TRACE_VERSION;
+    h->header_size = RTBW_TRACE_HDR_SIZE;
+    h->tsc_hz = rtbw_clock_hz();
+    struct timespec ts;
+    h->start_tsc = rtbw_rdtscp();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h->start_realtime_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    h->nr_targets = e->nr_targets;
+    snprintf(h->backend, sizeof(h->backend), "%s", e->backend->name);
+    gethostname(h->host, sizeof(h->host) - 1);
+    struct utsname u;
+    if (uname(&u) == 0)
+        snprintf(h->kernel, sizeof(h->kernel), "%.63s", u.release);
+    memcpy(h->target_name, e->target_name, sizeof(h->target_name));
+    trace_append(w, h, RTBW_TRACE_HDR_SIZE);
+
+    if (pthread_create(&w->thread, NULL, trace_writer_main, w) != 0) {
+        perror("pthread_create trace writer failed");
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        goto fail;
+    }
+    return w;
+fail:
+    close(w->fd);
+    unlink(path);
+    free(w->hdr);
+    for (int i = 0; i < TRACE_NR_BUFS; i++)
+        free(w->bufs[i]);
+    free(w->index);
+    free(w);
+    return NULL;
+}
+
+int rtbw_trace_close(rtbw_trace_writer *w, double tsc_hz) {
+    trace_flush_chunk(w);
+
+    // 索引（关闭时允许等待后台线程腾出缓冲区）
+    uint64_t index_off = w->file_off;
+    uint64_t index_len = sizeof(struct rtbw_trace_index) + w->nr_index * sizeof(w->index[0]);
+    struct rtbw_trace_index *idx = malloc(index_len);
+    if (idx) {
+        idx->magic = RTBW_TRACE_INDEX_MAGIC;
+        idx->nr_chunks = w->nr_index;
+        memcpy(idx->entry, w->index, w->nr_index * sizeof(w->index[0]));
+        trace_append(w, idx, index_len);
+        free(idx);
+    } else {
+        index_off = 0;
+    }
+
+    // 最后一个缓冲区补齐到对齐长度，写完后截断到实际长度
+    if (w->cur >= 0 && w->cur_len) {
+        uint32_t padded = (w->cur_len + TRACE_ALIGN - 1) & ~(TRACE_ALIGN - 1);
+        memset(w->bufs[w->cur] + w->cur_len, 0, padded - w->cur_len);
+        trace_submit(w, padded);
+    }
+    pthread_mutex_lock(&w->lock);
+    w->done = 1;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    int ret = w->error ? -1 : 0;
+    if (ftruncate(w->fd, w->file_off) < 0) {
+        perror("truncate trace failed");
+        ret = -1;
+    }
+    w->hdr->tsc_hz = tsc_hz;
+    w->hdr->index_offset = index_off;
+    w->hdr->nr_chunks = w->nr_index;
+    w->hdr->nr_records = w->nr_records;
+    if (pwrite(w->fd, w->hdr, RTBW_TRACE_HDR_SIZE, 0) != RTBW_TRACE_HDR_SIZE) {
+        perror("write trace header failed");
+        ret = -1;
+    }
+    if (fdatasync(w->fd) < 0)
+        ret = -1;
+    close(w->fd);
+
+    for (int i = 0; i < TRACE_NR_BUFS; i++)
+        free(w->bufs[i]);
+    free(w->hdr);
+    free(w->index);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w);
+    return ret;
+}
+
+// ==================== 读取 ====================
+
+struct rtbw_trace_reader {
+    int fd;
+    struct rtbw_trace_header hdr;
+    struct rtbw_trace_index_entry *index;
+    uint64_t nr_index;
+    uint64_t end;                       // 块区域结束位置（索引偏移或文件长度）
+    uint64_t next_off;                  // 下一个块头的偏移
+    // 当前块
+    uint8_t *payload;
+    uint32_t cap, pos, len, left;
+    uint64_t prev_tsc, prev_d;
+    uint32_t prev_rc;
+    uint64_t prev_tx[RTBW_MAX_TARGETS], prev_rx[RTBW_MAX_TARGETS];
+};
+
+static int read_full(int fd, void *buf, size_t len, uint64_t off) {
+    return pread(fd, buf, len, off) == (ssize_t)len ? 0 : -1;
+}
+
+rtbw_trace_reader *rtbw_trace_open(const char *path) {
+    rtbw_trace_reader *r = calloc(1, sizeof(*r));
+    if (!r) {
+        perror("alloc trace reader failed");
+        return NULL;
+    }
+    struct stat st;
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0 || fstat(r->fd, &st) < 0) {
+        perror("open trace failed");
+        goto fail;
+    }
+    // 文件头可能短于当前结构（目标数上限较小时写的文件），只读取文件中存在的部分
+    size_t hdr_len = (uint64_t)st.st_size < sizeof(r->hdr) ? (size_t)st.st_size : sizeof(r->hdr);
+    if (read_full(r->fd, &r->hdr, hdr_len, 0) < 0 ||
+        memcmp(r->hdr.magic, RTBW_TRACE_MAGIC, sizeof(RTBW_TRACE_MAGIC)) != 0 ||
+        r->hdr.version == 0 || r->hdr.version > RTBW_TRACE_VERSION || r->hdr.nr_targets > RTBW_MAX_TARGETS ||
+        offsetof(struct rtbw_trace_header, target_name) + r->hdr.nr_targets * RTBW_NAME_LEN > r->hdr.header_size) {
+        fprintf(stderr, "%s: 不是有效的trace文件\n", path);
+        goto fail;
+    }
+    r->end = st.st_size;
+    if (r->hdr.index_offset) {
+        struct rtbw_trace_index idx;
+        if (read_full(r->fd, &idx, sizeof(idx), r->hdr.index_offset) == 0 &&
+            idx.magic == RTBW_TRACE_INDEX_MAGIC &&
+            r->hdr.index_offset + sizeof(idx) + (uint64_t)idx.nr_chunks * sizeof(r->index[0]) <= (uint64_t)st.st_size) {
+            r->index = malloc((idx.nr_chunks + 1) * sizeof(r->index[0]));
+            if (r->index && read_full(r->fd, r->index, idx.nr_chunks * sizeof(r->index[0]),
+                                      r->hdr.index_offset + sizeof(idx)) == 0) {
+                r->nr_index = idx.nr_chunks;
+                r->end = r->hdr.index_offset;
+            }
+        }
+        if (!r->nr_index)
+            fprintf(stderr, "%s: 索引损坏，按块顺序扫描\n", path);
+    }
+    r->next_off = r->hdr.header_size;
+    return r;
+fail:
+    rtbw_trace_free(r);
+    return NULL;
+}
+
+const struct rtbw_trace_header *rtbw_trace_header(rtbw_trace_reader *r) {
+    return &r->hdr;
+}
+
+void rtbw_trace_seek(rtbw_trace_reader *r, uint64_t tsc) {
+    r->left = 0;
+    r->next_off = r->hdr.header_size;
+    if (!r->nr_index)
+        return;
+    uint64_t lo = 0, hi = r->nr_index;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (r->index[mid].last_tsc < tsc)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    r->next_off = lo < r->nr_index ? r->index[lo].offset : r->end;
+}
+
+// 读入下一个块：0成功，1没有更多块，-1块损坏
+static int trace_load_chunk(rtbw_trace_reader *r) {
+    struct rtbw_trace_chunk ch;
+    if (r->next_off + sizeof(ch) > r->end)
+        return 1;
+    if (read_full(r->fd, &ch, sizeof(ch), r->next_off) < 0 ||
+        ch.magic != RTBW_TRACE_CHUNK_MAGIC ||
+        r->next_off + sizeof(ch) + ch.payload_size > r->end)
+        return -1;
+    if (ch.payload_size > r->cap) {
+        uint8_t *p = realloc(r->payload, ch.payload_size);
+        if (!p)
+            return -1;
+        r->payload = p;
+        r->cap = ch.payload_size;
+    }
+    if (read_full(r->fd, r->payload, ch.payload_size, r->next_off + sizeof(ch)) < 0)
+        return -1;
+    r->next_off += sizeof(ch) + ch.payload_size;
+    r->pos = 0;
+    r->len = ch.payload_size;
+    r->left = ch.nr_records;
+    r->prev_tsc = r->prev_d = 0;
+    r->prev_rc = 0;
+    memset(r->prev_tx, 0, sizeof(r->prev_tx));
+    memset(r->prev_rx, 0, sizeof(r->prev_rx));
+    return 0;
+}
+
+static inline int get_varint(rtbw_trace_reader *r, uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64 && r->pos < r->len; shift += 7) {
+        uint8_t b = r->payload[r->pos++];
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int rtbw_trace_next(rtbw_trace_reader *r, rtbw_sample *out) {
+    while (r->left == 0) {
+        int ret = trace_load_chunk(r);
+        if (ret)
+            // 没有索引的文件可能在最后一个块中途被截断，视为正常结束
+            return ret > 0 || !r->nr_index ? 0 : -1;
+    }
+    uint64_t key, v;
+    if (get_varint(r, &key) < 0 || (key >> 2) > r->hdr.nr_targets + (RTBW_TARGET_PERIOD - RTBW_TARGET_EVENT))
+        return -1;
+    uint32_t t = key >> 2;
+    if (key & 2) {
+        if (get_varint(r, &v) < 0)
+            return -1;
+        r->prev_d += unzigzag(v);
+        r->prev_tsc += r->prev_d;
+    }
+    if (t >= r->hdr.nr_targets) {
+        // 采样周期事件、触发事件、标记事件
+        *out = (rtbw_sample) { .tsc = r->prev_tsc, .target = RTBW_TARGET_PERIOD - (t - r->hdr.nr_targets) };
+        if (get_varint(r, &out->tx) < 0 || get_varint(r, &out->rx) < 0)
+            return -1;
+        r->left--;
+        return 1;
+    }
+    if (get_varint(r, &v) < 0)
+        return -1;
+    r->prev_tx[t] += unzigzag(v);
+    if (get_varint(r, &v) < 0)
+        return -1;
+    r->prev_rx[t] += unzigzag(v);
+    if (get_varint(r, &v) < 0)
+        return -1;
+    r->prev_rc += unzigzag(v);
+    out->err = 0;
+    if (key & 1) {
+        if (get_varint(r, &v) < 0)
+            return -1;
+        out->err = -(int16_t)v;
+    }
+    out->tsc = r->prev_tsc;
+    out->tx = r->prev_tx[t];
+    out->rx = r->prev_rx[t];
+    out->read_cycles = r->prev_rc;
+    out->target = t;
+    r->left--;
+    return 1;
+}
+
+void rtbw_trace_free(rtbw_trace_reader *r) {
+    if (r->fd >= 0)
+        close(r->fd);
+    free(r->index);
+    free(r->payload);
+    free(r);
+}
@@ -0,0 +1,99 @@
+#ifndef RTBW_TRACE_H
+#define RTBW_TRACE_H
+
+#include <stdint.h>
+#include "rtbw_spsc.h"
+#include "rtbw_engine.h"
+
+// 原始采样的二进制记录文件
+// 文件布局：
+//   [文件头 header_size字节] [块0] [块1] ... [索引] [尾部]
+// 1. 文件头记录TSC频率、起始时刻和设备标识，单独一个文件即可解释
+// 2. 每个块 = 块头 + 编码后的记录，块内状态从零开始，因此每个块可以独立解码
+// 3. 记录编码（LEB128 varint，有符号量先zigzag）：
+//      key = target << 2 | 新一轮(tsc变化) << 1 | 有错误
+//      新一轮时：tsc增量与上一个增量之差（固定周期下通常1字节）
+//      tx、rx：相对该目标上一条记录的增量
+//      read_cycles：与上一条记录之差
+//      有错误时：-err
+//    事件（RTBW_TARGET_PERIOD）：key = nr_targets << 2 | 新一轮 << 1，之后是（新一轮时的tsc增量）、
+//      新周期、旧周期（纳秒），不影响各目标的增量状态
+//    触发事件（RTBW_TARGET_TRIGGER）：key = (nr_targets + 1) << 2 | 新一轮 << 1，之后是tx、rx
+//    标记事件（RTBW_TARGET_MARK）：key = (nr_targets + 2) << 2 | 新一轮 << 1，之后是tx、rx
+//    即事件的key为 nr_targets + (RTBW_TARGET_PERIOD - target)
+// 4. 正常关闭时在末尾写索引（每块的偏移和TSC范围）并回填文件头；
+//    异常退出的文件没有索引，读取时按块头顺序扫描到第一个损坏的块为止
+// 写入：报告线程编码，后台线程用大块对齐缓冲区写盘（尽量O_DIRECT），采样线程不涉及任何I/O
+// 飞行记录转储也用同样的格式（rtbw_trace_backfill），rtbw_dump和synth回放可以直接读取
+
+#define RTBW_TRACE_MAGIC "RTBWTRC"
+#define RTBW_TRACE_VERSION 4                // 2：增加采样周期事件；3：增加触发事件；4：增加标记事件；旧版本的文件仍可读取
+#define RTBW_TRACE_HDR_SIZE 12288          // 旧文件为4096字节，读取时以文件头的header_size为准
+#define RTBW_TRACE_CHUNK_MAGIC 0x4b4e4843      // "CHNK"
+#define RTBW_TRACE_INDEX_MAGIC 0x58444e49      // "INDX"
+
+struct rtbw_trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    double tsc_hz;                  // 关闭时用修正后的频率回填
+    uint64_t start_tsc;             // 与start_realtime_ns同一时刻的TSC
+    uint64_t start_realtime_ns;     // CLOCK_REALTIME
+    uint64_t index_offset;          // 0表示没有索引（未正常关闭）
+    uint64_t nr_chunks;
+    uint64_t nr_records;
+    uint32_t nr_targets;
+    uint32_t reserved;
+    char backend[16];
+    char host[64];
+    char kernel[64];
+    char target_name[RTBW_MAX_TARGETS][RTBW_NAME_LEN];
+};
+
+struct rtbw_trace_chunk {
+    uint32_t magic;
+    uint32_t nr_records;
+    uint32_t payload_size;          // 块头之后的编码字节数
+    uint32_t reserved;
+    uint64_t first_tsc;
+    uint64_t last_tsc;
+};
+
+struct rtbw_trace_index_entry {
+    uint64_t offset;                // 块头在文件中的偏移
+    uint64_t first_tsc;
+    uint64_t last_tsc;
+    uint32_t nr_records;
+    uint32_t reserved;
+};
+
+struct rtbw_trace_index {
+    uint32_t magic;
+    uint32_t nr_chunks;
+    struct rtbw_trace_index_entry entry[];
+};
+
+typedef struct rtbw_trace_writer rtbw_trace_writer;
+typedef struct rtbw_trace_reader rtbw_trace_reader;
+
+// 写入（报告线程调用）
+rtbw_trace_writer *rtbw_trace_create(const char *path, const rtbw_engine *e);
+void rtbw_trace_add(rtbw_trace_writer *w, const rtbw_sample *r);
+// 补写已有的采样（飞行记录转储）：文件起始时刻改为start_tsc，写盘跟不上时等待而不丢弃；
+// 在第一次rtbw_trace_add之前调用
+void rtbw_trace_backfill(rtbw_trace_writer *w, uint64_t start_tsc);
+// 写盘跟不上而丢弃的记录数
+uint64_t rtbw_trace_dropped(rtbw_trace_writer *w);
+// 写出剩余数据和索引，回填文件头；返回-1表示写盘出错
+int rtbw_trace_close(rtbw_trace_writer *w, double tsc_hz);
+
+// 读取
+rtbw_trace_reader *rtbw_trace_open(const char *path);
+const struct rtbw_trace_header *rtbw_trace_header(rtbw_trace_reader *r);
+// 定位到第一个last_tsc >= tsc的块（需要索引；没有索引时从头扫描）
+void rtbw_trace_seek(rtbw_trace_reader *r, uint64_t tsc);
+// 读下一条记录：1成功，0结束，-1文件损坏
+int rtbw_trace_next(rtbw_trace_reader *r, rtbw_sample *out);
+void rtbw_trace_free(rtbw_trace_reader *r);
+
+#endif // RTBW_TRACE_H